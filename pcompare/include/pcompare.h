@@ -10,6 +10,11 @@
  */
 
 #include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**
  * Number of comparing branches supported.
@@ -20,6 +25,12 @@
 #define ERROR     -1
 #define SUCCESS   0
 
+/**
+ * pcompare_lookup() flags
+ */
+#define PCOMPARE_LOOKUP_EXACT   0   //packages with the name
+#define PCOMPARE_LOOKUP_PREFIX  1   //packages which names start with the name
+
 // structure to store JSON file parameters
 typedef struct f_param
 {
@@ -29,14 +40,108 @@ typedef struct f_param
     void        *fptr;      //mapped file data pointer
 }f_param_t;
 
+// options of a comparison, zero initialized options (or NULL pointer) are the defaults
+typedef struct pcompare_options
+{
+    const char  *base_url;      //URL of the branches export, a branch is loaded from "<url>/<branch>";
+                                //NULL - the ALT Linux export https://rdb.altlinux.org/api/export/branch_binary_packages/
+    size_t      max_memory;     //memory budget in bytes, at least 4 MiB; 0 - unlimited.
+                                //With a budget the branches are sorted to runs in temporary files
+                                //($TMPDIR or /tmp) and merged from disk instead of being loaded to memory
+    const char  *cache_dir;     //reports cache directory (created if missing), NULL - no cache.
+                                //A report is reused while both branches files are not changed
+    size_t      cache_size;     //reports cache size limit in bytes, the least recently used reports
+                                //are removed over it; 0 - unlimited
+    int         summary;        //1 - instead of the packages arrays the report has their lengths and
+                                //per-architecture counters only; with a memory budget they are counted
+                                //by the merge of the runs
+}pcompare_options_t;
+
+// parsed branch, opaque handle
+typedef struct pcompare_branch pcompare_branch_t;
+
+#define PCOMPARE_JOB_LOADING        0   // branches of the job are downloading
+#define PCOMPARE_JOB_COMPARING      1   // branches of the job are parsing and comparing
+#define PCOMPARE_JOB_DONE           2   // the report is ready
+#define PCOMPARE_JOB_FAILED         3   // the job failed
+#define PCOMPARE_JOB_CANCELLED      4   // the job is cancelled
+
+// asynchronous comparison job
+typedef struct pcompare_job pcompare_job_t;
+
+// progress of an asynchronous comparison job
+typedef struct pcompare_progress
+{
+    int         state;          //PCOMPARE_JOB_* state
+    size_t      loaded_bytes;   //downloaded bytes
+    size_t      total_bytes;    //total size of the downloads, if known
+}pcompare_progress_t;
+
+// comparison job of a batch
+typedef struct pcompare_batch_job
+{
+    const char  *branch1;   //first branch name
+    const char  *branch2;   //second branch name
+    const char  *out_file;  //report file name
+    int         result;     //comparison result, set by pcompare_process_batch
+}pcompare_batch_job_t;
+
+// package information, zero terminated strings are owned by the branch
+typedef struct pcompare_package
+{
+    const char  *name;          //package name
+    const char  *version;       //package version
+    const char  *arch;          //package architecture
+    size_t      name_len;       //package name length
+    size_t      version_len;    //package version length
+    size_t      arch_len;       //package architecture length
+}pcompare_package_t;
+
+#define PCOMPARE_DIFF_END               0   // no more differences
+#define PCOMPARE_DIFF_ONLY_IN_FIRST     1   // package of the first branch is absent in the second one
+#define PCOMPARE_DIFF_ONLY_IN_SECOND    2   // package of the second branch is absent in the first one
+#define PCOMPARE_DIFF_NEWER_IN_FIRST    3   // package version in the first branch is newer than in the second one
+
+// difference of two branches, packages are owned by the branches
+typedef struct pcompare_difference
+{
+    int                 kind;       //PCOMPARE_DIFF_* kind
+    pcompare_package_t  first;      //package of the first branch (zeroed for PCOMPARE_DIFF_ONLY_IN_SECOND)
+    pcompare_package_t  second;     //package of the second branch (zeroed for PCOMPARE_DIFF_ONLY_IN_FIRST)
+}pcompare_difference_t;
+
+// position of a branches comparison, zero initialized one is the beginning
+typedef struct pcompare_diff_cursor
+{
+    size_t  pos[N_BRANCHES_TO_COMPARE_SUPPORTED];   //current record of every branch
+}pcompare_diff_cursor_t;
+
+/**
+ * @brief pcompare_set_threads  sets number of the library worker threads.
+ *                              Threads are created once per process, on the first parallel task,
+ *                              so the function must be called before any other library function.
+ * @param n_threads             number of worker threads, 0 means number of online CPUs (default)
+ * @return                      SUCCESS on success, ERROR if the worker threads are already started
+ */
+int pcompare_set_threads(const size_t n_threads);
+
 /**
  * @brief pcompare_load_files   loads packages information to appropriated file
- * @param fparam                - pointer to a f_param_t structure
+ * @param fparam                - pointer to an array of f_param_t structures
  * @param n_branches            - number of branches
  * @return                      SUCCESS on success, ERROR otherwise
  */
 int pcompare_load_files(f_param_t *fparam, const size_t n_branches);
 
+/**
+ * @brief pcompare_load_files_from  loads packages information to appropriated file from the export of the options
+ * @param fparam                    pointer to an array of f_param_t structures
+ * @param n_branches                number of branches
+ * @param options                   pointer to comparison options, NULL for the defaults
+ * @return                          SUCCESS on success, ERROR otherwise
+ */
+int pcompare_load_files_from(f_param_t *fparam, const size_t n_branches, const pcompare_options_t *options);
+
 
 /**
  * @brief pcompare_open_downloaded_files    opens and prepares for parsing downloaded fines
@@ -55,12 +160,237 @@ int pcompare_open_downloaded_files(f_param_t *fparam, const size_t n_branches);
 int pcompare_close_files(f_param_t *fparam, const int count);
 
 /**
- * @brief pcompsre_process_branches     comparing packages' branches and output the result
+ * @brief pcompare_process_branches_to  comparing packages' branches and output the result to a stream
+ * @param out                           output stream
+ * @param fparam                        pointer to an array of f_param_t structures
+ * @param n_branches                    number of branches to process
+ * @param options                       pointer to comparison options, NULL for the defaults
+ * @return                              SUCCESS code on success, ERROR code otherwise
+ */
+int pcompare_process_branches_to(FILE *out, const f_param_t *fparam, const size_t n_branches,
+                                 const pcompare_options_t *options);
+
+/**
+ * @brief pcompsre_process_branches     comparing packages' branches with the default options and output the result
  * @param fparam                        pointer to an array of f_param_t structures
  * @param n_branches                    number of branches to process
  * @return                              SUCCESS code on success, ERROR code otherwise
  */
 int pcompare_process_branches(const f_param_t *fparam, const size_t n_branches);
 
-#endif //__PCOMPARE_H_
+/**
+ * @brief pcompare_process_matrix   compares every ordered pair of branches (M*(M-1) comparisons).
+ *                                  Each branch is parsed once, all comparisons share the parsed tables
+ *                                  and run concurrently. Files must be opened with pcompare_open_downloaded_files.
+ * @param fparam                    pointer to an array of f_param_t structures
+ * @param n_branches                number of branches, at least 2
+ * @param out_dir                   directory for "<branch1>_vs_<branch2>.json" report files,
+ *                                  NULL to output one combined JSON report keyed by "<branch1>_vs_<branch2>"
+ * @param options                   pointer to comparison options (summary mode), NULL for the defaults
+ * @return                          SUCCESS code on success, ERROR code otherwise
+ */
+int pcompare_process_matrix(const f_param_t *fparam, const size_t n_branches, const char *out_dir,
+                            const pcompare_options_t *options);
+
+/**
+ * @brief pcompare_process_batch    runs a batch of comparisons sharing downloads and parsed branches.
+ *                                  Every distinct branch of the jobs is downloaded and parsed once,
+ *                                  then the comparisons run concurrently, each to its report file
+ * @param jobs                      pointer to an array of pcompare_batch_job_t structures,
+ *                                  the result of every job is set
+ * @param n_jobs                    number of jobs
+ * @param options                   pointer to comparison options (export URL, summary mode), NULL for the defaults
+ * @return                          SUCCESS code if all jobs succeeded, ERROR code otherwise
+ */
+int pcompare_process_batch(pcompare_batch_job_t *jobs, const size_t n_jobs, const pcompare_options_t *options);
 
+/**
+ * @brief pcompare_branch_open  parses an opened branch file and builds the point-query index
+ * @param fparam                pointer to a f_param_t structure opened with pcompare_open_downloaded_files
+ * @return                      branch handle on success, NULL otherwise
+ */
+pcompare_branch_t *pcompare_branch_open(const f_param_t *fparam);
+
+/**
+ * @brief pcompare_branch_close releases a branch handle, the same as pcompare_branch_release
+ * @param branch                branch handle
+ */
+void pcompare_branch_close(pcompare_branch_t *branch);
+
+/**
+ * @brief pcompare_branch_acquire   returns a shared read-only handle of a downloaded branch ("<name>.json").
+ *                                  All threads acquiring the same branch file share one parsed copy,
+ *                                  the branch is parsed by the first acquirer, other ones wait for it.
+ *                                  The copy is kept while it has references. A downloaded again file
+ *                                  (other inode, size or modification time) is parsed anew,
+ *                                  handles of the old copy stay valid.
+ * @param pack_name                 branch name
+ * @return                          branch handle on success, NULL otherwise
+ */
+pcompare_branch_t *pcompare_branch_acquire(const char *pack_name);
+
+/**
+ * @brief pcompare_branch_release   drops a reference of a branch handle, the last one frees the branch
+ * @param branch                    branch handle
+ */
+void pcompare_branch_release(pcompare_branch_t *branch);
+
+/**
+ * @brief pcompare_branch_ref   adds a reference to a branch handle, it is dropped by pcompare_branch_release
+ * @param branch                branch handle
+ * @return                      the same branch handle
+ */
+pcompare_branch_t *pcompare_branch_ref(pcompare_branch_t *branch);
+
+/**
+ * @brief pcompare_compare  compares two branches and outputs the result to a stream.
+ *                          Branches are not modified, so any number of comparisons may share them
+ * @param branch1           first branch handle
+ * @param branch2           second branch handle
+ * @param out               output stream
+ * @param options           pointer to comparison options (summary mode), NULL for the defaults
+ * @return                  SUCCESS code on success, ERROR code otherwise
+ */
+int pcompare_compare(const pcompare_branch_t *branch1, const pcompare_branch_t *branch2, FILE *out,
+                     const pcompare_options_t *options);
+
+/**
+ * @brief pcompare_branch_name  returns the branch name
+ * @param branch                branch handle
+ * @return                      branch name
+ */
+const char *pcompare_branch_name(const pcompare_branch_t *branch);
+
+/**
+ * @brief pcompare_lookup   finds versions of a package in a branch (binary search in the branch index)
+ * @param branch            branch handle
+ * @param name              package name or name prefix
+ * @param flags             PCOMPARE_LOOKUP_EXACT or PCOMPARE_LOOKUP_PREFIX
+ * @param packages          array to store found packages sorted by name and arch, may be NULL if max_packages is 0
+ * @param max_packages      array size
+ * @return                  number of found packages (may be greater than max_packages)
+ */
+size_t pcompare_lookup(const pcompare_branch_t *branch, const char *name, const int flags,
+                       pcompare_package_t *packages, const size_t max_packages);
+
+/**
+ * @brief pcompare_lookup_range finds versions of a package in a branch without copying them
+ * @param branch                branch handle
+ * @param name                  package name or name prefix (not zero terminated)
+ * @param name_len              name length
+ * @param flags                 PCOMPARE_LOOKUP_EXACT or PCOMPARE_LOOKUP_PREFIX
+ * @param first                 pointer to store position of the first found package (see pcompare_branch_package)
+ * @return                      number of found packages, they are at consecutive positions
+ */
+size_t pcompare_lookup_range(const pcompare_branch_t *branch, const char *name, const size_t name_len,
+                             const int flags, size_t *first);
+
+/**
+ * @brief pcompare_branch_size  returns number of packages in a branch
+ * @param branch                branch handle
+ * @return                      number of packages, 0 on invalid branch
+ */
+size_t pcompare_branch_size(const pcompare_branch_t *branch);
+
+/**
+ * @brief pcompare_branch_package   returns a package of a branch, packages are sorted by name and arch
+ * @param branch                    branch handle
+ * @param pos                       package position, less than pcompare_branch_size
+ * @param package                   pointer to a pcompare_package_t structure to fill
+ * @return                          SUCCESS on success, ERROR on invalid input parameter
+ */
+int pcompare_branch_package(const pcompare_branch_t *branch, const size_t pos, pcompare_package_t *package);
+
+/**
+ * @brief pcompare_diff_next    finds the next difference of two branches in the packages names order.
+ *                              Differences are evaluated lazily, one per call, nothing is allocated
+ * @param branch1               first branch handle
+ * @param branch2               second branch handle
+ * @param cursor                comparison position, zero initialized at the beginning
+ * @param diff                  pointer to a pcompare_difference_t structure to fill
+ * @return                      PCOMPARE_DIFF_* kind, PCOMPARE_DIFF_END at the end, ERROR on invalid input parameter
+ */
+int pcompare_diff_next(const pcompare_branch_t *branch1, const pcompare_branch_t *branch2,
+                       pcompare_diff_cursor_t *cursor, pcompare_difference_t *diff);
+
+/**
+ * @brief pcompare_history_add  adds a snapshot of a branch to the history archive "<dir>/<branch>".
+ *                              Snapshots are deltas of added, removed and version-changed packages against
+ *                              the previous one; the first snapshot, one after every 30 deltas and one changing
+ *                              most of the packages are checkpoints of all packages
+ * @param dir                   archive directory (created if missing)
+ * @param branch                branch handle
+ * @param date                  snapshot date "YYYY-MM-DD", later than the last archived one
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+int pcompare_history_add(const char *dir, const pcompare_branch_t *branch, const char *date);
+
+/**
+ * @brief pcompare_history_open reconstructs a branch snapshot from the history archive, nothing is downloaded.
+ *                              The branch is named "<branch>@<date>", it is compared and looked up as any other one
+ * @param dir                   archive directory
+ * @param pack_name             branch name
+ * @param date                  date "YYYY-MM-DD", the last snapshot archived on or before it is taken;
+ *                              NULL for the last archived snapshot
+ * @return                      branch handle on success (release with pcompare_branch_release), NULL otherwise
+ */
+pcompare_branch_t *pcompare_history_open(const char *dir, const char *pack_name, const char *date);
+
+/**
+ * @brief pcompare_start    starts an asynchronous comparison of two branches and returns at once.
+ *                          The branches are downloaded by the library I/O thread and compared
+ *                          on the library worker threads, the job eventfd becomes readable
+ *                          on download progress and on every state change.
+ * @param branch1           first branch name
+ * @param branch2           second branch name
+ * @param report_file       file name for the report, NULL to keep the report in memory
+ * @param options           pointer to comparison options (export URL, memory budget, reports cache,
+ *                          summary mode), NULL for the defaults; the job keeps a copy of them
+ * @return                  job handle on success, NULL otherwise
+ */
+pcompare_job_t *pcompare_start(const char *branch1, const char *branch2, const char *report_file,
+                               const pcompare_options_t *options);
+
+/**
+ * @brief pcompare_job_fd   returns the job eventfd to wait for with poll/epoll
+ * @param job               job handle
+ * @return                  file descriptor, -1 on invalid job
+ */
+int pcompare_job_fd(const pcompare_job_t *job);
+
+/**
+ * @brief pcompare_poll     resets the job eventfd and returns the job progress, never blocks
+ * @param job               job handle
+ * @param progress          pointer to a pcompare_progress_t structure to fill, may be NULL
+ * @return                  PCOMPARE_JOB_* state, ERROR on invalid job
+ */
+int pcompare_poll(pcompare_job_t *job, pcompare_progress_t *progress);
+
+/**
+ * @brief pcompare_cancel   requests the job cancellation, never blocks.
+ *                          Downloads are stopped at once, a running comparison is finished
+ *                          and discarded; the job comes to PCOMPARE_JOB_CANCELLED state.
+ * @param job               job handle
+ * @return                  SUCCESS on success, ERROR on invalid job
+ */
+int pcompare_cancel(pcompare_job_t *job);
+
+/**
+ * @brief pcompare_job_report   returns the report kept in memory
+ * @param job                   job handle in PCOMPARE_JOB_DONE state
+ * @param size                  pointer to the report size, may be NULL
+ * @return                      report owned by the job, NULL if there is no report
+ */
+const char *pcompare_job_report(const pcompare_job_t *job, size_t *size);
+
+/**
+ * @brief pcompare_job_free     cancels an unfinished job and releases the handle, never blocks
+ * @param job                   job handle
+ */
+void pcompare_job_free(pcompare_job_t *job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__PCOMPARE_H_
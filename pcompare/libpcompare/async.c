@@ -0,0 +1,605 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Asynchronous comparison jobs.
+ * Downloads of all jobs are driven by one process wide I/O thread with the curl multi socket
+ * interface over epoll, parsing and comparison run on the library thread pool.
+ * Every job has an eventfd which is signalled on progress and state changes.
+ * Jobs comparing the same branch share its parsed data through the branches registry.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <curl/curl.h>
+#include "pcompare.h"
+#include "thread_pool.h"
+#include "compare.h"
+#include "download.h"
+
+#define IO_EVENTS               64                  // epoll events per wait
+#define PROGRESS_STEP           (1024 * 1024)       // downloaded bytes between progress signals
+#define URL_LEN                 512
+
+//download of a job branch
+typedef struct transfer
+{
+    struct transfer *next;                  //next transfer in the I/O thread lists
+    struct pcompare_job *job;               //job of the transfer
+    CURL            *curl;                  //easy handle
+    FILE            *file;                  //temporary file
+    size_t          loaded;                 //downloaded bytes
+    size_t          signalled;              //downloaded bytes at the last progress signal
+    int             has_length;             //1 if the body length is counted in the job total
+    char            tmp_name[PATH_MAX];     //temporary file name
+    char            error[CURL_ERROR_SIZE]; //curl error message
+}transfer_t;
+
+struct pcompare_job
+{
+    char            *names[N_BRANCHES_TO_COMPARE_SUPPORTED];    //branches names
+    transfer_t      transfers[N_BRANCHES_TO_COMPARE_SUPPORTED]; //branches downloads
+    char            *report_file;       //report file name, NULL for the report in memory
+    pcompare_options_t options;         //comparison options, the strings are owned by the job
+    char            *report;            //report in memory
+    size_t          report_size;        //size of the report in memory
+    int             event_fd;           //progress and completion eventfd
+    int             state;              //PCOMPARE_JOB_* state (atomic)
+    int             cancelled;          //1 if the job is cancelled (atomic)
+    size_t          loaded_bytes;       //downloaded bytes (atomic)
+    size_t          total_bytes;        //known size of the downloads (atomic)
+    size_t          refs;               //references: the caller and the job pipeline (atomic)
+    size_t          n_loading;          //number of unfinished downloads (I/O thread only)
+    int             failed;             //1 if a download failed (I/O thread only)
+};
+
+//I/O thread state
+static struct
+{
+    pthread_once_t  once;
+    int             result;             //SUCCESS if the thread is started
+    int             epoll_fd;
+    int             wake_fd;            //eventfd to wake the thread up
+    CURLM           *multi;
+    long long       deadline;           //curl timeout deadline in ms, -1 if none
+    pthread_mutex_t lock;               //protects pending list
+    transfer_t      *pending;           //transfers to start
+    transfer_t      *active;            //started transfers (I/O thread only)
+}io = { PTHREAD_ONCE_INIT, ERROR, -1, -1, NULL, -1, PTHREAD_MUTEX_INITIALIZER, NULL, NULL };
+
+static tpool_group_t jobs_group;        //never waited group of the jobs tasks
+
+/**
+ * @brief now_ms    returns monotonic time in milliseconds
+ */
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief signal_fd     increments an eventfd counter
+ * @param fd            eventfd
+ */
+static void signal_fd(int fd)
+{
+    const uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        printf("eventfd write error: %s\n", strerror(errno));
+}
+
+/**
+ * @brief job_release   drops a job reference, frees the job with the last one
+ * @param job           pointer to a job
+ */
+static void job_release(pcompare_job_t *job)
+{
+    if (__atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL))
+        return;
+    for (size_t i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+        free(job->names[i]);
+    free(job->report_file);
+    free((char *)job->options.base_url);
+    free((char *)job->options.cache_dir);
+    free(job->report);
+    if (job->event_fd >= 0)
+        close(job->event_fd);
+    free(job);
+}
+
+/**
+ * @brief job_set_state     sets a job state and signals the job eventfd
+ * @param job               pointer to a job
+ * @param state             new state
+ */
+static void job_set_state(pcompare_job_t *job, const int state)
+{
+    __atomic_store_n(&job->state, state, __ATOMIC_RELEASE);
+    signal_fd(job->event_fd);
+}
+
+/**
+ * @brief job_finish    sets the final job state and drops the pipeline reference
+ * @param job           pointer to a job
+ * @param state         final state
+ */
+static void job_finish(pcompare_job_t *job, int state)
+{
+    if (state == PCOMPARE_JOB_DONE && __atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE))
+        state = PCOMPARE_JOB_CANCELLED;
+    job_set_state(job, state);
+    job_release(job);
+}
+
+/**
+ * @brief job_compare_task  thread pool task, parses and compares downloaded branches of a job
+ * @param param             pointer to a job
+ */
+static void job_compare_task(void *param)
+{
+    pcompare_job_t *job = (pcompare_job_t *)param;
+    FILE *out;
+
+    if (__atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE))
+    {
+        job_finish(job, PCOMPARE_JOB_CANCELLED);
+        return;
+    }
+    job_set_state(job, PCOMPARE_JOB_COMPARING);
+    if (job->report_file)
+        out = fopen(job->report_file, "w");
+    else
+        out = open_memstream(&job->report, &job->report_size);
+    int res = ERROR;
+    if (out)
+    {
+        res = compare_branches_by_name(out, job->names[0], job->names[1], &job->options);
+        if (fclose(out) != 0)
+            res = ERROR;
+    }
+    else
+    {
+        printf("Could not open report of \"%s\" and \"%s\" comparison: %s\n",
+               job->names[0], job->names[1], strerror(errno));
+    }
+    job_finish(job, (res == SUCCESS) ? PCOMPARE_JOB_DONE : PCOMPARE_JOB_FAILED);
+}
+
+/**
+ * @brief transfer_write_cb     curl write callback, writes downloaded data to the temporary file
+ * @return                      number of written bytes, 0 to abort the transfer
+ */
+static size_t transfer_write_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    transfer_t *t = (transfer_t *)userdata;
+    pcompare_job_t *job = t->job;
+    const size_t len = size * nmemb;
+
+    if (__atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE))
+        return 0;
+    if (!t->has_length)
+    {
+        curl_off_t length = -1;
+        t->has_length = 1;
+        if (curl_easy_getinfo(t->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK && length > 0)
+            __atomic_add_fetch(&job->total_bytes, (size_t)length, __ATOMIC_RELAXED);
+    }
+    if (fwrite(ptr, 1, len, t->file) != len)
+        return 0;
+    t->loaded += len;
+    __atomic_add_fetch(&job->loaded_bytes, len, __ATOMIC_RELAXED);
+    if (t->loaded - t->signalled >= PROGRESS_STEP)
+    {
+        t->signalled = t->loaded;
+        signal_fd(job->event_fd);
+    }
+    return len;
+}
+
+/**
+ * @brief transfer_finish   completes a download of a job branch,
+ *                          starts the comparison when all downloads of the job are finished
+ * @param t                 pointer to a transfer
+ * @param result            transfer result
+ */
+static void transfer_finish(transfer_t *t, const CURLcode result)
+{
+    pcompare_job_t *job = t->job;
+    const size_t i = t - job->transfers;
+    const int cancelled = __atomic_load_n(&job->cancelled, __ATOMIC_ACQUIRE);
+    char fname[PATH_MAX];
+
+    curl_easy_cleanup(t->curl);
+    t->curl = NULL;
+    int res = (fclose(t->file) == 0 && result == CURLE_OK && !cancelled) ? SUCCESS : ERROR;
+    t->file = NULL;
+    snprintf(fname, sizeof(fname), "%s.json", job->names[i]);
+    if (res == SUCCESS && rename(t->tmp_name, fname) != 0)
+    {
+        printf("Could not rename \"%s\" to \"%s\": %s\n", t->tmp_name, fname, strerror(errno));
+        res = ERROR;
+    }
+    if (res != SUCCESS)
+    {
+        unlink(t->tmp_name);
+        if (!cancelled)
+            printf("Package \"%s\" loading error: \"%s\"\n", job->names[i],
+                   t->error[0] ? t->error : curl_easy_strerror(result));
+        job->failed = 1;
+    }
+
+    if (--job->n_loading)
+        return;
+    if (cancelled)
+        job_finish(job, PCOMPARE_JOB_CANCELLED);
+    else if (job->failed)
+        job_finish(job, PCOMPARE_JOB_FAILED);
+    else
+        tpool_submit(&jobs_group, job_compare_task, job);
+}
+
+/**
+ * @brief io_socket_cb  curl socket callback, updates epoll set
+ * @return              0
+ */
+static int io_socket_cb(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp)
+{
+    struct epoll_event ev;
+    (void)easy; (void)userp; (void)socketp;
+
+    if (what == CURL_POLL_REMOVE)
+    {
+        epoll_ctl(io.epoll_fd, EPOLL_CTL_DEL, s, NULL);
+        return 0;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = s;
+    ev.events = ((what & CURL_POLL_IN) ? EPOLLIN : 0) | ((what & CURL_POLL_OUT) ? EPOLLOUT : 0);
+    if (epoll_ctl(io.epoll_fd, EPOLL_CTL_MOD, s, &ev) != 0 && errno == ENOENT)
+        epoll_ctl(io.epoll_fd, EPOLL_CTL_ADD, s, &ev);
+    return 0;
+}
+
+/**
+ * @brief io_timer_cb   curl timer callback, sets the timeout deadline
+ * @return              0
+ */
+static int io_timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+    (void)multi; (void)userp;
+    io.deadline = (timeout_ms < 0) ? -1 : now_ms() + timeout_ms;
+    return 0;
+}
+
+/**
+ * @brief io_unlink_active  removes a transfer from the active list
+ * @param t                 pointer to a transfer
+ */
+static void io_unlink_active(transfer_t *t)
+{
+    for (transfer_t **p = &io.active; *p; p = &(*p)->next)
+    {
+        if (*p == t)
+        {
+            *p = t->next;
+            break;
+        }
+    }
+    curl_multi_remove_handle(io.multi, t->curl);
+}
+
+/**
+ * @brief io_process_commands   starts pending transfers and stops transfers of cancelled jobs
+ */
+static void io_process_commands(void)
+{
+    pthread_mutex_lock(&io.lock);
+    transfer_t *pending = io.pending;
+    io.pending = NULL;
+    pthread_mutex_unlock(&io.lock);
+
+    while (pending)
+    {
+        transfer_t *t = pending;
+        pending = t->next;
+        if (__atomic_load_n(&t->job->cancelled, __ATOMIC_ACQUIRE) ||
+            curl_multi_add_handle(io.multi, t->curl) != CURLM_OK)
+        {
+            transfer_finish(t, CURLE_ABORTED_BY_CALLBACK);
+            continue;
+        }
+        t->next = io.active;
+        io.active = t;
+    }
+
+    transfer_t *t = io.active;
+    while (t)
+    {
+        transfer_t *next = t->next;
+        if (__atomic_load_n(&t->job->cancelled, __ATOMIC_ACQUIRE))
+        {
+            io_unlink_active(t);
+            transfer_finish(t, CURLE_ABORTED_BY_CALLBACK);
+        }
+        t = next;
+    }
+}
+
+/**
+ * @brief io_check_done     finishes completed transfers
+ */
+static void io_check_done(void)
+{
+    CURLMsg *msg;
+    int n_msgs;
+    while ((msg = curl_multi_info_read(io.multi, &n_msgs)))
+    {
+        if (msg->msg != CURLMSG_DONE) continue;
+        transfer_t *t;
+        const CURLcode result = msg->data.result;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&t);
+        io_unlink_active(t);
+        transfer_finish(t, result);
+    }
+}
+
+/**
+ * @brief io_thread     I/O thread main loop
+ * @param param         unused
+ * @return              never returns
+ */
+static void *io_thread(void *param)
+{
+    struct epoll_event events[IO_EVENTS];
+    int running;
+    (void)param;
+
+    for (;;)
+    {
+        int timeout = -1;
+        if (io.deadline >= 0)
+        {
+            const long long left = io.deadline - now_ms();
+            timeout = (left > 0) ? (int)left : 0;
+        }
+        const int n = epoll_wait(io.epoll_fd, events, IO_EVENTS, timeout);
+        for (int i = 0; i < n; ++i)
+        {
+            if (events[i].data.fd == io.wake_fd)
+            {
+                uint64_t count;
+                if (read(io.wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                    printf("eventfd read error: %s\n", strerror(errno));
+                io_process_commands();
+                continue;
+            }
+            const int flags = ((events[i].events & EPOLLIN) ? CURL_CSELECT_IN : 0) |
+                              ((events[i].events & EPOLLOUT) ? CURL_CSELECT_OUT : 0) |
+                              ((events[i].events & (EPOLLERR | EPOLLHUP)) ? CURL_CSELECT_ERR : 0);
+            curl_multi_socket_action(io.multi, events[i].data.fd, flags, &running);
+        }
+        if (io.deadline >= 0 && now_ms() >= io.deadline)
+        {
+            io.deadline = -1;
+            curl_multi_socket_action(io.multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        }
+        io_check_done();
+    }
+    return NULL;
+}
+
+/**
+ * @brief io_start  starts the I/O thread
+ */
+static void io_start(void)
+{
+    struct epoll_event ev;
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    download_global_init();
+    tpool_group_init(&jobs_group);
+    io.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    io.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    io.multi = curl_multi_init();
+    if (io.epoll_fd < 0 || io.wake_fd < 0 || !io.multi)
+    {
+        printf("Asynchronous I/O initialization error\n");
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = io.wake_fd;
+    epoll_ctl(io.epoll_fd, EPOLL_CTL_ADD, io.wake_fd, &ev);
+    curl_multi_setopt(io.multi, CURLMOPT_SOCKETFUNCTION, io_socket_cb);
+    curl_multi_setopt(io.multi, CURLMOPT_TIMERFUNCTION, io_timer_cb);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, io_thread, NULL) == 0)
+        io.result = SUCCESS;
+    else
+        printf("Asynchronous I/O thread creation error\n");
+    pthread_attr_destroy(&attr);
+}
+
+/**
+ * @brief transfer_init     prepares a download of a job branch
+ * @param job               pointer to a job
+ * @param i                 branch index
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+static int transfer_init(pcompare_job_t *job, const size_t i)
+{
+    transfer_t *t = &job->transfers[i];
+    char url[URL_LEN];
+
+    t->job = job;
+    if (branch_url(job->names[i], &job->options, url, sizeof(url)) != SUCCESS)
+    {
+        printf("Branch name \"%s\" is too long\n", job->names[i]);
+        return ERROR;
+    }
+    snprintf(t->tmp_name, sizeof(t->tmp_name), "%s.json.XXXXXX", job->names[i]);
+    int fd = mkstemp(t->tmp_name);
+    t->file = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+    if (!t->file)
+    {
+        printf("Could not open \"%s\"file to write\n", t->tmp_name);
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(t->tmp_name);
+        }
+        return ERROR;
+    }
+    t->curl = curl_easy_init();
+    if (!t->curl)
+    {
+        printf("Packet %s: CURL init error!\n", job->names[i]);
+        return ERROR;
+    }
+    curl_easy_setopt(t->curl, CURLOPT_URL, url);
+    curl_easy_setopt(t->curl, CURLOPT_ERRORBUFFER, t->error);
+    curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, transfer_write_cb);
+    curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, t);
+    curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t);
+    curl_easy_setopt(t->curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(t->curl, CURLOPT_FAILONERROR, 1L);
+    return SUCCESS;
+}
+
+/**
+ * @brief transfer_destroy  releases resources of a not started download
+ * @param t                 pointer to a transfer
+ */
+static void transfer_destroy(transfer_t *t)
+{
+    if (t->curl) curl_easy_cleanup(t->curl);
+    if (t->file)
+    {
+        fclose(t->file);
+        unlink(t->tmp_name);
+    }
+}
+
+pcompare_job_t *pcompare_start(const char *branch1, const char *branch2, const char *report_file,
+                               const pcompare_options_t *options)
+{
+    const char *branches[N_BRANCHES_TO_COMPARE_SUPPORTED] = {branch1, branch2};
+    size_t i;
+
+    if (!branch1 || !branch1[0] || !branch2 || !branch2[0])
+    {
+        printf("pcompare_start: branches names should be set!\n");
+        return NULL;
+    }
+    if (check_options(options) != SUCCESS)
+        return NULL;
+    pthread_once(&io.once, io_start);
+    if (io.result != SUCCESS)
+        return NULL;
+
+    pcompare_job_t *job = calloc(1, sizeof(pcompare_job_t));
+    if (!job)
+    {
+        printf("pcompare_start: memory allocation error\n");
+        return NULL;
+    }
+    job->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    job->state = PCOMPARE_JOB_LOADING;
+    job->refs = 2;
+    job->n_loading = N_BRANCHES_TO_COMPARE_SUPPORTED;
+    int res = (job->event_fd >= 0) ? SUCCESS : ERROR;
+    if (res == SUCCESS && report_file && !(job->report_file = strdup(report_file)))
+        res = ERROR;
+    if (options)
+    {
+        /* The job keeps its own copy of the options */
+        job->options = *options;
+        job->options.base_url = options->base_url ? strdup(options->base_url) : NULL;
+        job->options.cache_dir = options->cache_dir ? strdup(options->cache_dir) : NULL;
+        if ((options->base_url && !job->options.base_url) || (options->cache_dir && !job->options.cache_dir))
+            res = ERROR;
+    }
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED && res == SUCCESS; ++i)
+    {
+        job->names[i] = strdup(branches[i]);
+        res = job->names[i] ? transfer_init(job, i) : ERROR;
+    }
+    if (res != SUCCESS)
+    {
+        for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+            transfer_destroy(&job->transfers[i]);
+        job->refs = 1;
+        job_release(job);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&io.lock);
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+    {
+        job->transfers[i].next = io.pending;
+        io.pending = &job->transfers[i];
+    }
+    pthread_mutex_unlock(&io.lock);
+    signal_fd(io.wake_fd);
+    return job;
+}
+
+int pcompare_job_fd(const pcompare_job_t *job)
+{
+    return job ? job->event_fd : -1;
+}
+
+int pcompare_poll(pcompare_job_t *job, pcompare_progress_t *progress)
+{
+    uint64_t count;
+    if (!job)
+        return ERROR;
+    if (read(job->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        printf("eventfd read error: %s\n", strerror(errno));
+    const int state = __atomic_load_n(&job->state, __ATOMIC_ACQUIRE);
+    if (progress)
+    {
+        progress->state = state;
+        progress->loaded_bytes = __atomic_load_n(&job->loaded_bytes, __ATOMIC_RELAXED);
+        progress->total_bytes = __atomic_load_n(&job->total_bytes, __ATOMIC_RELAXED);
+    }
+    return state;
+}
+
+int pcompare_cancel(pcompare_job_t *job)
+{
+    if (!job)
+        return ERROR;
+    __atomic_store_n(&job->cancelled, 1, __ATOMIC_RELEASE);
+    signal_fd(io.wake_fd);
+    return SUCCESS;
+}
+
+const char *pcompare_job_report(const pcompare_job_t *job, size_t *size)
+{
+    if (!job || job->report_file || __atomic_load_n(&job->state, __ATOMIC_ACQUIRE) != PCOMPARE_JOB_DONE)
+        return NULL;
+    if (size)
+        *size = job->report_size;
+    return job->report;
+}
+
+void pcompare_job_free(pcompare_job_t *job)
+{
+    if (!job)
+        return;
+    pcompare_cancel(job);
+    job_release(job);
+}
@@ -0,0 +1,162 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Batch of comparisons sharing downloads and parsed branches:
+ * every distinct branch of the batch is downloaded and parsed once by a thread pool task,
+ * then all comparisons run concurrently on the shared branches.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "pcompare.h"
+#include "thread_pool.h"
+#include "compare.h"
+
+//distinct branch of a batch
+typedef struct
+{
+    const char          *pack_name;     //branch name
+    const pcompare_options_t *options;  //comparison options
+    pcompare_branch_t   *branch;        //shared parsed branch, NULL on error
+}batch_branch_t;
+
+//comparison of a batch with its branches
+typedef struct
+{
+    pcompare_batch_job_t    *job;                                       //comparison job
+    const batch_branch_t    *branches[N_BRANCHES_TO_COMPARE_SUPPORTED]; //branches of the job
+    const pcompare_options_t *options;                                  //comparison options
+}batch_compare_t;
+
+/**
+ * @brief branch_task   thread pool task, downloads a branch and acquires its shared parsed copy
+ * @param param         pointer to a batch_branch_t structure
+ */
+static void branch_task(void *param)
+{
+    batch_branch_t *batch_branch = (batch_branch_t *)param;
+    f_param_t fparam = { batch_branch->pack_name, -1, 0, NULL };
+
+    if (pcompare_load_files_from(&fparam, 1, batch_branch->options) != SUCCESS)
+    {
+        printf("Load of branch \"%s\" failed\n", batch_branch->pack_name);
+        return;
+    }
+    batch_branch->branch = pcompare_branch_acquire(batch_branch->pack_name);
+}
+
+/**
+ * @brief compare_task  thread pool task, compares branches of a job to its report file
+ * @param param         pointer to a batch_compare_t structure
+ */
+static void compare_task(void *param)
+{
+    batch_compare_t *compare = (batch_compare_t *)param;
+    pcompare_batch_job_t *job = compare->job;
+
+    if (!compare->branches[0]->branch || !compare->branches[1]->branch)
+        return;
+    FILE *out = fopen(job->out_file, "w");
+    if (!out)
+    {
+        printf("Could not open report file \"%s\": %s\n", job->out_file, strerror(errno));
+        return;
+    }
+    int res = pcompare_compare(compare->branches[0]->branch, compare->branches[1]->branch, out, compare->options);
+    if (fclose(out) != 0)
+        res = ERROR;
+    job->result = res;
+}
+
+/**
+ * @brief find_branch   finds a branch of a batch by name (batches are dozens of jobs, a linear search is enough)
+ * @param branches      array of the batch branches
+ * @param n_branches    number of the batch branches
+ * @param pack_name     branch name
+ * @return              pointer to the found branch, NULL if not found
+ */
+static batch_branch_t *find_branch(batch_branch_t *branches, const size_t n_branches, const char *pack_name)
+{
+    for (size_t i = 0; i < n_branches; ++i)
+    {
+        if (!strcmp(branches[i].pack_name, pack_name))
+            return &branches[i];
+    }
+    return NULL;
+}
+
+int pcompare_process_batch(pcompare_batch_job_t *jobs, const size_t n_jobs, const pcompare_options_t *options)
+{
+    size_t i, k, n_branches = 0;
+
+    if (!jobs || !n_jobs)
+    {
+        printf("pcompare_process_batch: invalid input parameter!\n");
+        return ERROR;
+    }
+    if (check_options(options) != SUCCESS)
+        return ERROR;
+    for (i = 0; i < n_jobs; ++i)
+    {
+        if (!jobs[i].branch1 || !jobs[i].branch2 || !jobs[i].out_file)
+        {
+            printf("pcompare_process_batch: invalid job %lu!\n", i + 1);
+            return ERROR;
+        }
+        jobs[i].result = ERROR;
+    }
+
+    batch_branch_t *branches = calloc(N_BRANCHES_TO_COMPARE_SUPPORTED * n_jobs, sizeof(batch_branch_t));
+    batch_compare_t *compares = calloc(n_jobs, sizeof(batch_compare_t));
+    if (!branches || !compares)
+    {
+        printf("pcompare_process_batch: memory allocation error\n");
+        free(branches);
+        free(compares);
+        return ERROR;
+    }
+
+    /* Distinct branches of all jobs */
+    for (i = 0; i < n_jobs; ++i)
+    {
+        const char *names[N_BRANCHES_TO_COMPARE_SUPPORTED] = { jobs[i].branch1, jobs[i].branch2 };
+        compares[i].job = &jobs[i];
+        compares[i].options = options;
+        for (k = 0; k < N_BRANCHES_TO_COMPARE_SUPPORTED; ++k)
+        {
+            batch_branch_t *branch = find_branch(branches, n_branches, names[k]);
+            if (!branch)
+            {
+                branch = &branches[n_branches++];
+                branch->pack_name = names[k];
+                branch->options = options;
+            }
+            compares[i].branches[k] = branch;
+        }
+    }
+    printf("Batch of %lu comparisons of %lu branches\n", n_jobs, n_branches);
+
+    /* Every branch is downloaded and parsed once, then all comparisons share the parsed branches */
+    tpool_group_t group;
+    tpool_group_init(&group);
+    for (i = 0; i < n_branches; ++i)
+        tpool_submit(&group, branch_task, &branches[i]);
+    tpool_group_wait(&group);
+
+    tpool_group_init(&group);
+    for (i = 0; i < n_jobs; ++i)
+        tpool_submit(&group, compare_task, &compares[i]);
+    tpool_group_wait(&group);
+
+    int res = SUCCESS;
+    for (i = 0; i < n_jobs; ++i)
+    {
+        if (jobs[i].result != SUCCESS)
+            res = ERROR;
+    }
+    for (i = 0; i < n_branches; ++i)
+        pcompare_branch_release(branches[i].branch);
+    free(branches);
+    free(compares);
+    return res;
+}
@@ -0,0 +1,227 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Merkle digest of a sorted branch table
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pcompare.h"
+#include "branch_digest.h"
+
+#define NAME_SEED       0x243f6a8885a308d3ULL
+#define NODE_SEED       0x13198a2e03707344ULL
+#define ROOT_SEED       0xa4093822299f31d0ULL
+
+/**
+ * @brief mix64     64-bit finalizer (bijective)
+ */
+static inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * @brief hash_bytes    hashes a string
+ * @param str           string
+ * @param len           string length
+ * @param seed          hash seed (a previous hash to chain strings)
+ * @return              64-bit hash
+ */
+static uint64_t hash_bytes(const char *str, size_t len, const uint64_t seed)
+{
+    uint64_t h = seed ^ (len * 0x9e3779b97f4a7c15ULL);
+    uint64_t v;
+    for (; len >= 8; len -= 8, str += 8)
+    {
+        memcpy(&v, str, 8);
+        h = mix64(h ^ v);
+    }
+    v = 0;
+    memcpy(&v, str, len);
+    return mix64(h ^ v ^ ((uint64_t)len << 59));
+}
+
+/**
+ * @brief name_hash     hashes a record name
+ */
+static inline uint64_t name_hash(const branch_table_t *table, const package_rec_t *rec)
+{
+    return hash_bytes(branch_table_str(table, rec->name), rec->name_len, NAME_SEED);
+}
+
+/**
+ * @brief record_hash   hashes a whole record
+ * @param table         pointer to a branch table
+ * @param rec           pointer to a record
+ * @param name_h        hash of the record name
+ * @return              64-bit hash
+ */
+static inline uint64_t record_hash(const branch_table_t *table, const package_rec_t *rec, const uint64_t name_h)
+{
+    const uint64_t h = hash_bytes(branch_table_str(table, rec->version), rec->version_len, name_h);
+    return hash_bytes(branch_table_str(table, rec->arch), rec->arch_len, h);
+}
+
+/**
+ * @brief ends_node     checks if a node of a level ends after a record
+ * @param name_h        hash of the record name
+ * @param level         node level
+ * @return              1 if the node ends
+ */
+static inline int ends_node(const uint64_t name_h, const size_t level)
+{
+    const uint64_t mask = (1ULL << (DIGEST_LEAF_BITS + level * DIGEST_FANOUT_BITS)) - 1;
+    return !(name_h & mask);
+}
+
+/**
+ * @brief build_leaves  builds the leaves level
+ * @param digest        pointer to a digest
+ * @param table         pointer to a sorted table
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int build_leaves(branch_digest_t *digest, const branch_table_t *table)
+{
+    /* Leaves are counted at first to allocate them at once */
+    uint64_t *name_hashes = malloc((table->n_records ? table->n_records : 1) * sizeof(uint64_t));
+    if (!name_hashes) return ERROR;
+    size_t n_leaves = 0;
+    for (size_t i = 0; i < table->n_records; ++i)
+    {
+        name_hashes[i] = name_hash(table, &table->records[i]);
+        n_leaves += ends_node(name_hashes[i], 0) || (i + 1 == table->n_records);
+    }
+    digest_node_t *leaves = malloc((n_leaves ? n_leaves : 1) * sizeof(digest_node_t));
+    if (!leaves)
+    {
+        free(name_hashes);
+        return ERROR;
+    }
+
+    size_t k = 0, start = 0;
+    uint64_t h = NODE_SEED;
+    for (size_t i = 0; i < table->n_records; ++i)
+    {
+        h = mix64(h ^ record_hash(table, &table->records[i], name_hashes[i]));
+        if (ends_node(name_hashes[i], 0) || (i + 1 == table->n_records))
+        {
+            leaves[k].start = (uint32_t)start;
+            leaves[k].count = (uint32_t)(i + 1 - start);
+            leaves[k].hash = mix64(h ^ leaves[k].count);
+            ++k;
+            start = i + 1;
+            h = NODE_SEED;
+        }
+    }
+    free(name_hashes);
+    digest->levels[0] = leaves;
+    digest->n_nodes[0] = n_leaves;
+    digest->n_levels = 1;
+    return SUCCESS;
+}
+
+/**
+ * @brief build_level   builds the next level over the current top level
+ * @param digest        pointer to a digest
+ * @param table         pointer to a sorted table
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int build_level(branch_digest_t *digest, const branch_table_t *table)
+{
+    const size_t level = digest->n_levels;
+    const digest_node_t *children = digest->levels[level - 1];
+    const size_t n_children = digest->n_nodes[level - 1];
+    digest_node_t *nodes = malloc(n_children * sizeof(digest_node_t));
+    if (!nodes) return ERROR;
+
+    size_t n = 0;
+    uint64_t h = NODE_SEED;
+    int empty = 1;
+    for (size_t c = 0; c < n_children; ++c)
+    {
+        if (empty)
+        {
+            nodes[n].start = children[c].start;
+            empty = 0;
+        }
+        h = mix64(h ^ children[c].hash);
+        const size_t last = children[c].start + children[c].count - 1;
+        if ((c + 1 == n_children) || ends_node(name_hash(table, &table->records[last]), level))
+        {
+            nodes[n].count = (uint32_t)(last + 1 - nodes[n].start);
+            nodes[n].hash = mix64(h ^ nodes[n].count);
+            ++n;
+            h = NODE_SEED;
+            empty = 1;
+        }
+    }
+    digest->levels[level] = nodes;
+    digest->n_nodes[level] = n;
+    digest->n_levels = level + 1;
+    return SUCCESS;
+}
+
+int branch_digest_build(branch_table_t *table)
+{
+    branch_digest_t *digest = calloc(1, sizeof(branch_digest_t));
+    if (!digest || build_leaves(digest, table) != SUCCESS)
+    {
+        printf("branch_digest_build: memory allocation error\n");
+        free(digest);
+        return ERROR;
+    }
+    while ((digest->n_levels < DIGEST_MAX_LEVELS) && (digest->n_nodes[digest->n_levels - 1] > 1))
+    {
+        if (build_level(digest, table) != SUCCESS)
+        {
+            printf("branch_digest_build: memory allocation error\n");
+            branch_digest_free(digest);
+            return ERROR;
+        }
+    }
+    const size_t top = digest->n_levels - 1;
+    uint64_t h = ROOT_SEED ^ table->n_records;
+    for (size_t k = 0; k < digest->n_nodes[top]; ++k)
+        h = mix64(h ^ digest->levels[top][k].hash);
+    digest->root = h;
+
+    branch_digest_free(table->digest);
+    table->digest = digest;
+    return SUCCESS;
+}
+
+void branch_digest_free(branch_digest_t *digest)
+{
+    if (!digest) return;
+    for (size_t l = 0; l < digest->n_levels; ++l)
+        free(digest->levels[l]);
+    free(digest);
+}
+
+size_t branch_digest_skip(const branch_digest_t *a, digest_cursor_t *ca, const size_t i,
+                          const branch_digest_t *b, digest_cursor_t *cb, const size_t j)
+{
+    size_t level = (a->n_levels < b->n_levels) ? a->n_levels : b->n_levels;
+
+    /* From the largest nodes down to leaves: the first identical pair starting here is skipped */
+    while (level--)
+    {
+        const digest_node_t *na = a->levels[level];
+        const digest_node_t *nb = b->levels[level];
+        size_t ka = ca->node[level], kb = cb->node[level];
+        while (ka < a->n_nodes[level] && na[ka].start < i) ++ka;
+        while (kb < b->n_nodes[level] && nb[kb].start < j) ++kb;
+        ca->node[level] = ka;
+        cb->node[level] = kb;
+        if (ka == a->n_nodes[level] || kb == b->n_nodes[level] || na[ka].start != i || nb[kb].start != j)
+            continue;
+        if (na[ka].count == nb[kb].count && na[ka].hash == nb[kb].hash)
+            return na[ka].count;
+    }
+    return 0;
+}
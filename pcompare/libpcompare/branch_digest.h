@@ -0,0 +1,97 @@
+#ifndef __BRANCH_DIGEST_H_
+#define __BRANCH_DIGEST_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Merkle digest of a sorted branch table.
+ * Records are grouped to leaves by the name hash: a leaf ends after a record which name hash
+ * has DIGEST_LEAF_BITS low zero bits, so the boundaries depend on the names only and identical
+ * ranges of two tables have identical leaves wherever they are. A node of level L ends after
+ * a record with DIGEST_LEAF_BITS + L * DIGEST_FANOUT_BITS low zero bits of the name hash.
+ * Every node keeps a hash of its records, the root hash covers the whole table.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "branch_table.h"
+
+#define DIGEST_LEAF_BITS        6       // 64 records per leaf on average
+#define DIGEST_FANOUT_BITS      4       // 16 children per node on average
+#define DIGEST_MAX_LEVELS       8
+
+//digest node: a range of records
+typedef struct
+{
+    uint32_t    start;      //first record
+    uint32_t    count;      //number of records
+    uint64_t    hash;       //hash of the records
+}digest_node_t;
+
+//digest of a table
+typedef struct branch_digest
+{
+    digest_node_t   *levels[DIGEST_MAX_LEVELS];     //nodes of every level, level 0 is leaves
+    size_t          n_nodes[DIGEST_MAX_LEVELS];     //number of nodes of every level
+    size_t          n_levels;                       //number of levels
+    uint64_t        root;                           //hash of the whole table
+}branch_digest_t;
+
+//position of a merge in a digest
+typedef struct
+{
+    size_t  node[DIGEST_MAX_LEVELS];                //first node of every level that starts not before the position
+}digest_cursor_t;
+
+/**
+ * @brief branch_digest_build   builds the digest of a sorted table and attaches it to the table
+ * @param table                 pointer to a sorted branch table
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+int branch_digest_build(branch_table_t *table);
+
+/**
+ * @brief branch_digest_free    releases a digest
+ * @param digest                pointer to a digest, may be NULL
+ */
+void branch_digest_free(branch_digest_t *digest);
+
+/**
+ * @brief branch_digest_equal   checks in O(1) if two tables with digests are identical
+ * @param a                     first table
+ * @param b                     second table
+ * @return                      1 if the tables are identical, 0 if they differ or have no digests
+ */
+static inline int branch_digest_equal(const branch_table_t *a, const branch_table_t *b)
+{
+    return a->digest && b->digest && a->n_records == b->n_records && a->digest->root == b->digest->root;
+}
+
+/**
+ * @brief branch_digest_next_leaf   returns the first leaf start not before a record
+ * @param digest                    pointer to a digest
+ * @param cursor                    merge cursor of the digest, moves forward only
+ * @param record                    record index
+ * @return                          leaf start, SIZE_MAX after the last leaf
+ */
+static inline size_t branch_digest_next_leaf(const branch_digest_t *digest, digest_cursor_t *cursor, const size_t record)
+{
+    const digest_node_t *leaves = digest->levels[0];
+    size_t k = cursor->node[0];
+    while (k < digest->n_nodes[0] && leaves[k].start < record) ++k;
+    cursor->node[0] = k;
+    return (k < digest->n_nodes[0]) ? leaves[k].start : SIZE_MAX;
+}
+
+/**
+ * @brief branch_digest_skip    finds the largest identical nodes starting at the merge positions of two tables
+ * @param a                     digest of the first table
+ * @param ca                    merge cursor of the first digest
+ * @param i                     merge position in the first table
+ * @param b                     digest of the second table
+ * @param cb                    merge cursor of the second digest
+ * @param j                     merge position in the second table
+ * @return                      number of identical records to skip in both tables, 0 if there are no identical nodes
+ */
+size_t branch_digest_skip(const branch_digest_t *a, digest_cursor_t *ca, const size_t i,
+                          const branch_digest_t *b, digest_cursor_t *cb, const size_t j);
+
+#endif //__BRANCH_DIGEST_H_
@@ -0,0 +1,80 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Point-query index over a sorted branch table
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pcompare.h"
+#include "branch_index.h"
+
+#define NODES_PREFETCH_DISTANCE     16      // 4 levels ahead: 16 descendants fit 4 cache lines of 4 nodes
+
+/**
+ * @brief fill_nodes    places sorted records to Eytzinger order by in-order traversal of the implicit tree
+ * @param index         pointer to a branch_index_t structure
+ * @param table         pointer to a sorted branch table
+ * @param record        index of the next sorted record
+ * @param k             current node
+ * @return              index of the next sorted record after the subtree
+ */
+static size_t fill_nodes(branch_index_t *index, const branch_table_t *table, size_t record, const size_t k)
+{
+    if (k > index->n_nodes) return record;
+    record = fill_nodes(index, table, record, 2 * k);
+    const package_rec_t *rec = &table->records[record];
+    index->nodes[k].prefix = rec->name_prefix;
+    index->nodes[k].record = (uint32_t)record;
+    index->nodes[k].pad = 0;
+    return fill_nodes(index, table, record + 1, 2 * k + 1);
+}
+
+int branch_index_build(branch_index_t *index, const branch_table_t *table)
+{
+    index->n_nodes = table->n_records;
+    index->nodes = aligned_alloc(64, ((index->n_nodes + 1) * sizeof(branch_index_node_t) + 63) & ~(size_t)63);
+    if (!index->nodes)
+    {
+        printf("branch_index_build: memory allocation error\n");
+        index->n_nodes = 0;
+        return ERROR;
+    }
+    memset(&index->nodes[0], 0, sizeof(branch_index_node_t));
+    fill_nodes(index, table, 0, 1);
+    return SUCCESS;
+}
+
+void branch_index_destroy(branch_index_t *index)
+{
+    free(index->nodes);
+    index->nodes = NULL;
+    index->n_nodes = 0;
+}
+
+size_t branch_index_lower_bound(const branch_index_t *index, const branch_table_t *table, const char *key,
+                                const size_t key_len)
+{
+    const uint64_t key_prefix = branch_name_prefix(key, key_len);
+    const size_t n = index->n_nodes;
+    size_t k = 1;
+
+    while (k <= n)
+    {
+        __builtin_prefetch(index->nodes + NODES_PREFETCH_DISTANCE * k);
+        const branch_index_node_t *node = &index->nodes[k];
+        int less;
+        if (node->prefix != key_prefix)
+            less = node->prefix < key_prefix;
+        else
+        {
+            const package_rec_t *rec = &table->records[node->record];
+            const int res = memcmp(branch_table_str(table, rec->name), key,
+                                   (rec->name_len < key_len) ? rec->name_len : key_len);
+            less = res ? (res < 0) : (rec->name_len < key_len);
+        }
+        k = 2 * k + less;
+    }
+    /* Go up while the path turns left: the last "right" turn parent is the lower bound */
+    k >>= __builtin_ffsll(~k);
+    return k ? index->nodes[k].record : n;
+}
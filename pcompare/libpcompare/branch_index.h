@@ -0,0 +1,55 @@
+#ifndef __BRANCH_INDEX_H_
+#define __BRANCH_INDEX_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Point-query index over a sorted branch table.
+ * Names are stored in Eytzinger (BFS) order of an implicit binary search tree,
+ * so the top levels of the search share a few cache lines and the next levels are prefetched.
+ * Every node keeps the record name prefix key (branch_name_prefix) to compare without touching the strings.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "branch_table.h"
+
+//index node
+typedef struct
+{
+    uint64_t    prefix;     //8 first name bytes, big-endian, zero padded
+    uint32_t    record;     //record index in the table
+    uint32_t    pad;
+}branch_index_node_t;
+
+//index of a table
+typedef struct
+{
+    branch_index_node_t *nodes;     //nodes in Eytzinger order, nodes[0] is unused
+    size_t              n_nodes;    //number of nodes (records in the table)
+}branch_index_t;
+
+/**
+ * @brief branch_index_build    builds the index of a sorted table
+ * @param index                 pointer to a branch_index_t structure
+ * @param table                 pointer to a sorted branch table
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+int branch_index_build(branch_index_t *index, const branch_table_t *table);
+
+/**
+ * @brief branch_index_destroy  releases index memory
+ * @param index                 pointer to a branch_index_t structure
+ */
+void branch_index_destroy(branch_index_t *index);
+
+/**
+ * @brief branch_index_lower_bound  finds the first record which name is not less than the key
+ * @param index                     pointer to a branch_index_t structure
+ * @param table                     pointer to the indexed table
+ * @param key                       key (not zero terminated)
+ * @param key_len                   key length
+ * @return                          record index, number of records if all names are less than the key
+ */
+size_t branch_index_lower_bound(const branch_index_t *index, const branch_table_t *table, const char *key,
+                                const size_t key_len);
+
+#endif //__BRANCH_INDEX_H_
@@ -0,0 +1,267 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Compact table of a branch packages
+ */
+#define _GNU_SOURCE     // qsort_r
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pcompare.h"
+#include "branch_table.h"
+#include "branch_digest.h"
+#include "thread_pool.h"
+
+#define JSON_BYTES_PER_RECORD       192     // estimation of a package size in the branch JSON file
+#define JSON_BYTES_PER_STRINGS      6       // estimation of the JSON file size to the package strings size ratio
+#define MIN_RECORDS_CAPACITY        1024
+#define MIN_STRINGS_CAPACITY        (64 * 1024)
+#define RADIX                       256
+#define RADIX_SORT_CUTOFF           64      // buckets smaller than this are sorted by comparison
+#define RADIX_PARALLEL_CUTOFF       16384   // buckets larger than this are sorted as separate tasks
+
+//radix sort task parameters
+typedef struct
+{
+    const branch_table_t    *table;     //sorted table
+    package_rec_t           *records;   //bucket records
+    package_rec_t           *tmp;       //temporary buffer of the bucket size
+    size_t                  n;          //number of records in the bucket
+    size_t                  depth;      //name byte to distribute by
+    tpool_group_t           *group;     //group of the sort tasks
+}radix_task_t;
+
+int branch_table_init(branch_table_t *table, const size_t size_hint)
+{
+    memset(table, 0, sizeof(*table));
+    table->records_capacity = size_hint / JSON_BYTES_PER_RECORD;
+    if (table->records_capacity < MIN_RECORDS_CAPACITY) table->records_capacity = MIN_RECORDS_CAPACITY;
+    table->strings_capacity = size_hint / JSON_BYTES_PER_STRINGS;
+    if (table->strings_capacity < MIN_STRINGS_CAPACITY) table->strings_capacity = MIN_STRINGS_CAPACITY;
+
+    table->records = malloc(table->records_capacity * sizeof(package_rec_t));
+    table->strings = malloc(table->strings_capacity);
+    if (!table->records || !table->strings)
+    {
+        printf("branch_table_init: memory allocation error\n");
+        branch_table_destroy(table);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+int branch_table_reserve(branch_table_t *table, const size_t n_records, const size_t strings_size)
+{
+    package_rec_t *records = realloc(table->records, (n_records ? n_records : 1) * sizeof(package_rec_t));
+    if (records)
+    {
+        table->records = records;
+        table->records_capacity = n_records ? n_records : 1;
+    }
+    char *strings = realloc(table->strings, strings_size ? strings_size : 1);
+    if (strings)
+    {
+        table->strings = strings;
+        table->strings_capacity = strings_size ? strings_size : 1;
+    }
+    if (!records || !strings)
+    {
+        printf("branch_table_reserve: memory allocation error\n");
+        return ERROR;
+    }
+    table->n_records = 0;
+    table->strings_size = 0;
+    return SUCCESS;
+}
+
+void branch_table_destroy(branch_table_t *table)
+{
+    branch_digest_free(table->digest);
+    free(table->records);
+    free(table->strings);
+    memset(table, 0, sizeof(*table));
+}
+
+/**
+ * @brief add_string    copies a string to the table arena
+ * @param table         pointer to a branch_table_t structure
+ * @param str           string (not zero terminated)
+ * @param len           string length
+ * @param offset        pointer to store the string offset
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int add_string(branch_table_t *table, const char *str, const size_t len, uint32_t *offset)
+{
+    if (table->strings_size + len + 1 > table->strings_capacity)
+    {
+        size_t capacity = table->strings_capacity * 2;
+        while (capacity < table->strings_size + len + 1) capacity *= 2;
+        if (capacity > UINT32_MAX) capacity = UINT32_MAX;
+        if (table->strings_size + len + 1 > capacity)
+        {
+            printf("branch_table_add: strings arena overflow\n");
+            return ERROR;
+        }
+        char *strings = realloc(table->strings, capacity);
+        if (!strings)
+        {
+            printf("branch_table_add: memory allocation error\n");
+            return ERROR;
+        }
+        table->strings = strings;
+        table->strings_capacity = capacity;
+    }
+    *offset = (uint32_t)table->strings_size;
+    memcpy(table->strings + table->strings_size, str, len);
+    table->strings[table->strings_size + len] = 0;
+    table->strings_size += len + 1;
+    return SUCCESS;
+}
+
+int branch_table_add(branch_table_t *table, const char *name, const size_t name_len,
+                     const char *version, const size_t version_len, const char *arch, const size_t arch_len)
+{
+    if (table->n_records == table->records_capacity)
+    {
+        size_t capacity = table->records_capacity * 2;
+        package_rec_t *records = realloc(table->records, capacity * sizeof(package_rec_t));
+        if (!records)
+        {
+            printf("branch_table_add: memory allocation error\n");
+            return ERROR;
+        }
+        table->records = records;
+        table->records_capacity = capacity;
+    }
+
+    package_rec_t *rec = &table->records[table->n_records];
+    if (add_string(table, name, name_len, &rec->name) != SUCCESS ||
+        add_string(table, version, version_len, &rec->version) != SUCCESS ||
+        add_string(table, arch, arch_len, &rec->arch) != SUCCESS)
+        return ERROR;
+    rec->name_prefix = branch_name_prefix(name, name_len);
+    rec->name_len = (uint32_t)name_len;
+    rec->version_len = (uint32_t)version_len;
+    rec->arch_len = (uint32_t)arch_len;
+    ++table->n_records;
+    return SUCCESS;
+}
+
+/**
+ * @brief compare_records   compares records by name and arch, qsort_r comparator
+ * @param a                 pointer to the first package_rec_t
+ * @param b                 pointer to the second package_rec_t
+ * @param ctx               pointer to a radix_task_t structure, names are equal up to its depth
+ * @return                  strcmp like result
+ */
+static int compare_records(const void *a, const void *b, void *ctx)
+{
+    const radix_task_t *task = ctx;
+    const package_rec_t *ra = a, *rb = b;
+    const size_t depth = task->depth;
+    int res = strcmp(branch_table_str(task->table, ra->name) + ((depth < ra->name_len) ? depth : ra->name_len),
+                     branch_table_str(task->table, rb->name) + ((depth < rb->name_len) ? depth : rb->name_len));
+    if (res) return res;
+    return strcmp(branch_table_str(task->table, ra->arch), branch_table_str(task->table, rb->arch));
+}
+
+int branch_table_is_sorted(const branch_table_t *table)
+{
+    for (size_t i = 1; i < table->n_records; ++i)
+    {
+        const package_rec_t *prev = &table->records[i - 1], *rec = &table->records[i];
+        int res = strcmp(branch_table_str(table, prev->name), branch_table_str(table, rec->name));
+        if (!res)
+            res = strcmp(branch_table_str(table, prev->arch), branch_table_str(table, rec->arch));
+        if (res > 0) return 0;
+    }
+    return 1;
+}
+
+static void radix_sort_task(void *param);
+
+/**
+ * @brief radix_sort    MSD radix sort of a bucket by name bytes starting from the task depth
+ * @param task          pointer to a radix_task_t structure
+ */
+static void radix_sort(radix_task_t *task)
+{
+    if (task->n < RADIX_SORT_CUTOFF)
+    {
+        qsort_r(task->records, task->n, sizeof(package_rec_t), compare_records, task);
+        return;
+    }
+
+    size_t counts[RADIX] = {0};
+    size_t starts[RADIX];
+    const size_t depth = task->depth;
+    size_t i;
+
+    for (i = 0; i < task->n; ++i)
+    {
+        const package_rec_t *rec = &task->records[i];
+        ++counts[(depth < rec->name_len) ? (unsigned char)task->table->strings[rec->name + depth] : 0];
+    }
+    starts[0] = 0;
+    for (i = 1; i < RADIX; ++i)
+        starts[i] = starts[i - 1] + counts[i - 1];
+    for (i = 0; i < task->n; ++i)
+    {
+        const package_rec_t *rec = &task->records[i];
+        const unsigned char c = (depth < rec->name_len) ? (unsigned char)task->table->strings[rec->name + depth] : 0;
+        task->tmp[starts[c]++] = *rec;
+    }
+    memcpy(task->records, task->tmp, task->n * sizeof(package_rec_t));
+
+    /* Bucket 0 holds names that end at this depth, they are equal and are ordered by arch */
+    size_t start = 0;
+    for (i = 0; i < RADIX; start += counts[i], ++i)
+    {
+        if (counts[i] < 2) continue;
+        radix_task_t sub = { task->table, task->records + start, task->tmp + start, counts[i], depth + 1, task->group };
+        if (i == 0)
+        {
+            qsort_r(sub.records, sub.n, sizeof(package_rec_t), compare_records, &sub);
+            continue;
+        }
+        if (sub.n >= RADIX_PARALLEL_CUTOFF && task->group)
+        {
+            radix_task_t *subtask = malloc(sizeof(radix_task_t));
+            if (subtask)
+            {
+                *subtask = sub;
+                tpool_submit(task->group, radix_sort_task, subtask);
+                continue;
+            }
+        }
+        radix_sort(&sub);
+    }
+}
+
+/**
+ * @brief radix_sort_task   thread pool task wrapper of radix_sort
+ * @param param             pointer to an allocated radix_task_t structure, freed by the task
+ */
+static void radix_sort_task(void *param)
+{
+    radix_sort((radix_task_t *)param);
+    free(param);
+}
+
+int branch_table_sort(branch_table_t *table)
+{
+    if (table->n_records < 2) return SUCCESS;
+
+    package_rec_t *tmp = malloc(table->n_records * sizeof(package_rec_t));
+    if (!tmp)
+    {
+        printf("branch_table_sort: memory allocation error\n");
+        return ERROR;
+    }
+    tpool_group_t group;
+    tpool_group_init(&group);
+    radix_task_t task = { table, table->records, tmp, table->n_records, 0, &group };
+    radix_sort(&task);
+    tpool_group_wait(&group);
+    free(tmp);
+    return SUCCESS;
+}
@@ -0,0 +1,125 @@
+#ifndef __BRANCH_TABLE_H_
+#define __BRANCH_TABLE_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Compact table of a branch packages: fixed-size records with offsets
+ * to zero terminated strings stored in one strings arena.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//package record, all strings are offsets in the table strings arena
+typedef struct
+{
+    uint64_t name_prefix;   //8 first name bytes, big-endian, zero padded (branch_name_prefix)
+    uint32_t name;          //package name offset
+    uint32_t name_len;      //package name length
+    uint32_t version;       //package version offset
+    uint32_t version_len;   //package version length
+    uint32_t arch;          //package architecture offset
+    uint32_t arch_len;      //package architecture length
+}package_rec_t;
+
+struct branch_digest;
+
+//table of packages
+typedef struct
+{
+    package_rec_t   *records;           //records array
+    size_t          n_records;          //number of records
+    size_t          records_capacity;   //allocated number of records
+    char            *strings;           //strings arena
+    size_t          strings_size;       //used arena size
+    size_t          strings_capacity;   //allocated arena size
+    struct branch_digest *digest;       //Merkle digest of the sorted table, NULL if not built
+}branch_table_t;
+
+/**
+ * @brief branch_table_init     initiates an empty table
+ * @param table                 pointer to a branch_table_t structure
+ * @param size_hint             expected size of the source JSON file, used to preallocate memory
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+int branch_table_init(branch_table_t *table, const size_t size_hint);
+
+/**
+ * @brief branch_table_reserve  sets capacities of an empty table
+ * @param table                 pointer to an initiated branch_table_t structure
+ * @param n_records             number of records
+ * @param strings_size          strings arena size
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+int branch_table_reserve(branch_table_t *table, const size_t n_records, const size_t strings_size);
+
+/**
+ * @brief branch_table_destroy  releases table memory (with the digest)
+ * @param table                 pointer to a branch_table_t structure
+ */
+void branch_table_destroy(branch_table_t *table);
+
+/**
+ * @brief branch_table_add  appends a package to the table
+ * @param table             pointer to a branch_table_t structure
+ * @param name              package name (not zero terminated)
+ * @param name_len          package name length
+ * @param version           package version (not zero terminated)
+ * @param version_len       package version length
+ * @param arch              package architecture (not zero terminated)
+ * @param arch_len          package architecture length
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+int branch_table_add(branch_table_t *table, const char *name, const size_t name_len,
+                     const char *version, const size_t version_len, const char *arch, const size_t arch_len);
+
+/**
+ * @brief branch_table_is_sorted    checks that packages are sorted by name (strcmp order) and by arch for equal names
+ * @param table                     pointer to a branch_table_t structure
+ * @return                          1 if the table is sorted, 0 otherwise
+ */
+int branch_table_is_sorted(const branch_table_t *table);
+
+/**
+ * @brief branch_table_sort     sorts packages by name and arch with parallel MSD radix sort
+ * @param table                 pointer to a branch_table_t structure
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+int branch_table_sort(branch_table_t *table);
+
+/**
+ * @brief branch_table_str  returns zero terminated string of the table
+ * @param table             pointer to a branch_table_t structure
+ * @param offset            string offset
+ * @return                  pointer to the string
+ */
+static inline const char *branch_table_str(const branch_table_t *table, const uint32_t offset)
+{
+    return table->strings + offset;
+}
+
+/**
+ * @brief branch_name_prefix    returns 8 first bytes of a name as a big-endian integer
+ * @param name                  name (not zero terminated)
+ * @param len                   name length
+ * @return                      name prefix key, comparing the keys gives the strcmp order of the prefixes
+ */
+static inline uint64_t branch_name_prefix(const char *name, const size_t len)
+{
+    uint64_t prefix = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (len >= 8)
+    {
+        memcpy(&prefix, name, 8);
+        return __builtin_bswap64(prefix);
+    }
+#endif
+    for (size_t i = 0; i < 8; ++i)
+    {
+        prefix <<= 8;
+        if (i < len) prefix |= (unsigned char)name[i];
+    }
+    return prefix;
+}
+
+#endif //__BRANCH_TABLE_H_
@@ -0,0 +1,68 @@
+#ifndef __COMPARE_H_
+#define __COMPARE_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Library internal interface of the branches comparison used by the asynchronous jobs and the history archive
+ */
+
+#include <stdio.h>
+#include "pcompare.h"
+#include "branch_table.h"
+
+/**
+ * @brief check_options     validates comparison options and creates the reports cache directory
+ * @param options           pointer to comparison options, NULL for the defaults
+ * @return                  SUCCESS on valid options, ERROR otherwise
+ */
+int check_options(const pcompare_options_t *options);
+
+/**
+ * @brief compare_branches  compares two opened branches and outputs the report
+ *                          (within the memory budget of the options)
+ * @param out               output stream
+ * @param fparam            pointer to an array of 2 opened f_param_t structures
+ * @param options           pointer to comparison options, NULL for the defaults
+ * @return                  SUCCESS code on success, ERROR code otherwise
+ */
+int compare_branches(FILE *out, const f_param_t *fparam, const pcompare_options_t *options);
+
+/**
+ * @brief compare_branches_by_name  compares two downloaded branches sharing their parsed data
+ *                                  with other comparisons through the branches registry.
+ *                                  With the reports cache of the options the report is taken from the cache
+ *                                  or is cached
+ * @param out                       output stream
+ * @param pack_name1                first branch name
+ * @param pack_name2                second branch name
+ * @param options                   pointer to comparison options, NULL for the defaults
+ * @return                          SUCCESS code on success, ERROR code otherwise
+ */
+int compare_branches_by_name(FILE *out, const char *pack_name1, const char *pack_name2,
+                             const pcompare_options_t *options);
+
+/**
+ * @brief branch_url    builds the download URL of a branch
+ * @param pack_name     branch name
+ * @param options       pointer to comparison options with the export URL, NULL for the defaults
+ * @param url           buffer for the URL
+ * @param size          buffer size
+ * @return              SUCCESS on success, ERROR if the buffer is too small
+ */
+int branch_url(const char *pack_name, const pcompare_options_t *options, char *url, const size_t size);
+
+/**
+ * @brief branch_from_table creates a branch of a sorted table and builds its digest and point-query index
+ * @param pack_name         branch name
+ * @param table             pointer to a sorted table, the branch owns it (it is destroyed on error)
+ * @return                  branch handle with one reference on success, NULL otherwise
+ */
+pcompare_branch_t *branch_from_table(const char *pack_name, branch_table_t *table);
+
+/**
+ * @brief branch_get_table  returns the packages table of a branch
+ * @param branch            branch handle
+ * @return                  pointer to the sorted table owned by the branch
+ */
+const branch_table_t *branch_get_table(const pcompare_branch_t *branch);
+
+#endif //__COMPARE_H_
@@ -0,0 +1,622 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Download of a branch export to a file
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <errno.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include "pcompare.h"
+#include "download.h"
+
+#define RANGES_MAGIC            0x7365676e61524350ULL   // "PCRanges"
+#define VALIDATOR_LEN           128
+#define RANGE_PENDING           0
+#define RANGE_ACTIVE            1
+#define RANGE_DONE              2
+#define HTTP_OK                 200
+#define HTTP_PARTIAL_CONTENT    206
+
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+
+//remote file properties
+typedef struct
+{
+    curl_off_t  size;                       //body size, -1 if unknown
+    int         accept_ranges;              //1 if the server accepts byte ranges
+    char        validator[VALIDATOR_LEN];   //ETag or Last-Modified, empty if unknown
+    char        *url;                       //effective URL after redirects
+}remote_info_t;
+
+//header of the ranges state file, followed by a state byte per range
+typedef struct
+{
+    uint64_t    magic;
+    uint64_t    size;                       //body size
+    uint64_t    range_size;                 //range size
+    char        validator[VALIDATOR_LEN];   //server validator of the body
+}ranges_header_t;
+
+//ranged download
+typedef struct
+{
+    int         fd;                         //output file
+    int         state_fd;                   //ranges state file
+    uint64_t    size;                       //body size
+    uint64_t    range_size;                 //range size
+    size_t      n_ranges;                   //number of ranges
+    uint8_t     *state;                     //state of every range
+    uint8_t     *attempts;                  //fetch attempts of every range
+    size_t      next;                       //the first range that can be pending
+    size_t      n_done;                     //number of completed ranges
+    int         whole_body;                 //1 if the server answered a range request with the whole body
+}ranged_download_t;
+
+//connection of a ranged download
+typedef struct
+{
+    CURL        *curl;                      //easy handle
+    ranged_download_t *download;            //download
+    size_t      range;                      //fetched range
+    uint64_t    offset;                     //range offset
+    uint64_t    length;                     //range length
+    uint64_t    received;                   //received bytes of the range
+    int         busy;                       //1 if a range is fetched
+    char        range_str[64];              //"first-last" range string
+    char        error[CURL_ERROR_SIZE];     //curl error message
+}connection_t;
+
+/**
+ * @brief header_value  returns a value of a header line if the line is the header
+ * @param line          header line
+ * @param len           line length
+ * @param header        header name with the colon
+ * @param value_len     pointer to the value length
+ * @return              pointer to the value, NULL if the line is other header
+ */
+static const char *header_value(const char *line, size_t len, const char *header, size_t *value_len)
+{
+    const size_t hlen = strlen(header);
+    if (len < hlen || strncasecmp(line, header, hlen)) return NULL;
+    line += hlen;
+    len -= hlen;
+    while (len && (*line == ' ' || *line == '\t')) { ++line; --len; }
+    while (len && (line[len - 1] == '\r' || line[len - 1] == '\n' || line[len - 1] == ' ')) --len;
+    *value_len = len;
+    return line;
+}
+
+/**
+ * @brief info_header_cb    curl header callback, collects remote file properties
+ * @return                  number of processed bytes
+ */
+static size_t info_header_cb(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    remote_info_t *info = (remote_info_t *)userdata;
+    const size_t len = size * nitems;
+    const char *value;
+    size_t value_len;
+
+    if (len >= 5 && !strncmp(buffer, "HTTP/", 5))
+    {
+        /* A new response (e.g. after a redirect) */
+        info->accept_ranges = 0;
+        info->validator[0] = 0;
+    }
+    else if ((value = header_value(buffer, len, "Accept-Ranges:", &value_len)))
+    {
+        info->accept_ranges = (value_len == 5 && !strncasecmp(value, "bytes", 5));
+    }
+    else if ((value = header_value(buffer, len, "ETag:", &value_len)) ||
+             (!info->validator[0] && (value = header_value(buffer, len, "Last-Modified:", &value_len))))
+    {
+        if (value_len < VALIDATOR_LEN)
+        {
+            memcpy(info->validator, value, value_len);
+            info->validator[value_len] = 0;
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief get_remote_info   requests headers of a URL
+ * @param url               URL
+ * @param info              pointer to a remote_info_t structure to fill
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+static int get_remote_info(const char *url, remote_info_t *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->size = -1;
+    CURL *curl = curl_easy_init();
+    if (!curl) return ERROR;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, info_header_cb);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, info);
+
+    long code = 0;
+    char *effective_url = NULL;
+    int res = ERROR;
+    if (curl_easy_perform(curl) == CURLE_OK &&
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code) == CURLE_OK && code / 100 == 2 &&
+        curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &info->size) == CURLE_OK &&
+        curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective_url) == CURLE_OK && effective_url)
+    {
+        info->url = strdup(effective_url);
+        res = info->url ? SUCCESS : ERROR;
+    }
+    curl_easy_cleanup(curl);
+    return res;
+}
+
+/**
+ * @brief download_single   downloads a URL to a file over a single connection.
+ *                          The body is written to a temporary file renamed to the file at the end,
+ *                          so the file which may be mapped by a reader is never rewritten in place
+ * @param url               URL to download
+ * @param fname             output file name
+ * @param name              name of the download for messages
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+static int download_single(const char *url, const char *fname, const char *name)
+{
+    char tmp_name[PATH_MAX];
+    if (snprintf(tmp_name, sizeof(tmp_name), "%s.XXXXXX", fname) >= (int)sizeof(tmp_name))
+    {
+        printf("File name \"%s\" is too long\n", fname);
+        return ERROR;
+    }
+    int fd = mkstemp(tmp_name);
+    FILE *f = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+    if (!f)
+    {
+        printf("Could not open \"%s\"file to write\n", tmp_name);
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(tmp_name);
+        }
+        return ERROR;
+    }
+    fchmod(fd, 0644);
+
+    char curlErrorBuffer[CURL_ERROR_SIZE];
+    CURL *curl = curl_easy_init();
+    if (!curl)
+    {
+        printf("Packet %s: CURL init error!\n", name);
+        fclose(f);
+        unlink(tmp_name);
+        return ERROR;
+    }
+    /* Error buffer definition */
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curlErrorBuffer);
+
+    /* URL download definition */
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+
+    /* Switch HTML header off */
+    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
+
+    /* Set file descriptor as a buffer to write */
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, f);
+
+    /* Switch show progress statistic on */
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+
+    /* Auto redirecting enable */
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+
+    printf("\nLoading packet \"%s\"...\n", name);
+    CURLcode curlResult = curl_easy_perform(curl);
+
+    const int closed = (fclose(f) == 0);
+    curl_easy_cleanup(curl);
+
+    if (curlResult != CURLE_OK)
+    {
+        printf("Package \"%s\"Curl perfom error = %d. Error message:\"%s\"\n", name, curlResult, curlErrorBuffer);
+        unlink(tmp_name);
+        return ERROR;
+    }
+    if (!closed || rename(tmp_name, fname) != 0)
+    {
+        printf("Could not write \"%s\": %s\n", fname, strerror(errno));
+        unlink(tmp_name);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief lock_ranges_state     opens the ranges state file and locks it for the download.
+ *                              A concurrent download of the same file waits for the lock; the state file
+ *                              removed by a finished download is opened anew
+ * @param state_name            state file name
+ * @return                      descriptor of the locked state file, -1 on error
+ */
+static int lock_ranges_state(const char *state_name)
+{
+    while (1)
+    {
+        struct stat fst, st;
+        int fd = open(state_name, O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            printf("Could not open \"%s\" file: %s\n", state_name, strerror(errno));
+            return -1;
+        }
+        if (flock(fd, LOCK_EX) != 0 || fstat(fd, &fst) != 0)
+        {
+            printf("Could not lock \"%s\" file: %s\n", state_name, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        if (stat(state_name, &st) == 0 && st.st_dev == fst.st_dev && st.st_ino == fst.st_ino)
+            return fd;
+        close(fd);
+    }
+}
+
+/**
+ * @brief open_ranges_state     opens and locks the ranges state file, resumes a download with the same size
+ *                              and validator if the partial file of this size exists. A download without validator
+ *                              is never resumed
+ * @param d                     pointer to a ranged_download_t structure with the size set
+ * @param state_name            state file name
+ * @param part_name             partial file name
+ * @param validator             server validator of the body
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+static int open_ranges_state(ranged_download_t *d, const char *state_name, const char *part_name,
+                             const char *validator)
+{
+    ranges_header_t header;
+    struct stat st;
+
+    d->state_fd = lock_ranges_state(state_name);
+    if (d->state_fd < 0)
+        return ERROR;
+    if (validator[0] && pread(d->state_fd, &header, sizeof(header), 0) == sizeof(header) &&
+        header.magic == RANGES_MAGIC && header.size == d->size && header.range_size &&
+        !strncmp(header.validator, validator, VALIDATOR_LEN) &&
+        stat(part_name, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size == d->size)
+    {
+        d->range_size = header.range_size;
+    }
+    else
+    {
+        /* A new download: at least one range per connection, but not too small ranges */
+        d->range_size = (d->size + DOWNLOAD_CONNECTIONS - 1) / DOWNLOAD_CONNECTIONS;
+        if (d->range_size > DOWNLOAD_RANGE_SIZE) d->range_size = DOWNLOAD_RANGE_SIZE;
+        if (d->range_size < DOWNLOAD_MIN_RANGE_SIZE) d->range_size = DOWNLOAD_MIN_RANGE_SIZE;
+        memset(&header, 0, sizeof(header));
+        header.magic = RANGES_MAGIC;
+        header.size = d->size;
+        header.range_size = d->range_size;
+        memcpy(header.validator, validator, strlen(validator) + 1);
+        if (ftruncate(d->state_fd, 0) != 0 ||
+            pwrite(d->state_fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            printf("Could not write \"%s\" file: %s\n", state_name, strerror(errno));
+            return ERROR;
+        }
+    }
+
+    d->n_ranges = (d->size + d->range_size - 1) / d->range_size;
+    d->state = calloc(d->n_ranges, 1);
+    d->attempts = calloc(d->n_ranges, 1);
+    if (!d->state || !d->attempts)
+    {
+        printf("download_file: memory allocation error\n");
+        return ERROR;
+    }
+    if (pread(d->state_fd, d->state, d->n_ranges, sizeof(header)) < 0)
+        memset(d->state, RANGE_PENDING, d->n_ranges);
+    for (size_t i = 0; i < d->n_ranges; ++i)
+    {
+        if (d->state[i] == RANGE_DONE) ++d->n_done;
+        else d->state[i] = RANGE_PENDING;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief range_write_cb    curl write callback, writes received data to the range place of the file
+ * @return                  number of written bytes, 0 on error
+ */
+static size_t range_write_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    connection_t *c = (connection_t *)userdata;
+    const size_t len = size * nmemb;
+    long code = 0;
+    if (!c->received && curl_easy_getinfo(c->curl, CURLINFO_RESPONSE_CODE, &code) == CURLE_OK &&
+        code != HTTP_PARTIAL_CONTENT)
+        return 0;   //not a range: do not fetch the whole body
+    if (c->received + len > c->length)
+        return 0;
+    for (size_t written = 0; written < len;)
+    {
+        ssize_t n = pwrite(c->download->fd, ptr + written, len - written, c->offset + c->received + written);
+        if (n <= 0) return 0;
+        written += n;
+    }
+    c->received += len;
+    return len;
+}
+
+/**
+ * @brief start_range   starts fetching of the next pending range on a connection
+ * @param c             pointer to an idle connection
+ * @param multi         multi handle
+ * @return              1 if a range is started, 0 if there is no pending range
+ */
+static int start_range(connection_t *c, CURLM *multi)
+{
+    ranged_download_t *d = c->download;
+    while (d->next < d->n_ranges && d->state[d->next] != RANGE_PENDING)
+        ++d->next;
+    if (d->next == d->n_ranges) return 0;
+
+    c->range = d->next++;
+    c->offset = c->range * d->range_size;
+    c->length = (c->offset + d->range_size <= d->size) ? d->range_size : d->size - c->offset;
+    c->received = 0;
+    c->busy = 1;
+    c->error[0] = 0;
+    d->state[c->range] = RANGE_ACTIVE;
+    ++d->attempts[c->range];
+    snprintf(c->range_str, sizeof(c->range_str), "%llu-%llu",
+             (unsigned long long)c->offset, (unsigned long long)(c->offset + c->length - 1));
+    curl_easy_setopt(c->curl, CURLOPT_RANGE, c->range_str);
+    curl_multi_add_handle(multi, c->curl);
+    return 1;
+}
+
+/**
+ * @brief finish_range  checks a fetched range and records it as completed or pending again
+ * @param c             pointer to a connection
+ * @param multi         multi handle
+ * @param result        transfer result
+ * @return              SUCCESS on success or when the range may be retried, ERROR otherwise
+ */
+static int finish_range(connection_t *c, CURLM *multi, CURLcode result)
+{
+    ranged_download_t *d = c->download;
+    long code = 0;
+
+    curl_easy_getinfo(c->curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_multi_remove_handle(multi, c->curl);
+    c->busy = 0;
+
+    if (result == CURLE_OK && code == HTTP_PARTIAL_CONTENT && c->received == c->length)
+    {
+        /* Data must reach the file before the range is recorded as completed */
+        const uint8_t done = RANGE_DONE;
+        if (fdatasync(d->fd) != 0 ||
+            pwrite(d->state_fd, &done, 1, sizeof(ranges_header_t) + c->range) != 1)
+        {
+            printf("Could not record completed range: %s\n", strerror(errno));
+            return ERROR;
+        }
+        d->state[c->range] = RANGE_DONE;
+        ++d->n_done;
+        return SUCCESS;
+    }
+
+    if (code == HTTP_OK)
+    {
+        /* The server ignores ranges, or the body is changed since its validator was taken */
+        d->whole_body = 1;
+        return ERROR;
+    }
+    printf("Range %s: %s\n", c->range_str,
+           (result != CURLE_OK) ? (c->error[0] ? c->error : curl_easy_strerror(result)) :
+           (code != HTTP_PARTIAL_CONTENT) ? "the server did not return partial content" : "the range is truncated");
+    if (code != HTTP_PARTIAL_CONTENT && result == CURLE_OK)
+        return ERROR;
+    if (d->attempts[c->range] >= DOWNLOAD_RETRIES)
+        return ERROR;
+    d->state[c->range] = RANGE_PENDING;
+    if (c->range < d->next) d->next = c->range;
+    return SUCCESS;
+}
+
+/**
+ * @brief fetch_ranges  fetches all pending ranges over parallel connections.
+ *                      Ranges are requested with "If-Range: <validator>", so the server answers with
+ *                      the whole body instead of a range of a changed body
+ * @param d             pointer to a ranged_download_t structure
+ * @param url           URL to download
+ * @param validator     server validator of the body, empty if unknown
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int fetch_ranges(ranged_download_t *d, const char *url, const char *validator)
+{
+    connection_t connections[DOWNLOAD_CONNECTIONS];
+    char if_range[VALIDATOR_LEN + 16];
+    struct curl_slist *headers = NULL;
+    size_t n_connections = d->n_ranges - d->n_done;
+    if (n_connections > DOWNLOAD_CONNECTIONS) n_connections = DOWNLOAD_CONNECTIONS;
+    size_t i;
+    int res = SUCCESS;
+
+    if (validator[0])
+    {
+        snprintf(if_range, sizeof(if_range), "If-Range: %s", validator);
+        headers = curl_slist_append(NULL, if_range);
+        if (!headers) return ERROR;
+    }
+    CURLM *multi = curl_multi_init();
+    if (!multi)
+    {
+        curl_slist_free_all(headers);
+        return ERROR;
+    }
+    memset(connections, 0, sizeof(connections));
+    for (i = 0; i < n_connections; ++i)
+    {
+        connection_t *c = &connections[i];
+        c->download = d;
+        c->curl = curl_easy_init();
+        if (!c->curl)
+        {
+            res = ERROR;
+            break;
+        }
+        curl_easy_setopt(c->curl, CURLOPT_URL, url);
+        curl_easy_setopt(c->curl, CURLOPT_ERRORBUFFER, c->error);
+        curl_easy_setopt(c->curl, CURLOPT_WRITEFUNCTION, range_write_cb);
+        curl_easy_setopt(c->curl, CURLOPT_WRITEDATA, c);
+        curl_easy_setopt(c->curl, CURLOPT_PRIVATE, c);
+        curl_easy_setopt(c->curl, CURLOPT_FOLLOWLOCATION, 1L);
+        if (headers)
+            curl_easy_setopt(c->curl, CURLOPT_HTTPHEADER, headers);
+    }
+
+    int running = 0;
+    while (res == SUCCESS && d->n_done < d->n_ranges)
+    {
+        for (i = 0; i < n_connections; ++i)
+        {
+            if (!connections[i].busy)
+                start_range(&connections[i], multi);
+        }
+        if (curl_multi_perform(multi, &running) != CURLM_OK ||
+            curl_multi_poll(multi, NULL, 0, 1000, NULL) != CURLM_OK)
+        {
+            res = ERROR;
+            break;
+        }
+        CURLMsg *msg;
+        int n_msgs;
+        while (res == SUCCESS && (msg = curl_multi_info_read(multi, &n_msgs)))
+        {
+            if (msg->msg != CURLMSG_DONE) continue;
+            connection_t *c;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&c);
+            res = finish_range(c, multi, msg->data.result);
+        }
+    }
+
+    for (i = 0; i < n_connections; ++i)
+    {
+        if (!connections[i].curl) continue;
+        if (connections[i].busy) curl_multi_remove_handle(multi, connections[i].curl);
+        curl_easy_cleanup(connections[i].curl);
+    }
+    curl_multi_cleanup(multi);
+    curl_slist_free_all(headers);
+    return res;
+}
+
+/**
+ * @brief download_ranged   downloads a URL to a file by ranges over parallel connections
+ * @param info              remote file properties
+ * @param fname             output file name
+ * @param name              name of the download for messages
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+static int download_ranged(const remote_info_t *info, const char *fname, const char *name)
+{
+    char part_name[PATH_MAX];
+    char state_name[PATH_MAX];
+    ranged_download_t d;
+    int res = ERROR;
+
+    snprintf(part_name, sizeof(part_name), "%s.part", fname);
+    snprintf(state_name, sizeof(state_name), "%s.ranges", fname);
+    memset(&d, 0, sizeof(d));
+    d.size = info->size;
+    d.fd = -1;
+    d.state_fd = -1;
+
+    if (open_ranges_state(&d, state_name, part_name, info->validator) != SUCCESS)
+        goto out;
+    d.fd = open(part_name, O_WRONLY | O_CREAT | (d.n_done ? 0 : O_TRUNC), 0644);
+    if (d.fd < 0)
+    {
+        printf("Could not open \"%s\"file to write\n", part_name);
+        goto out;
+    }
+    if (ftruncate(d.fd, d.size) != 0)
+    {
+        printf("Could not allocate \"%s\" file: %s\n", part_name, strerror(errno));
+        goto out;
+    }
+    posix_fallocate(d.fd, 0, d.size);
+
+    if (d.n_done)
+        printf("\nResuming packet \"%s\" loading: %lu of %lu ranges are loaded...\n", name, d.n_done, d.n_ranges);
+    else
+        printf("\nLoading packet \"%s\" (%llu bytes) by %lu ranges...\n", name, (unsigned long long)d.size, d.n_ranges);
+
+    res = fetch_ranges(&d, info->url, info->validator);
+    if (d.whole_body)
+    {
+        printf("The server ignores ranges of packet \"%s\" or the packet is changed, loading over a single connection...\n", name);
+        close(d.fd);
+        d.fd = -1;
+        unlink(part_name);
+        unlink(state_name);
+        res = download_single(info->url, fname, name);
+        goto out;
+    }
+    if (res == SUCCESS && rename(part_name, fname) != 0)
+    {
+        printf("Could not rename \"%s\" to \"%s\": %s\n", part_name, fname, strerror(errno));
+        res = ERROR;
+    }
+    if (res == SUCCESS)
+        unlink(state_name);
+    else
+        printf("Packet \"%s\": %lu of %lu ranges are loaded, the loading can be resumed\n", name, d.n_done, d.n_ranges);
+out:
+    if (d.fd >= 0) close(d.fd);
+    if (d.state_fd >= 0) close(d.state_fd);
+    free(d.state);
+    free(d.attempts);
+    return res;
+}
+
+/**
+ * @brief curl_init     initiates libcurl
+ */
+static void curl_init(void)
+{
+    curl_global_init(CURL_GLOBAL_ALL);
+}
+
+void download_global_init(void)
+{
+    pthread_once(&curl_once, curl_init);
+}
+
+int download_file(const char *url, const char *fname, const char *name)
+{
+    remote_info_t info;
+
+    download_global_init();
+    int res;
+    if (get_remote_info(url, &info) == SUCCESS && info.accept_ranges &&
+        info.size >= 2 * DOWNLOAD_MIN_RANGE_SIZE)
+        res = download_ranged(&info, fname, name);
+    else
+        res = download_single(url, fname, name);
+    free(info.url);
+    return res;
+}
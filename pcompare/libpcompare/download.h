@@ -0,0 +1,37 @@
+#ifndef __DOWNLOAD_H_
+#define __DOWNLOAD_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Download of a branch export to a file.
+ * When the server accepts byte ranges, the body is split into ranges which are fetched
+ * over several parallel connections straight into a preallocated "<file>.part" file.
+ * Completed ranges are recorded in "<file>.ranges", so an interrupted download resumes
+ * from the completed ranges if the server validator (ETag or Last-Modified) is not changed
+ * and "<file>.part" still has the body size, otherwise it starts anew. Ranges are requested
+ * with "If-Range: <validator>", so a body changed during the download comes whole.
+ * Concurrent ranged downloads of the same file are serialized by a lock of "<file>.ranges".
+ * Otherwise, or when the server answers a range request with the whole body,
+ * the body is fetched over a single connection to a temporary file.
+ * Either way the file is replaced by a rename, it is never rewritten in place.
+ */
+
+#define DOWNLOAD_CONNECTIONS    4                   // parallel connections of a ranged download
+#define DOWNLOAD_RANGE_SIZE     (4 * 1024 * 1024)   // maximal range size
+#define DOWNLOAD_MIN_RANGE_SIZE (256 * 1024)        // minimal range size
+#define DOWNLOAD_RETRIES        3                   // attempts to fetch a range
+
+/**
+ * @brief download_global_init  initiates libcurl once per process
+ */
+void download_global_init(void);
+
+/**
+ * @brief download_file     downloads a URL to a file
+ * @param url               URL to download
+ * @param fname             output file name
+ * @param name              name of the download for messages
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+int download_file(const char *url, const char *fname, const char *name);
+
+#endif //__DOWNLOAD_H_
@@ -0,0 +1,672 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * External-memory comparison of two branches
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "rpmvercmp.h"
+#include "pcompare.h"
+#include "json_scan.h"
+#include "branch_table.h"
+#include "report.h"
+#include "ext_compare.h"
+
+#define EQUAL                       0
+#define N_SPILLS                    3                   // absent in first, absent in second, newer in first
+#define SPILL_NEWER                 2
+#define SPILL_BUFFER_SIZE           (64 * 1024)
+#define COPY_BUFFER_SIZE            (64 * 1024)
+#define MIN_RUN_BUFFER_SIZE         (4 * 1024)
+#define MAX_RUN_BUFFER_SIZE         (1024 * 1024)
+#define SCANNED_PAGES_MARGIN        (1024 * 1024)       // mapped input kept behind the scanning position
+#define RUN_STRINGS                 3                   // name, version and arch
+
+//sorted run reader
+typedef struct
+{
+    FILE        *file;                  //run file
+    char        *vbuf;                  //run file stdio buffer
+    char        *strings;               //current record strings
+    size_t      strings_size;           //allocated size of the strings buffer
+    const char  *str[RUN_STRINGS];      //current record name, version and arch
+    int         valid;                  //1 if the current record is valid
+}run_reader_t;
+
+//sorted stream of a branch packages merged from the runs
+typedef struct
+{
+    run_reader_t    *runs;              //runs readers
+    size_t          n_runs;             //number of runs
+    run_reader_t    *current;           //reader with the least record, NULL at the end of the stream
+}branch_stream_t;
+
+//builder of sorted runs
+typedef struct
+{
+    branch_table_t  table;              //records of the current run
+    size_t          max_records;        //records limit of a run
+    size_t          max_strings;        //strings limit of a run
+    int             *runs;              //runs files descriptors
+    size_t          n_runs;             //number of runs
+    size_t          runs_capacity;      //allocated size of the runs array
+    char            *data;              //mapped input
+    size_t          size;               //input size
+    size_t          released;           //size of the input prefix released from memory
+    size_t          release_step;       //input size to release at once
+}run_builder_t;
+
+//spilled report array
+typedef struct
+{
+    FILE    *file;                      //temporary file, NULL in summary mode
+    size_t  count;                      //number of packages
+}spill_t;
+
+//counters of the report arrays packages of one architecture
+typedef struct
+{
+    char    *arch;                      //architecture
+    size_t  counts[N_SPILLS];           //packages of every report array
+}arch_count_t;
+
+//summary of the merge: per-architecture counters instead of the spilled arrays
+typedef struct
+{
+    arch_count_t    *archs;             //per-architecture counters
+    size_t          n_archs;            //number of architectures
+    size_t          archs_capacity;     //allocated number of architectures
+}ext_summary_t;
+
+/**
+ * @brief ext_tmpfd     creates an anonymous temporary file
+ * @return              file descriptor, -1 on error
+ */
+static int ext_tmpfd(void)
+{
+    const char *dir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/pcompare-XXXXXX", (dir && dir[0]) ? dir : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        printf("Could not create temporary file \"%s\": %s\n", path, strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    return fd;
+}
+
+/**
+ * @brief flush_run     sorts records collected by the builder and writes them as a new run
+ * @param b             pointer to a run_builder_t structure
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int flush_run(run_builder_t *b)
+{
+    branch_table_t *table = &b->table;
+    if (!table->n_records) return SUCCESS;
+    if (!branch_table_is_sorted(table) && branch_table_sort(table) != SUCCESS)
+        return ERROR;
+
+    if (b->n_runs == b->runs_capacity)
+    {
+        size_t capacity = b->runs_capacity ? b->runs_capacity * 2 : 16;
+        int *runs = realloc(b->runs, capacity * sizeof(int));
+        if (!runs)
+        {
+            printf("External comparison: memory allocation error\n");
+            return ERROR;
+        }
+        b->runs = runs;
+        b->runs_capacity = capacity;
+    }
+    int fd = ext_tmpfd();
+    if (fd < 0) return ERROR;
+    int wfd = dup(fd);
+    FILE *f = (wfd >= 0) ? fdopen(wfd, "w") : NULL;
+    if (!f)
+    {
+        printf("Could not open run file: %s\n", strerror(errno));
+        if (wfd >= 0) close(wfd);
+        close(fd);
+        return ERROR;
+    }
+    for (size_t i = 0; i < table->n_records; ++i)
+    {
+        const package_rec_t *rec = &table->records[i];
+        const uint32_t lens[RUN_STRINGS] = {rec->name_len, rec->version_len, rec->arch_len};
+        fwrite(lens, sizeof(lens), 1, f);
+        fwrite(branch_table_str(table, rec->name), 1, rec->name_len, f);
+        fwrite(branch_table_str(table, rec->version), 1, rec->version_len, f);
+        fwrite(branch_table_str(table, rec->arch), 1, rec->arch_len, f);
+    }
+    if (ferror(f) | fclose(f))
+    {
+        printf("Run file write error: %s\n", strerror(errno));
+        close(fd);
+        return ERROR;
+    }
+    b->runs[b->n_runs++] = fd;
+    table->n_records = 0;
+    table->strings_size = 0;
+    return SUCCESS;
+}
+
+/**
+ * @brief release_scanned_input     releases memory pages of the already scanned input
+ * @param b                         pointer to a run_builder_t structure
+ * @param pos                       pointer to the current scanning position (or to a scanner buffer)
+ */
+static void release_scanned_input(run_builder_t *b, const char *pos)
+{
+    if (pos < b->data || pos >= b->data + b->size) return;
+    size_t offset = pos - b->data;
+    if (offset < b->released + b->release_step + SCANNED_PAGES_MARGIN) return;
+
+    const size_t page = sysconf(_SC_PAGESIZE);
+    size_t end = (offset - SCANNED_PAGES_MARGIN) & ~(page - 1);
+    madvise(b->data + b->released, end - b->released, MADV_DONTNEED);
+    b->released = end;
+}
+
+/**
+ * @brief add_package_to_run    json_scan_array callback, collects packages to the current run
+ * @param ctx                   pointer to a run_builder_t structure
+ * @param fields                name, version and arch fields
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+static int add_package_to_run(void *ctx, const json_field_t *fields)
+{
+    run_builder_t *b = (run_builder_t *)ctx;
+    const char *tags[N_OUT_PARAMS] = {NAME_TAG, VERSION_TAG, ARCH_TAG};
+    for (size_t k = 0; k < N_OUT_PARAMS; ++k)
+    {
+        if (!fields[k].str)
+        {
+            printf("Package without \"%s\" field!\n", tags[k]);
+            return ERROR;
+        }
+    }
+    const size_t strings_size = fields[0].len + fields[1].len + fields[2].len + RUN_STRINGS;
+    if ((b->table.n_records == b->max_records) || (b->table.strings_size + strings_size > b->max_strings))
+    {
+        if (flush_run(b) != SUCCESS) return ERROR;
+    }
+    if (branch_table_add(&b->table, fields[0].str, fields[0].len, fields[1].str, fields[1].len,
+                         fields[2].str, fields[2].len) != SUCCESS)
+        return ERROR;
+    release_scanned_input(b, fields[0].str);
+    return SUCCESS;
+}
+
+/**
+ * @brief build_runs    streams a branch file into sorted runs
+ * @param fparam        pointer to an opened f_param_t structure
+ * @param max_memory    memory budget of the runs building
+ * @param b             pointer to a run_builder_t structure to fill
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int build_runs(const f_param_t *fparam, const size_t max_memory, run_builder_t *b)
+{
+    const char *tags[N_OUT_PARAMS] = {NAME_TAG, VERSION_TAG, ARCH_TAG};
+
+    memset(b, 0, sizeof(*b));
+    /* A half of the budget is for the records and for the radix sort buffer, another half is for strings */
+    b->max_records = max_memory / 4 / sizeof(package_rec_t);
+    b->max_strings = max_memory / 2;
+    b->data = fparam->fptr;
+    b->size = fparam->size;
+    b->release_step = max_memory / 8;
+    if (branch_table_init(&b->table, 0) != SUCCESS ||
+        branch_table_reserve(&b->table, b->max_records, b->max_strings) != SUCCESS)
+        return ERROR;
+
+    printf("Sorting \"%s\" file to runs...\n", fparam->pack_name);
+    int res = json_scan_array(fparam->fptr, fparam->size, PACKAGES_TAG, tags, N_OUT_PARAMS, add_package_to_run, b);
+    if (res == SUCCESS)
+        res = flush_run(b);
+    branch_table_destroy(&b->table);
+    if (res == SUCCESS)
+        printf("\"%s\" file is sorted to %lu runs.\n", fparam->pack_name, b->n_runs);
+    return res;
+}
+
+/**
+ * @brief destroy_runs  closes runs files of a builder
+ * @param b             pointer to a run_builder_t structure
+ */
+static void destroy_runs(run_builder_t *b)
+{
+    for (size_t i = 0; i < b->n_runs; ++i)
+    {
+        if (b->runs[i] >= 0) close(b->runs[i]);
+    }
+    free(b->runs);
+    b->runs = NULL;
+    b->n_runs = 0;
+}
+
+/**
+ * @brief run_reader_next   reads the next record of a run
+ * @param r                 pointer to a run_reader_t structure
+ * @return                  SUCCESS on success or at the end of the run, ERROR otherwise
+ */
+static int run_reader_next(run_reader_t *r)
+{
+    uint32_t lens[RUN_STRINGS];
+    r->valid = 0;
+    if (fread(lens, sizeof(lens), 1, r->file) != 1)
+    {
+        if (ferror(r->file))
+        {
+            printf("Run file read error\n");
+            return ERROR;
+        }
+        return SUCCESS;
+    }
+    const size_t need = (size_t)lens[0] + lens[1] + lens[2] + RUN_STRINGS;
+    if (need > r->strings_size)
+    {
+        char *strings = realloc(r->strings, need);
+        if (!strings)
+        {
+            printf("External comparison: memory allocation error\n");
+            return ERROR;
+        }
+        r->strings = strings;
+        r->strings_size = need;
+    }
+    char *p = r->strings;
+    for (size_t k = 0; k < RUN_STRINGS; ++k)
+    {
+        if (lens[k] && fread(p, lens[k], 1, r->file) != 1)
+        {
+            printf("Run file is truncated\n");
+            return ERROR;
+        }
+        p[lens[k]] = 0;
+        r->str[k] = p;
+        p += lens[k] + 1;
+    }
+    r->valid = 1;
+    return SUCCESS;
+}
+
+/**
+ * @brief compare_run_records   compares current records of two runs by name and arch
+ * @param a                     pointer to the first run_reader_t
+ * @param b                     pointer to the second run_reader_t
+ * @return                      strcmp like result
+ */
+static int compare_run_records(const run_reader_t *a, const run_reader_t *b)
+{
+    int res = strcmp(a->str[0], b->str[0]);
+    return res ? res : strcmp(a->str[2], b->str[2]);
+}
+
+/**
+ * @brief stream_select     finds the run with the least current record
+ * @param st                pointer to a branch_stream_t structure
+ */
+static void stream_select(branch_stream_t *st)
+{
+    st->current = NULL;
+    for (size_t i = 0; i < st->n_runs; ++i)
+    {
+        run_reader_t *r = &st->runs[i];
+        if (r->valid && (!st->current || compare_run_records(r, st->current) < 0))
+            st->current = r;
+    }
+}
+
+/**
+ * @brief stream_next   moves a branch stream to the next record
+ * @param st            pointer to a branch_stream_t structure
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int stream_next(branch_stream_t *st)
+{
+    if (run_reader_next(st->current) != SUCCESS) return ERROR;
+    stream_select(st);
+    return SUCCESS;
+}
+
+/**
+ * @brief stream_open   opens the runs of a branch for merging
+ * @param st            pointer to a branch_stream_t structure
+ * @param b             pointer to a run_builder_t structure, the runs are moved to the stream
+ * @param buffer_size   stdio buffer size of a run
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int stream_open(branch_stream_t *st, run_builder_t *b, const size_t buffer_size)
+{
+    st->current = NULL;
+    st->n_runs = 0;
+    st->runs = calloc(b->n_runs ? b->n_runs : 1, sizeof(run_reader_t));
+    if (!st->runs)
+    {
+        printf("External comparison: memory allocation error\n");
+        return ERROR;
+    }
+    for (size_t i = 0; i < b->n_runs; ++i)
+    {
+        run_reader_t *r = &st->runs[i];
+        lseek(b->runs[i], 0, SEEK_SET);
+        r->file = fdopen(b->runs[i], "r");
+        if (!r->file)
+        {
+            printf("Could not open run file: %s\n", strerror(errno));
+            return ERROR;
+        }
+        b->runs[i] = -1;
+        ++st->n_runs;
+        r->vbuf = malloc(buffer_size);
+        if (r->vbuf) setvbuf(r->file, r->vbuf, _IOFBF, buffer_size);
+        if (run_reader_next(r) != SUCCESS) return ERROR;
+    }
+    stream_select(st);
+    return SUCCESS;
+}
+
+/**
+ * @brief stream_close  closes runs of a branch stream
+ * @param st            pointer to a branch_stream_t structure
+ */
+static void stream_close(branch_stream_t *st)
+{
+    for (size_t i = 0; i < st->n_runs; ++i)
+    {
+        fclose(st->runs[i].file);
+        free(st->runs[i].vbuf);
+        free(st->runs[i].strings);
+    }
+    free(st->runs);
+    st->runs = NULL;
+    st->n_runs = 0;
+}
+
+/**
+ * @brief spill_package     appends a package to a spilled report array
+ * @param sp                pointer to a spill_t structure
+ * @param r                 run reader with the package as the current record
+ */
+static void spill_package(spill_t *sp, const run_reader_t *r)
+{
+    if (sp->count) fputs(REPORT_PACKAGES_SEPARATOR, sp->file);
+    report_package(sp->file, r->str[0], r->str[1], r->str[2]);
+    ++sp->count;
+}
+
+/**
+ * @brief count_package     counts a package of a report array by its architecture
+ * @param summary           pointer to an ext_summary_t structure
+ * @param array             report array index
+ * @param arch              package architecture
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+static int count_package(ext_summary_t *summary, const size_t array, const char *arch)
+{
+    size_t i;
+    for (i = 0; i < summary->n_archs; ++i)
+    {
+        if (!strcmp(summary->archs[i].arch, arch))
+        {
+            ++summary->archs[i].counts[array];
+            return SUCCESS;
+        }
+    }
+    if (summary->n_archs == summary->archs_capacity)
+    {
+        const size_t capacity = summary->archs_capacity ? 2 * summary->archs_capacity : 16;
+        arch_count_t *archs = realloc(summary->archs, capacity * sizeof(arch_count_t));
+        if (!archs)
+        {
+            printf("External comparison: memory allocation error\n");
+            return ERROR;
+        }
+        summary->archs = archs;
+        summary->archs_capacity = capacity;
+    }
+    memset(&summary->archs[i], 0, sizeof(arch_count_t));
+    summary->archs[i].arch = strdup(arch);
+    if (!summary->archs[i].arch)
+    {
+        printf("External comparison: memory allocation error\n");
+        return ERROR;
+    }
+    summary->archs[i].counts[array] = 1;
+    ++summary->n_archs;
+    return SUCCESS;
+}
+
+/**
+ * @brief add_package   adds a package to a report array: spills it, or only counts it in summary mode
+ * @param spills        pointer to an array of N_SPILLS spills
+ * @param summary       pointer to an ext_summary_t structure, NULL if the arrays are spilled
+ * @param array         report array index
+ * @param r             run reader with the package as the current record
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int add_package(spill_t *spills, ext_summary_t *summary, const size_t array, const run_reader_t *r)
+{
+    if (!summary)
+    {
+        spill_package(&spills[array], r);
+        return SUCCESS;
+    }
+    ++spills[array].count;
+    return count_package(summary, array, r->str[2]);
+}
+
+/**
+ * @brief merge_streams     merges two branch streams and spills (or counts) the differences
+ * @param streams           pointer to an array of 2 branch streams
+ * @param spills            pointer to an array of N_SPILLS spills
+ * @param summary           pointer to an ext_summary_t structure, NULL if the arrays are spilled
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+static int merge_streams(branch_stream_t *streams, spill_t *spills, ext_summary_t *summary)
+{
+    int res = SUCCESS;
+    while (res == SUCCESS && streams[0].current && streams[1].current)
+    {
+        int cmp = strcmp(streams[0].current->str[0], streams[1].current->str[0]);
+        if (cmp == EQUAL)
+        {
+            if (rpmvercmp(streams[0].current->str[1], streams[1].current->str[1]) > 0)
+                res = add_package(spills, summary, SPILL_NEWER, streams[0].current);
+            if (res == SUCCESS) res = stream_next(&streams[0]);
+            if (res == SUCCESS) res = stream_next(&streams[1]);
+        }
+        else if (cmp < EQUAL)
+        {
+            res = add_package(spills, summary, 1, streams[0].current);     //absent in the second branch
+            if (res == SUCCESS) res = stream_next(&streams[0]);
+        }
+        else
+        {
+            res = add_package(spills, summary, 0, streams[1].current);     //absent in the first branch
+            if (res == SUCCESS) res = stream_next(&streams[1]);
+        }
+    }
+    /* the rest of a longer branch is absent in the other one */
+    while (res == SUCCESS && streams[0].current)
+    {
+        res = add_package(spills, summary, 1, streams[0].current);
+        if (res == SUCCESS) res = stream_next(&streams[0]);
+    }
+    while (res == SUCCESS && streams[1].current)
+    {
+        res = add_package(spills, summary, 0, streams[1].current);
+        if (res == SUCCESS) res = stream_next(&streams[1]);
+    }
+    return res;
+}
+
+/**
+ * @brief out_spill     outputs a spilled report array
+ * @param out           output stream
+ * @param format        format of the array header with the branch name
+ * @param name          branch name
+ * @param sp            pointer to a spill_t structure
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int out_spill(FILE *out, const char *format, const char *name, spill_t *sp)
+{
+    char buffer[COPY_BUFFER_SIZE];
+    size_t n;
+
+    fprintf(out, REPORT_LENGTH_FORMAT, sp->count);
+    fprintf(out, format, name);
+    if (fflush(sp->file) != 0 || fseek(sp->file, 0, SEEK_SET) != 0)
+    {
+        printf("Spill file error: %s\n", strerror(errno));
+        return ERROR;
+    }
+    while ((n = fread(buffer, 1, sizeof(buffer), sp->file)) > 0)
+        fwrite(buffer, 1, n, out);
+    if (ferror(sp->file))
+    {
+        printf("Spill file read error\n");
+        return ERROR;
+    }
+    if (sp->count) fprintf(out, "\n");
+    return SUCCESS;
+}
+
+/**
+ * @brief out_spills    outputs the report from the spilled arrays
+ * @param out           output stream
+ * @param fparam        pointer to an array of 2 f_param_t structures
+ * @param spills        pointer to an array of N_SPILLS spills
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int out_spills(FILE *out, const f_param_t *fparam, spill_t *spills)
+{
+    int res = SUCCESS;
+
+    fprintf(out, "{\n");
+    for (size_t i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED && res == SUCCESS; ++i)
+    {
+        res = out_spill(out, REPORT_ABSENT_HEADER_FORMAT, fparam[i].pack_name, &spills[i]);
+        fprintf(out, "],\n");
+    }
+    if (res != SUCCESS) return res;
+    res = out_spill(out, REPORT_NEWER_HEADER_FORMAT, fparam[0].pack_name, &spills[SPILL_NEWER]);
+    fprintf(out, "]\n");
+    fprintf(out, "}\n");
+    return res;
+}
+
+/**
+ * @brief compare_arch_counts   qsort comparator of architecture counters by name
+ */
+static int compare_arch_counts(const void *a, const void *b)
+{
+    return strcmp(((const arch_count_t *)a)->arch, ((const arch_count_t *)b)->arch);
+}
+
+/**
+ * @brief out_summary   outputs lengths and per-architecture counters of the report arrays
+ * @param out           output stream
+ * @param fparam        pointer to an array of 2 f_param_t structures
+ * @param spills        pointer to an array of N_SPILLS spills with the arrays lengths
+ * @param summary       pointer to an ext_summary_t structure
+ */
+static void out_summary(FILE *out, const f_param_t *fparam, const spill_t *spills, ext_summary_t *summary)
+{
+    qsort(summary->archs, summary->n_archs, sizeof(arch_count_t), compare_arch_counts);
+    fprintf(out, "{\n");
+    for (size_t a = 0; a < N_SPILLS; ++a)
+    {
+        if (a < N_BRANCHES_TO_COMPARE_SUPPORTED)
+            fprintf(out, SUMMARY_ABSENT_HEADER_FORMAT, fparam[a].pack_name);
+        else
+            fprintf(out, SUMMARY_NEWER_HEADER_FORMAT, fparam[0].pack_name);
+        fprintf(out, SUMMARY_LENGTH_FORMAT, spills[a].count);
+        const char *separator = "";
+        for (size_t i = 0; i < summary->n_archs; ++i)
+        {
+            const arch_count_t *arch = &summary->archs[i];
+            if (!arch->counts[a]) continue;
+            fprintf(out, SUMMARY_ARCH_FORMAT, separator, (int)strlen(arch->arch), arch->arch, arch->counts[a]);
+            separator = ",";
+        }
+        fprintf(out, "%s", (a + 1 < N_SPILLS) ? SUMMARY_ARRAY_END ",\n" : SUMMARY_ARRAY_END "\n");
+    }
+    fprintf(out, "}\n");
+}
+
+int ext_compare_branches(FILE *out, const f_param_t *fparam, const size_t max_memory, const int summary)
+{
+    ext_summary_t arch_summary;
+    run_builder_t builders[N_BRANCHES_TO_COMPARE_SUPPORTED];
+    branch_stream_t streams[N_BRANCHES_TO_COMPARE_SUPPORTED];
+    spill_t spills[N_SPILLS];
+    char *spill_buffers[N_SPILLS];
+    size_t i;
+    int res = SUCCESS;
+
+    memset(builders, 0, sizeof(builders));
+    memset(streams, 0, sizeof(streams));
+    memset(spills, 0, sizeof(spills));
+    memset(spill_buffers, 0, sizeof(spill_buffers));
+    memset(&arch_summary, 0, sizeof(arch_summary));
+
+    /* Branches are sorted to runs one after another, each one may use the whole budget */
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED && res == SUCCESS; ++i)
+        res = build_runs(&fparam[i], max_memory, &builders[i]);
+
+    /* A half of the budget is shared by the runs buffers while merging */
+    size_t run_buffer_size = MAX_RUN_BUFFER_SIZE;
+    const size_t n_runs = builders[0].n_runs + builders[1].n_runs;
+    if (n_runs && run_buffer_size > max_memory / 2 / n_runs)
+        run_buffer_size = max_memory / 2 / n_runs;
+    if (run_buffer_size < MIN_RUN_BUFFER_SIZE)
+        run_buffer_size = MIN_RUN_BUFFER_SIZE;
+
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED && res == SUCCESS; ++i)
+        res = stream_open(&streams[i], &builders[i], run_buffer_size);
+    /* A summary only counts the differences, nothing is spilled */
+    for (i = 0; i < N_SPILLS && res == SUCCESS && !summary; ++i)
+    {
+        int fd = ext_tmpfd();
+        spills[i].file = (fd >= 0) ? fdopen(fd, "w+") : NULL;
+        if (!spills[i].file)
+        {
+            if (fd >= 0) close(fd);
+            res = ERROR;
+            break;
+        }
+        spill_buffers[i] = malloc(SPILL_BUFFER_SIZE);
+        if (spill_buffers[i]) setvbuf(spills[i].file, spill_buffers[i], _IOFBF, SPILL_BUFFER_SIZE);
+    }
+
+    if (res == SUCCESS)
+        res = merge_streams(streams, spills, summary ? &arch_summary : NULL);
+    if (res == SUCCESS && summary)
+        out_summary(out, fparam, spills, &arch_summary);
+    else if (res == SUCCESS)
+        res = out_spills(out, fparam, spills);
+
+    for (i = 0; i < N_SPILLS; ++i)
+    {
+        if (spills[i].file) fclose(spills[i].file);
+        free(spill_buffers[i]);
+    }
+    for (i = 0; i < arch_summary.n_archs; ++i)
+        free(arch_summary.archs[i].arch);
+    free(arch_summary.archs);
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+    {
+        stream_close(&streams[i]);
+        destroy_runs(&builders[i]);
+    }
+    return res;
+}
@@ -0,0 +1,28 @@
+#ifndef __EXT_COMPARE_H_
+#define __EXT_COMPARE_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * External-memory comparison of two branches with a bounded memory budget.
+ * Every branch is streamed from the mapped file into sorted runs in temporary files,
+ * the runs are merged by a streaming k-way merge that keeps only small buffers in memory,
+ * and the found differences are spilled to temporary files before they are output
+ * (a summary only counts them by architectures).
+ * Temporary files are created in $TMPDIR (/tmp by default) and are removed at once.
+ */
+
+#include <stdio.h>
+#include "pcompare.h"
+
+#define EXT_MIN_MEMORY      (4 * 1024 * 1024)   // minimal supported memory budget
+
+/**
+ * @brief ext_compare_branches  compares two opened branches within a memory budget
+ * @param out                   output stream
+ * @param fparam                pointer to an array of 2 opened f_param_t structures
+ * @param max_memory            memory budget in bytes
+ * @param summary               1 to output lengths and per-architecture counters of the report arrays only
+ * @return                      SUCCESS code on success, ERROR code otherwise
+ */
+int ext_compare_branches(FILE *out, const f_param_t *fparam, const size_t max_memory, const int summary);
+
+#endif //__EXT_COMPARE_H_
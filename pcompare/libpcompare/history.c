@@ -0,0 +1,1154 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * History archive of branch snapshots. Every branch has a directory "<dir>/<branch>" with
+ * "<date>.full" checkpoints keeping whole package tables and "<date>.delta" files keeping
+ * added, removed and version-changed packages against the previous snapshot.
+ * A snapshot is reconstructed from the last checkpoint before it: the following deltas are
+ * decoded in parallel, composed into one delta and applied to the checkpoint in one merge.
+ * Files are front-coded: a name is stored as the length of the prefix shared with the previous
+ * record name and the rest, architectures are indexes in the file dictionary.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "pcompare.h"
+#include "branch_table.h"
+#include "thread_pool.h"
+#include "compare.h"
+
+#define HISTORY_MAGIC               "PCHIST1"   // file signature, 8 bytes with the terminating zero
+#define HISTORY_FULL_SUFFIX         ".full"
+#define HISTORY_DELTA_SUFFIX        ".delta"
+#define HISTORY_DATE_LEN            10          // "YYYY-MM-DD"
+#define HISTORY_DATE_SEPARATOR      '@'         // separator of the branch name and the date of a snapshot name
+#define HISTORY_CHECKPOINT_INTERVAL 30          // deltas between checkpoints
+#define HISTORY_MIN_BUFFER          (64 * 1024)
+#define HISTORY_MIN_RECORD_SIZE     4           // shared length, suffix length, arch and version length
+#define HISTORY_KIND_FULL           0
+#define HISTORY_KIND_DELTA          1
+#define HISTORY_OP_ADDED            1           // package is added
+#define HISTORY_OP_REMOVED          2           // package is removed, the record has no version
+#define HISTORY_OP_CHANGED          3           // versions of the package are changed
+
+//snapshot file of a branch directory
+typedef struct
+{
+    char    date[HISTORY_DATE_LEN + 1];     //snapshot date
+    int     full;                           //1 - checkpoint, 0 - delta
+}history_file_t;
+
+//packages of a snapshot file: a whole table or changes against the previous snapshot
+typedef struct
+{
+    branch_table_t  table;      //records sorted by name and arch, records of one name and arch are consecutive
+    uint8_t         *ops;       //HISTORY_OP_* of every record of a delta, NULL for a checkpoint
+}history_records_t;
+
+//growing output buffer of a file
+typedef struct
+{
+    uint8_t     *data;      //file data
+    size_t      size;       //used size
+    size_t      capacity;   //allocated size
+    int         result;     //SUCCESS or ERROR after a failed allocation
+}history_buffer_t;
+
+//input position of a file
+typedef struct
+{
+    const uint8_t   *pos;       //current position
+    const uint8_t   *end;       //end of the file data
+    int             result;     //SUCCESS or ERROR after a read over the end
+}history_reader_t;
+
+//file decoding task parameters
+typedef struct
+{
+    char                path[PATH_MAX]; //file path
+    int                 full;           //1 - checkpoint, 0 - delta
+    history_records_t   records;        //decoded records
+    int                 result;         //SUCCESS or ERROR
+}history_decode_t;
+
+//reference to a record of a decoded delta
+typedef struct
+{
+    uint32_t    delta;      //delta index
+    uint32_t    record;     //record index in the delta
+}history_ref_t;
+
+//composed deltas: references to the records of the latest delta of every name and arch, sorted by name and arch
+typedef struct
+{
+    history_ref_t   *refs;      //references array
+    size_t          n_refs;     //number of references
+}history_refs_t;
+
+//deltas composition task parameters
+typedef struct
+{
+    const history_decode_t  *deltas;    //decoded deltas
+    const history_refs_t    *base;      //earlier composed deltas
+    const history_refs_t    *delta;     //later composed deltas
+    history_refs_t          out;        //composition
+    int                     result;     //SUCCESS or ERROR
+}history_merge_t;
+
+/**
+ * @brief records_destroy   releases records of a snapshot file
+ * @param records           pointer to a history_records_t structure
+ */
+static void records_destroy(history_records_t *records)
+{
+    branch_table_destroy(&records->table);
+    free(records->ops);
+    records->ops = NULL;
+}
+
+/**
+ * @brief records_init  allocates records of a snapshot file
+ * @param records       pointer to a history_records_t structure
+ * @param n_records     records capacity, 0 for the default one
+ * @param strings_size  strings arena capacity
+ * @param n_ops         number of delta records ops to allocate, 0 for a checkpoint
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int records_init(history_records_t *records, const size_t n_records, const size_t strings_size, const size_t n_ops)
+{
+    records->ops = NULL;
+    if (branch_table_init(&records->table, 0) != SUCCESS)
+        return ERROR;
+    if (n_records && branch_table_reserve(&records->table, n_records, strings_size) != SUCCESS)
+    {
+        branch_table_destroy(&records->table);
+        return ERROR;
+    }
+    if (n_ops && !(records->ops = malloc(n_ops)))
+    {
+        printf("History: memory allocation error\n");
+        branch_table_destroy(&records->table);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief add_record    appends a record of a table to records of a snapshot file
+ * @param records       pointer to a history_records_t structure
+ * @param table         source table
+ * @param rec           source record
+ * @param op            HISTORY_OP_* of a delta record, ignored for a checkpoint
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int add_record(history_records_t *records, const branch_table_t *table, const package_rec_t *rec, const uint8_t op)
+{
+    const int removed = records->ops && (op == HISTORY_OP_REMOVED);
+    if (records->ops)
+        records->ops[records->table.n_records] = op;
+    return branch_table_add(&records->table, branch_table_str(table, rec->name), rec->name_len,
+                            removed ? "" : branch_table_str(table, rec->version), removed ? 0 : rec->version_len,
+                            branch_table_str(table, rec->arch), rec->arch_len);
+}
+
+/**
+ * @brief compare_keys  compares records of two tables by name and arch
+ * @param ta            first table
+ * @param a             record of the first table
+ * @param tb            second table
+ * @param b             record of the second table
+ * @return              strcmp like result
+ */
+static int compare_keys(const branch_table_t *ta, const package_rec_t *a, const branch_table_t *tb, const package_rec_t *b)
+{
+    if (a->name_prefix != b->name_prefix)
+        return (a->name_prefix > b->name_prefix) ? 1 : -1;
+    const int res = strcmp(branch_table_str(ta, a->name), branch_table_str(tb, b->name));
+    if (res)
+        return res;
+    return strcmp(branch_table_str(ta, a->arch), branch_table_str(tb, b->arch));
+}
+
+/**
+ * @brief key_end   returns the end of the records run with the same name and arch
+ * @param table     sorted table
+ * @param start     first record of the run
+ * @return          index of the first record after the run
+ */
+static size_t key_end(const branch_table_t *table, const size_t start)
+{
+    size_t end = start + 1;
+    while (end < table->n_records &&
+           !compare_keys(table, &table->records[start], table, &table->records[end]))
+        ++end;
+    return end;
+}
+
+/**
+ * @brief add_run   appends a run of records to records of a snapshot file
+ * @param records   pointer to a history_records_t structure
+ * @param table     source table
+ * @param start     first record of the run
+ * @param end       end of the run
+ * @param op        HISTORY_OP_* of the records
+ * @return          SUCCESS on success, ERROR otherwise
+ */
+static int add_run(history_records_t *records, const branch_table_t *table, const size_t start, const size_t end,
+                   const uint8_t op)
+{
+    for (size_t i = start; i < end; ++i)
+    {
+        if (add_record(records, table, &table->records[i], op) != SUCCESS)
+            return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief runs_equal    checks that runs of the same name and arch have the same versions
+ * @param ta            first table
+ * @param a             first record of the run of the first table
+ * @param a_end         end of the run of the first table
+ * @param tb            second table
+ * @param b             first record of the run of the second table
+ * @param b_end         end of the run of the second table
+ * @return              1 if the runs are equal, 0 otherwise
+ */
+static int runs_equal(const branch_table_t *ta, size_t a, const size_t a_end,
+                      const branch_table_t *tb, size_t b, const size_t b_end)
+{
+    if (a_end - a != b_end - b)
+        return 0;
+    for (; a < a_end; ++a, ++b)
+    {
+        const package_rec_t *ra = &ta->records[a], *rb = &tb->records[b];
+        if (ra->version_len != rb->version_len ||
+            memcmp(branch_table_str(ta, ra->version), branch_table_str(tb, rb->version), ra->version_len))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief make_delta    finds changes of a snapshot against the previous one
+ * @param prev          previous snapshot table
+ * @param cur           new snapshot table
+ * @param delta         pointer to a history_records_t structure to store the changes
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int make_delta(const branch_table_t *prev, const branch_table_t *cur, history_records_t *delta)
+{
+    size_t i = 0, j = 0;
+
+    if (records_init(delta, 0, 0, prev->n_records + cur->n_records + 1) != SUCCESS)
+        return ERROR;
+    while (i < prev->n_records || j < cur->n_records)
+    {
+        const int res = (i == prev->n_records) ? 1 : (j == cur->n_records) ? -1 :
+                        compare_keys(prev, &prev->records[i], cur, &cur->records[j]);
+        const size_t i_end = (res <= 0) ? key_end(prev, i) : i;
+        const size_t j_end = (res >= 0) ? key_end(cur, j) : j;
+        int added = SUCCESS;
+        if (res < 0)
+            added = add_record(delta, prev, &prev->records[i], HISTORY_OP_REMOVED);
+        else if (res > 0)
+            added = add_run(delta, cur, j, j_end, HISTORY_OP_ADDED);
+        else if (!runs_equal(prev, i, i_end, cur, j, j_end))
+            added = add_run(delta, cur, j, j_end, HISTORY_OP_CHANGED);
+        if (added != SUCCESS)
+        {
+            records_destroy(delta);
+            return ERROR;
+        }
+        i = i_end;
+        j = j_end;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief buffer_put    appends bytes to an output buffer
+ * @param buffer        pointer to a history_buffer_t structure
+ * @param data          bytes
+ * @param size          number of bytes
+ */
+static void buffer_put(history_buffer_t *buffer, const void *data, const size_t size)
+{
+    if (buffer->result != SUCCESS)
+        return;
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : HISTORY_MIN_BUFFER;
+        while (capacity < buffer->size + size) capacity *= 2;
+        uint8_t *data = realloc(buffer->data, capacity);
+        if (!data)
+        {
+            printf("History: memory allocation error\n");
+            buffer->result = ERROR;
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+/**
+ * @brief buffer_put_varint appends an unsigned LEB128 number to an output buffer
+ * @param buffer            pointer to a history_buffer_t structure
+ * @param value             number
+ */
+static void buffer_put_varint(history_buffer_t *buffer, uint64_t value)
+{
+    uint8_t bytes[10];
+    size_t n = 0;
+    do
+    {
+        bytes[n++] = (value & 0x7f) | ((value >> 7) ? 0x80 : 0);
+        value >>= 7;
+    } while (value);
+    buffer_put(buffer, bytes, n);
+}
+
+/**
+ * @brief arch_index    finds an arch in the dictionary of a file (branches have a few archs)
+ * @param table         table of the records
+ * @param archs         dictionary: records with the distinct archs
+ * @param n_archs       dictionary size
+ * @param rec           record
+ * @return              index of the arch, n_archs if not found
+ */
+static size_t arch_index(const branch_table_t *table, const package_rec_t **archs, const size_t n_archs,
+                         const package_rec_t *rec)
+{
+    const char *arch = branch_table_str(table, rec->arch);
+    for (size_t k = 0; k < n_archs; ++k)
+    {
+        if (archs[k]->arch_len == rec->arch_len && !memcmp(branch_table_str(table, archs[k]->arch), arch, rec->arch_len))
+            return k;
+    }
+    return n_archs;
+}
+
+/**
+ * @brief encode_records    encodes records of a snapshot file
+ * @param records           pointer to a history_records_t structure
+ * @param buffer            pointer to an empty history_buffer_t structure to store the file
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+static int encode_records(const history_records_t *records, history_buffer_t *buffer)
+{
+    const branch_table_t *table = &records->table;
+    const package_rec_t **archs = NULL;
+    size_t n_archs = 0, capacity = 0, strings_size = 0, i;
+
+    for (i = 0; i < table->n_records; ++i)
+    {
+        const package_rec_t *rec = &table->records[i];
+        strings_size += rec->name_len + rec->version_len + rec->arch_len + 3;
+        if (arch_index(table, archs, n_archs, rec) < n_archs)
+            continue;
+        if (n_archs == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            const package_rec_t **p = realloc(archs, capacity * sizeof(*archs));
+            if (!p)
+            {
+                printf("History: memory allocation error\n");
+                free(archs);
+                return ERROR;
+            }
+            archs = p;
+        }
+        archs[n_archs++] = rec;
+    }
+
+    const uint8_t kind = records->ops ? HISTORY_KIND_DELTA : HISTORY_KIND_FULL;
+    buffer_put(buffer, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+    buffer_put(buffer, &kind, 1);
+    buffer_put_varint(buffer, n_archs);
+    for (i = 0; i < n_archs; ++i)
+    {
+        buffer_put_varint(buffer, archs[i]->arch_len);
+        buffer_put(buffer, branch_table_str(table, archs[i]->arch), archs[i]->arch_len);
+    }
+    buffer_put_varint(buffer, table->n_records);
+    buffer_put_varint(buffer, strings_size);
+
+    /* Sorted names share long prefixes: only the rest of a name is stored */
+    const char *prev = "";
+    size_t prev_len = 0;
+    for (i = 0; i < table->n_records && buffer->result == SUCCESS; ++i)
+    {
+        const package_rec_t *rec = &table->records[i];
+        const char *name = branch_table_str(table, rec->name);
+        size_t shared = 0;
+        while (shared < prev_len && shared < rec->name_len && prev[shared] == name[shared])
+            ++shared;
+        if (records->ops)
+            buffer_put(buffer, &records->ops[i], 1);
+        buffer_put_varint(buffer, shared);
+        buffer_put_varint(buffer, rec->name_len - shared);
+        buffer_put(buffer, name + shared, rec->name_len - shared);
+        buffer_put_varint(buffer, arch_index(table, archs, n_archs, rec));
+        buffer_put_varint(buffer, rec->version_len);
+        buffer_put(buffer, branch_table_str(table, rec->version), rec->version_len);
+        prev = name;
+        prev_len = rec->name_len;
+    }
+    free(archs);
+    return buffer->result;
+}
+
+/**
+ * @brief reader_varint reads an unsigned LEB128 number
+ * @param reader        pointer to a history_reader_t structure
+ * @return              the number, 0 after an error
+ */
+static uint64_t reader_varint(history_reader_t *reader)
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64 && reader->pos < reader->end; shift += 7)
+    {
+        const uint8_t byte = *reader->pos++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    reader->result = ERROR;
+    return 0;
+}
+
+/**
+ * @brief reader_bytes  reads bytes
+ * @param reader        pointer to a history_reader_t structure
+ * @param size          number of bytes
+ * @return              pointer to the bytes, NULL after an error
+ */
+static const char *reader_bytes(history_reader_t *reader, const uint64_t size)
+{
+    if (reader->result != SUCCESS || size > (uint64_t)(reader->end - reader->pos))
+    {
+        reader->result = ERROR;
+        return NULL;
+    }
+    const char *bytes = (const char *)reader->pos;
+    reader->pos += size;
+    return bytes;
+}
+
+/**
+ * @brief decode_records    decodes records of a snapshot file
+ * @param data              file data
+ * @param size              file size
+ * @param full              1 - checkpoint, 0 - delta
+ * @param records           pointer to a history_records_t structure to store the records
+ * @return                  SUCCESS on success, ERROR on invalid data or memory allocation error
+ */
+static int decode_records(const uint8_t *data, const size_t size, const int full, history_records_t *records)
+{
+    history_reader_t reader = { data, data + size, SUCCESS };
+    const char *magic = reader_bytes(&reader, sizeof(HISTORY_MAGIC));
+    const char *kind = reader_bytes(&reader, 1);
+    if (!kind || memcmp(magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) ||
+        *kind != (full ? HISTORY_KIND_FULL : HISTORY_KIND_DELTA))
+        return ERROR;
+
+    const uint64_t n_archs = reader_varint(&reader);
+    if (reader.result != SUCCESS || n_archs > (uint64_t)(reader.end - reader.pos))
+        return ERROR;
+    const char **archs = malloc((n_archs + 1) * sizeof(*archs));
+    size_t *archs_len = malloc((n_archs + 1) * sizeof(*archs_len));
+    if (!archs || !archs_len)
+    {
+        printf("History: memory allocation error\n");
+        free(archs);
+        free(archs_len);
+        return ERROR;
+    }
+    for (size_t k = 0; k < n_archs; ++k)
+    {
+        archs_len[k] = reader_varint(&reader);
+        archs[k] = reader_bytes(&reader, archs_len[k]);
+    }
+    const uint64_t n_records = reader_varint(&reader);
+    const uint64_t strings_size = reader_varint(&reader);
+    if (reader.result != SUCCESS || n_records > (uint64_t)(reader.end - reader.pos) / HISTORY_MIN_RECORD_SIZE ||
+        strings_size > UINT32_MAX ||
+        records_init(records, n_records + 1, strings_size + 1, full ? 0 : n_records + 1) != SUCCESS)
+    {
+        free(archs);
+        free(archs_len);
+        return ERROR;
+    }
+
+    char *name = NULL;
+    size_t name_len = 0, name_capacity = 0;
+    int res = SUCCESS;
+    for (uint64_t i = 0; i < n_records && res == SUCCESS; ++i)
+    {
+        const char *op = full ? NULL : reader_bytes(&reader, 1);
+        const uint64_t shared = reader_varint(&reader);
+        const uint64_t suffix_len = reader_varint(&reader);
+        const char *suffix = reader_bytes(&reader, suffix_len);
+        const uint64_t arch = reader_varint(&reader);
+        const uint64_t version_len = reader_varint(&reader);
+        const char *version = reader_bytes(&reader, version_len);
+        if (reader.result != SUCCESS || shared > name_len || arch >= n_archs ||
+            (op && (*op < HISTORY_OP_ADDED || *op > HISTORY_OP_CHANGED)))
+        {
+            res = ERROR;
+            break;
+        }
+        if (shared + suffix_len + 1 > name_capacity)
+        {
+            name_capacity = (shared + suffix_len + 1) * 2;
+            char *p = realloc(name, name_capacity);
+            if (!p)
+            {
+                printf("History: memory allocation error\n");
+                res = ERROR;
+                break;
+            }
+            name = p;
+        }
+        memcpy(name + shared, suffix, suffix_len);
+        name_len = shared + suffix_len;
+        if (op)
+            records->ops[i] = *op;
+        res = branch_table_add(&records->table, name, name_len, version, version_len, archs[arch], archs_len[arch]);
+    }
+    if (res == SUCCESS && reader.pos != reader.end)
+        res = ERROR;
+    free(name);
+    free(archs);
+    free(archs_len);
+    if (res != SUCCESS)
+        records_destroy(records);
+    return res;
+}
+
+/**
+ * @brief read_file     reads a whole file
+ * @param path          file path
+ * @param size          pointer to store the file size
+ * @return              file data to free, NULL on error
+ */
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    struct stat st;
+    uint8_t *data = NULL;
+    size_t done = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0 || !(data = malloc(st.st_size ? st.st_size : 1)))
+    {
+        printf("Could not read history file \"%s\": %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    while (done < (size_t)st.st_size)
+    {
+        const ssize_t n = read(fd, data + done, st.st_size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+        {
+            printf("Could not read history file \"%s\": %s\n", path, n ? strerror(errno) : "unexpected end");
+            close(fd);
+            free(data);
+            return NULL;
+        }
+        done += n;
+    }
+    close(fd);
+    *size = done;
+    return data;
+}
+
+/**
+ * @brief write_file    writes a file atomically: to a temporary file which is renamed then
+ * @param path          file path
+ * @param data          file data
+ * @param size          file size
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int write_file(const char *path, const uint8_t *data, const size_t size)
+{
+    char tmp_path[PATH_MAX];
+    size_t done = 0;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >= (int)sizeof(tmp_path))
+        return ERROR;
+    int fd = mkstemp(tmp_path);
+    if (fd < 0)
+    {
+        printf("Could not create history file \"%s\": %s\n", path, strerror(errno));
+        return ERROR;
+    }
+    while (done < size)
+    {
+        const ssize_t n = write(fd, data + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        done += n;
+    }
+    fchmod(fd, 0644);
+    if (done < size || fsync(fd) != 0 || close(fd) != 0 || rename(tmp_path, path) != 0)
+    {
+        printf("Could not write history file \"%s\": %s\n", path, strerror(errno));
+        if (done < size) close(fd);
+        unlink(tmp_path);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief decode_task   thread pool task, reads and decodes a snapshot file
+ * @param param         pointer to a history_decode_t structure
+ */
+static void decode_task(void *param)
+{
+    history_decode_t *decode = (history_decode_t *)param;
+    size_t size;
+    uint8_t *data = read_file(decode->path, &size);
+    if (!data)
+        return;
+    decode->result = decode_records(data, size, decode->full, &decode->records);
+    if (decode->result != SUCCESS)
+        printf("Invalid history file \"%s\"\n", decode->path);
+    free(data);
+}
+
+/**
+ * @brief is_date   checks a "YYYY-MM-DD" date
+ * @param date      string
+ * @param len       string length
+ * @return          1 if the string is a date, 0 otherwise
+ */
+static int is_date(const char *date, const size_t len)
+{
+    if (len != HISTORY_DATE_LEN)
+        return 0;
+    for (size_t i = 0; i < HISTORY_DATE_LEN; ++i)
+    {
+        if ((i == 4 || i == 7) ? (date[i] != '-') : (date[i] < '0' || date[i] > '9'))
+            return 0;
+    }
+    const int month = (date[5] - '0') * 10 + (date[6] - '0');
+    const int day = (date[8] - '0') * 10 + (date[9] - '0');
+    return (month >= 1 && month <= 12 && day >= 1 && day <= 31);
+}
+
+/**
+ * @brief compare_files qsort comparator of snapshot files by date ("YYYY-MM-DD" dates are ordered as strings)
+ */
+static int compare_files(const void *a, const void *b)
+{
+    return strcmp(((const history_file_t *)a)->date, ((const history_file_t *)b)->date);
+}
+
+/**
+ * @brief list_files    lists snapshot files of a branch directory
+ * @param branch_dir    branch directory
+ * @param files         pointer to store the array of files sorted by date, to free
+ * @param n_files       pointer to store number of files
+ * @return              SUCCESS on success (no directory is no files), ERROR otherwise
+ */
+static int list_files(const char *branch_dir, history_file_t **files, size_t *n_files)
+{
+    history_file_t *list = NULL;
+    size_t n = 0, capacity = 0;
+    struct dirent *de;
+
+    *files = NULL;
+    *n_files = 0;
+    DIR *d = opendir(branch_dir);
+    if (!d)
+    {
+        if (errno == ENOENT)
+            return SUCCESS;
+        printf("Could not open history directory \"%s\": %s\n", branch_dir, strerror(errno));
+        return ERROR;
+    }
+    while ((de = readdir(d)))
+    {
+        const char *suffix = de->d_name + HISTORY_DATE_LEN;
+        if (strlen(de->d_name) <= HISTORY_DATE_LEN || !is_date(de->d_name, HISTORY_DATE_LEN) ||
+            (strcmp(suffix, HISTORY_FULL_SUFFIX) && strcmp(suffix, HISTORY_DELTA_SUFFIX)))
+            continue;
+        if (n == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            history_file_t *p = realloc(list, capacity * sizeof(history_file_t));
+            if (!p)
+            {
+                printf("History: memory allocation error\n");
+                closedir(d);
+                free(list);
+                return ERROR;
+            }
+            list = p;
+        }
+        memcpy(list[n].date, de->d_name, HISTORY_DATE_LEN);
+        list[n].date[HISTORY_DATE_LEN] = 0;
+        list[n].full = !strcmp(suffix, HISTORY_FULL_SUFFIX);
+        ++n;
+    }
+    closedir(d);
+    if (n)
+        qsort(list, n, sizeof(history_file_t), compare_files);
+    for (size_t i = 1; i < n; ++i)
+    {
+        if (!strcmp(list[i - 1].date, list[i].date))
+        {
+            printf("History directory \"%s\" has two snapshots of %s\n", branch_dir, list[i].date);
+            free(list);
+            return ERROR;
+        }
+    }
+    *files = list;
+    *n_files = n;
+    return SUCCESS;
+}
+
+/**
+ * @brief file_path     builds path of a snapshot file
+ * @param path          buffer of PATH_MAX bytes
+ * @param branch_dir    branch directory
+ * @param file          snapshot file
+ * @return              SUCCESS on success, ERROR if the path is too long
+ */
+static int file_path(char *path, const char *branch_dir, const history_file_t *file)
+{
+    const int len = snprintf(path, PATH_MAX, "%s/%s%s", branch_dir, file->date,
+                             file->full ? HISTORY_FULL_SUFFIX : HISTORY_DELTA_SUFFIX);
+    return (len < PATH_MAX) ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief ref_table returns the table of a referenced delta record
+ * @param deltas    decoded deltas
+ * @param ref       reference
+ * @return          pointer to the table of the delta
+ */
+static inline const branch_table_t *ref_table(const history_decode_t *deltas, const history_ref_t *ref)
+{
+    return &deltas[ref->delta].records.table;
+}
+
+/**
+ * @brief ref_record    returns a referenced delta record
+ * @param deltas        decoded deltas
+ * @param ref           reference
+ * @return              pointer to the record
+ */
+static inline const package_rec_t *ref_record(const history_decode_t *deltas, const history_ref_t *ref)
+{
+    return &deltas[ref->delta].records.table.records[ref->record];
+}
+
+/**
+ * @brief ref_run   returns length of the run of a name and arch starting at a reference
+ *                  (a run is composed as a whole, so it is a run of one delta)
+ * @param deltas    decoded deltas
+ * @param ref       reference of the first record of the run
+ * @return          number of records of the run
+ */
+static inline size_t ref_run(const history_decode_t *deltas, const history_ref_t *ref)
+{
+    return key_end(ref_table(deltas, ref), ref->record) - ref->record;
+}
+
+/**
+ * @brief merge_task    thread pool task, composes two composed deltas: runs of the later ones replace runs
+ *                      of the same name and arch of the earlier ones, only references are copied
+ * @param param         pointer to a history_merge_t structure
+ */
+static void merge_task(void *param)
+{
+    history_merge_t *merge = (history_merge_t *)param;
+    const history_refs_t *a = merge->base, *b = merge->delta;
+    history_refs_t *out = &merge->out;
+    size_t i = 0, j = 0;
+
+    out->n_refs = 0;
+    out->refs = malloc((a->n_refs + b->n_refs + 1) * sizeof(history_ref_t));
+    if (!out->refs)
+    {
+        printf("History: memory allocation error\n");
+        return;
+    }
+    while (i < a->n_refs || j < b->n_refs)
+    {
+        const history_ref_t *ra = &a->refs[i], *rb = &b->refs[j];
+        const int res = (i == a->n_refs) ? 1 : (j == b->n_refs) ? -1 :
+                        compare_keys(ref_table(merge->deltas, ra), ref_record(merge->deltas, ra),
+                                     ref_table(merge->deltas, rb), ref_record(merge->deltas, rb));
+        const size_t i_end = (res <= 0) ? i + ref_run(merge->deltas, ra) : i;
+        const size_t j_end = (res >= 0) ? j + ref_run(merge->deltas, rb) : j;
+        if (res < 0)
+            memcpy(out->refs + out->n_refs, ra, (i_end - i) * sizeof(history_ref_t));
+        else
+            memcpy(out->refs + out->n_refs, rb, (j_end - j) * sizeof(history_ref_t));
+        out->n_refs += (res < 0) ? i_end - i : j_end - j;
+        i = i_end;
+        j = j_end;
+    }
+    merge->result = SUCCESS;
+}
+
+/**
+ * @brief compose_deltas    composes deltas pairwise, an earlier one with the next one, in log2(n) rounds
+ *                          of concurrent merges of the records references
+ * @param deltas            array of decoded deltas in the date order
+ * @param n                 number of deltas
+ * @param composed          pointer to a history_refs_t structure to store the composition, to free
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+static int compose_deltas(const history_decode_t *deltas, size_t n, history_refs_t *composed)
+{
+    history_refs_t *refs = calloc(n, sizeof(history_refs_t));
+    history_merge_t *merges = malloc(n / 2 * sizeof(history_merge_t) + 1);
+    tpool_group_t group;
+    size_t k;
+    int res = (refs && merges) ? SUCCESS : ERROR;
+
+    for (k = 0; k < n && res == SUCCESS; ++k)
+    {
+        const size_t n_records = deltas[k].records.table.n_records;
+        refs[k].refs = malloc((n_records + 1) * sizeof(history_ref_t));
+        if (!refs[k].refs)
+        {
+            res = ERROR;
+            break;
+        }
+        for (size_t r = 0; r < n_records; ++r)
+        {
+            refs[k].refs[r].delta = k;
+            refs[k].refs[r].record = r;
+        }
+        refs[k].n_refs = n_records;
+    }
+    if (res != SUCCESS)
+        printf("History: memory allocation error\n");
+
+    while (n > 1 && res == SUCCESS)
+    {
+        const size_t n_merges = n / 2;
+        tpool_group_init(&group);
+        for (k = 0; k < n_merges; ++k)
+        {
+            merges[k].deltas = deltas;
+            merges[k].base = &refs[2 * k];
+            merges[k].delta = &refs[2 * k + 1];
+            merges[k].result = ERROR;
+            tpool_submit(&group, merge_task, &merges[k]);
+        }
+        tpool_group_wait(&group);
+        /* Results replace the merged pairs, k-th result goes to the place of the k/2-th pair consumed before */
+        for (k = 0; k < n_merges; ++k)
+        {
+            free(refs[2 * k].refs);
+            free(refs[2 * k + 1].refs);
+            refs[2 * k].refs = refs[2 * k + 1].refs = NULL;
+            if (merges[k].result != SUCCESS)
+            {
+                free(merges[k].out.refs);
+                res = ERROR;
+                continue;
+            }
+            refs[k] = merges[k].out;
+        }
+        if (n % 2)
+        {
+            refs[n_merges] = refs[n - 1];
+            refs[n - 1].refs = NULL;
+        }
+        n = n_merges + n % 2;
+    }
+
+    if (res == SUCCESS)
+        *composed = refs[0];
+    for (k = (res == SUCCESS) ? 1 : 0; refs && k < n; ++k)
+        free(refs[k].refs);
+    free(refs);
+    free(merges);
+    return res;
+}
+
+/**
+ * @brief apply_deltas  applies composed deltas to a checkpoint: runs of the deltas replace runs of the same
+ *                      name and arch, removed ones are dropped. The snapshot takes over the checkpoint strings
+ *                      arena, so records of the checkpoint are copied without their strings
+ * @param base          checkpoint, its arena is moved to the snapshot
+ * @param deltas        decoded deltas
+ * @param composed      composed deltas
+ * @param out           pointer to a branch_table_t structure to store the snapshot
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int apply_deltas(history_records_t *base, const history_decode_t *deltas, const history_refs_t *composed,
+                        branch_table_t *out)
+{
+    branch_table_t bt = base->table;    //checkpoint records with the strings of the snapshot
+    size_t i = 0, j = 0;
+
+    *out = bt;
+    out->n_records = 0;
+    out->records_capacity = bt.n_records + composed->n_refs + 1;
+    out->records = malloc(out->records_capacity * sizeof(package_rec_t));
+    if (!out->records)
+    {
+        printf("History: memory allocation error\n");
+        return ERROR;
+    }
+    base->table.strings = NULL;
+    base->table.strings_size = base->table.strings_capacity = 0;
+    while (i < bt.n_records || j < composed->n_refs)
+    {
+        const history_ref_t *ref = &composed->refs[j];
+        const int res = (i == bt.n_records) ? 1 : (j == composed->n_refs) ? -1 :
+                        compare_keys(&bt, &bt.records[i], ref_table(deltas, ref), ref_record(deltas, ref));
+        const size_t i_end = (res <= 0) ? key_end(&bt, i) : i;
+        const size_t j_end = (res >= 0) ? j + ref_run(deltas, ref) : j;
+        if (res < 0)
+        {
+            memcpy(out->records + out->n_records, bt.records + i, (i_end - i) * sizeof(package_rec_t));
+            out->n_records += i_end - i;
+        }
+        else if (deltas[ref->delta].records.ops[ref->record] != HISTORY_OP_REMOVED)
+        {
+            for (size_t k = j; k < j_end; ++k)
+            {
+                const branch_table_t *table = ref_table(deltas, &composed->refs[k]);
+                const package_rec_t *rec = ref_record(deltas, &composed->refs[k]);
+                if (branch_table_add(out, branch_table_str(table, rec->name), rec->name_len,
+                                     branch_table_str(table, rec->version), rec->version_len,
+                                     branch_table_str(table, rec->arch), rec->arch_len) != SUCCESS)
+                {
+                    branch_table_destroy(out);
+                    return ERROR;
+                }
+            }
+            bt.strings = out->strings;
+        }
+        i = i_end;
+        j = j_end;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief load_snapshot reconstructs a snapshot from the last checkpoint before it and the following deltas
+ * @param branch_dir    branch directory
+ * @param files         snapshot files sorted by date
+ * @param last          index of the snapshot file
+ * @param table         pointer to a branch_table_t structure to store the snapshot
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int load_snapshot(const char *branch_dir, const history_file_t *files, const size_t last, branch_table_t *table)
+{
+    size_t first = last, i;
+    while (first && !files[first].full)
+        --first;
+    if (!files[first].full)
+    {
+        printf("History directory \"%s\" has no checkpoint before %s\n", branch_dir, files[last].date);
+        return ERROR;
+    }
+
+    /* The checkpoint and the deltas are read and decoded concurrently */
+    const size_t n = last - first + 1;
+    history_decode_t *decodes = calloc(n, sizeof(history_decode_t));
+    if (!decodes)
+    {
+        printf("History: memory allocation error\n");
+        return ERROR;
+    }
+    tpool_group_t group;
+    tpool_group_init(&group);
+    for (i = 0; i < n; ++i)
+    {
+        decodes[i].full = files[first + i].full;
+        decodes[i].result = ERROR;
+        if (file_path(decodes[i].path, branch_dir, &files[first + i]) == SUCCESS)
+            tpool_submit(&group, decode_task, &decodes[i]);
+    }
+    tpool_group_wait(&group);
+    int res = SUCCESS;
+    for (i = 0; i < n; ++i)
+    {
+        if (decodes[i].result != SUCCESS)
+            res = ERROR;
+    }
+
+    /* Deltas are small: they are composed into one, so the checkpoint is merged once */
+    if (res == SUCCESS && n > 1)
+    {
+        history_refs_t composed = { NULL, 0 };
+        res = compose_deltas(decodes + 1, n - 1, &composed);
+        if (res == SUCCESS)
+        {
+            res = apply_deltas(&decodes[0].records, decodes + 1, &composed, table);
+            free(composed.refs);
+        }
+    }
+    else if (res == SUCCESS)
+    {
+        *table = decodes[0].records.table;
+        free(decodes[0].records.ops);
+        decodes[0].result = ERROR;
+    }
+    for (i = 0; i < n; ++i)
+    {
+        if (decodes[i].result == SUCCESS)
+            records_destroy(&decodes[i].records);
+    }
+    free(decodes);
+    return res;
+}
+
+/**
+ * @brief branch_dir_path   builds the directory path of a branch archive
+ * @param path              buffer of PATH_MAX bytes
+ * @param dir               archive directory
+ * @param pack_name         branch name
+ * @return                  SUCCESS on success, ERROR on invalid name or too long path
+ */
+static int branch_dir_path(char *path, const char *dir, const char *pack_name)
+{
+    if (!dir || !dir[0] || !pack_name || !pack_name[0] || strchr(pack_name, '/') ||
+        strchr(pack_name, HISTORY_DATE_SEPARATOR) || pack_name[0] == '.')
+    {
+        printf("History: invalid archive directory or branch name\n");
+        return ERROR;
+    }
+    if (snprintf(path, PATH_MAX, "%s/%s", dir, pack_name) >= PATH_MAX)
+    {
+        printf("History: too long path of branch \"%s\"\n", pack_name);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+int pcompare_history_add(const char *dir, const pcompare_branch_t *branch, const char *date)
+{
+    char branch_dir[PATH_MAX], path[PATH_MAX];
+    history_file_t *files;
+    size_t n_files, i;
+
+    if (!branch || !date || !is_date(date, strlen(date)) ||
+        branch_dir_path(branch_dir, dir, pcompare_branch_name(branch)) != SUCCESS)
+    {
+        printf("pcompare_history_add: invalid input parameter!\n");
+        return ERROR;
+    }
+    if ((mkdir(dir, 0755) != 0 && errno != EEXIST) || (mkdir(branch_dir, 0755) != 0 && errno != EEXIST))
+    {
+        printf("Could not create history directory \"%s\": %s\n", branch_dir, strerror(errno));
+        return ERROR;
+    }
+    if (list_files(branch_dir, &files, &n_files) != SUCCESS)
+        return ERROR;
+    if (n_files && strcmp(files[n_files - 1].date, date) >= 0)
+    {
+        printf("Snapshot of \"%s\" on %s is not later than the last archived one of %s\n",
+               pcompare_branch_name(branch), date, files[n_files - 1].date);
+        free(files);
+        return ERROR;
+    }
+
+    /* A checkpoint starts the history and follows every HISTORY_CHECKPOINT_INTERVAL deltas */
+    size_t n_deltas = 0;
+    for (i = n_files; i && !files[i - 1].full; --i)
+        ++n_deltas;
+    const branch_table_t *table = branch_get_table(branch);
+    history_records_t records = { *table, NULL };
+    history_records_t delta;
+    int full = !n_files || n_deltas >= HISTORY_CHECKPOINT_INTERVAL;
+    int res = SUCCESS;
+    if (!full)
+    {
+        branch_table_t prev;
+        res = load_snapshot(branch_dir, files, n_files - 1, &prev);
+        if (res == SUCCESS)
+        {
+            res = make_delta(&prev, table, &delta);
+            branch_table_destroy(&prev);
+        }
+        /* A delta of most of the packages is not smaller than a checkpoint */
+        if (res == SUCCESS && delta.table.n_records * 2 > table->n_records)
+        {
+            records_destroy(&delta);
+            full = 1;
+        }
+        else if (res == SUCCESS)
+        {
+            records = delta;
+        }
+    }
+    free(files);
+    if (res != SUCCESS)
+        return ERROR;
+
+    history_buffer_t buffer = { NULL, 0, 0, SUCCESS };
+    history_file_t file = { "", full };
+    memcpy(file.date, date, HISTORY_DATE_LEN + 1);
+    res = encode_records(&records, &buffer);
+    if (res == SUCCESS && file_path(path, branch_dir, &file) != SUCCESS)
+        res = ERROR;
+    if (res == SUCCESS)
+        res = write_file(path, buffer.data, buffer.size);
+    if (res == SUCCESS)
+        printf("Snapshot of \"%s\" on %s is archived as a %s of %lu packages (%lu bytes)\n",
+               pcompare_branch_name(branch), date, full ? "checkpoint" : "delta", records.table.n_records, buffer.size);
+    if (!full)
+        records_destroy(&delta);
+    free(buffer.data);
+    return res;
+}
+
+pcompare_branch_t *pcompare_history_open(const char *dir, const char *pack_name, const char *date)
+{
+    char branch_dir[PATH_MAX], name[PATH_MAX];
+    history_file_t *files;
+    size_t n_files;
+
+    if ((date && !is_date(date, strlen(date))) || branch_dir_path(branch_dir, dir, pack_name) != SUCCESS)
+    {
+        printf("pcompare_history_open: invalid input parameter!\n");
+        return NULL;
+    }
+    if (list_files(branch_dir, &files, &n_files) != SUCCESS)
+        return NULL;
+
+    /* The snapshot of a date is the last one archived on or before it */
+    size_t last = n_files;
+    while (last && date && strcmp(files[last - 1].date, date) > 0)
+        --last;
+    if (!last)
+    {
+        if (date)
+            printf("No snapshot of \"%s\" on or before %s in \"%s\"\n", pack_name, date, dir);
+        else
+            printf("No snapshot of \"%s\" in \"%s\"\n", pack_name, dir);
+        free(files);
+        return NULL;
+    }
+    --last;
+    snprintf(name, sizeof(name), "%s%c%s", pack_name, HISTORY_DATE_SEPARATOR, date ? date : files[last].date);
+
+    branch_table_t table;
+    printf("Reconstructing \"%s\" from the snapshot of %s...\n", name, files[last].date);
+    const int res = load_snapshot(branch_dir, files, last, &table);
+    free(files);
+    if (res != SUCCESS)
+        return NULL;
+    return branch_from_table(name, &table);
+}
@@ -0,0 +1,719 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Projecting JSON scanner with SIMD structural index
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "pcompare.h"
+#include "json_scan.h"
+
+#define SCAN_BLOCK              64              // bytes per bitmask
+#define SCAN_WINDOW             (64 * 1024)     // bytes indexed by one stage 1 pass (multiple of SCAN_BLOCK)
+#define MAX_PROJECTED_KEYS      8
+#define EVEN_BITS               0x5555555555555555ULL
+
+//bitmasks of one input block
+typedef struct
+{
+    uint64_t quote;         //'"' characters
+    uint64_t backslash;     //'\' characters
+    uint64_t structural;    //'{', '}', '[', ']', ':' and ',' characters
+}block_masks_t;
+
+typedef void (*block_masks_fn)(const unsigned char *block, block_masks_t *masks);
+
+//scanner state
+typedef struct
+{
+    const char      *data;                          //JSON text
+    size_t          size;                           //JSON text size
+    size_t          next_block;                     //position of the next block to index
+    uint64_t        prev_escaped;                   //first character of the next block is escaped
+    uint64_t        prev_in_string;                 //all ones if the previous block ended inside a string
+    block_masks_fn  block_masks;                    //bitmasks implementation
+    size_t          *index;                         //structural positions of the current window
+    size_t          n_index;                        //number of positions in the index
+    size_t          cur;                            //current position in the index
+    char            *scratch[MAX_PROJECTED_KEYS];   //buffers for unescaped values
+    size_t          scratch_size[MAX_PROJECTED_KEYS];
+}scanner_t;
+
+//projection parameters
+typedef struct
+{
+    const char          **keys;         //keys to project
+    size_t              *key_lens;      //their lengths
+    size_t              n_keys;         //number of keys
+    json_scan_record_cb cb;             //callback
+    void                *ctx;           //callback context
+}projection_t;
+
+/**
+ * @brief block_masks_scalar    scalar bitmasks calculation
+ * @param b                     pointer to SCAN_BLOCK bytes
+ * @param m                     pointer to store bitmasks
+ */
+static void block_masks_scalar(const unsigned char *b, block_masks_t *m)
+{
+    uint64_t quote = 0, backslash = 0, structural = 0;
+    for (int i = 0; i < SCAN_BLOCK; ++i)
+    {
+        const uint64_t bit = 1ULL << i;
+        switch (b[i])
+        {
+            case '"':
+                quote |= bit;
+                break;
+            case '\\':
+                backslash |= bit;
+                break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                structural |= bit;
+                break;
+            default:
+                break;
+        }
+    }
+    m->quote = quote;
+    m->backslash = backslash;
+    m->structural = structural;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief block_masks_sse2  SSE2 bitmasks calculation (SSE2 is a part of x86_64 baseline)
+ * @param b                 pointer to SCAN_BLOCK bytes
+ * @param m                 pointer to store bitmasks
+ */
+static void block_masks_sse2(const unsigned char *b, block_masks_t *m)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i lbrace = _mm_set1_epi8('{');
+    const __m128i rbrace = _mm_set1_epi8('}');
+    const __m128i lbracket = _mm_set1_epi8('[');
+    const __m128i rbracket = _mm_set1_epi8(']');
+
+    m->quote = m->backslash = m->structural = 0;
+    for (int i = 0; i < SCAN_BLOCK / 16; ++i)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(b + 16 * i));
+        __m128i s = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)),
+                                 _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lbrace), _mm_cmpeq_epi8(v, rbrace)),
+                                              _mm_or_si128(_mm_cmpeq_epi8(v, lbracket), _mm_cmpeq_epi8(v, rbracket))));
+        m->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << (16 * i);
+        m->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << (16 * i);
+        m->structural |= (uint64_t)(uint16_t)_mm_movemask_epi8(s) << (16 * i);
+    }
+}
+
+/**
+ * @brief block_masks_avx2  AVX2 bitmasks calculation
+ * @param b                 pointer to SCAN_BLOCK bytes
+ * @param m                 pointer to store bitmasks
+ */
+__attribute__((target("avx2")))
+static void block_masks_avx2(const unsigned char *b, block_masks_t *m)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i lbrace = _mm256_set1_epi8('{');
+    const __m256i rbrace = _mm256_set1_epi8('}');
+    const __m256i lbracket = _mm256_set1_epi8('[');
+    const __m256i rbracket = _mm256_set1_epi8(']');
+
+    m->quote = m->backslash = m->structural = 0;
+    for (int i = 0; i < SCAN_BLOCK / 32; ++i)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(b + 32 * i));
+        __m256i s = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)),
+                                    _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, lbrace), _mm256_cmpeq_epi8(v, rbrace)),
+                                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, lbracket), _mm256_cmpeq_epi8(v, rbracket))));
+        m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << (32 * i);
+        m->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << (32 * i);
+        m->structural |= (uint64_t)(uint32_t)_mm256_movemask_epi8(s) << (32 * i);
+    }
+}
+#endif
+
+/**
+ * @brief choose_block_masks    chooses the best bitmasks implementation for the CPU
+ * @param name                  pointer to store the implementation name, may be NULL
+ * @return                      bitmasks function
+ */
+static block_masks_fn choose_block_masks(const char **name)
+{
+    const char *impl = "scalar";
+    block_masks_fn fn = block_masks_scalar;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        impl = "avx2";
+        fn = block_masks_avx2;
+    }
+    else
+    {
+        impl = "sse2";
+        fn = block_masks_sse2;
+    }
+#endif
+    if (name) *name = impl;
+    return fn;
+}
+
+const char *json_scan_impl(void)
+{
+    const char *name;
+    choose_block_masks(&name);
+    return name;
+}
+
+/**
+ * @brief find_escaped  finds characters escaped by backslashes (odd length backslash sequences)
+ * @param s             pointer to a scanner_t structure, keeps the carry between blocks
+ * @param backslash     backslashes bitmask
+ * @return              bitmask of escaped characters
+ */
+static inline uint64_t find_escaped(scanner_t *s, uint64_t backslash)
+{
+    backslash &= ~s->prev_escaped;
+    const uint64_t follows_escape = (backslash << 1) | s->prev_escaped;
+    const uint64_t odd_sequence_starts = backslash & ~EVEN_BITS & ~follows_escape;
+    uint64_t sequences_starting_on_even_bits;
+    s->prev_escaped = __builtin_add_overflow(odd_sequence_starts, backslash, &sequences_starting_on_even_bits);
+    const uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+    return (EVEN_BITS ^ invert_mask) & follows_escape;
+}
+
+/**
+ * @brief prefix_xor    bit i of the result is xor of bits 0..i of the argument
+ * @param x             bitmask
+ * @return              prefix xor bitmask
+ */
+static inline uint64_t prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/**
+ * @brief index_window  stage 1: builds structural index of the next SCAN_WINDOW bytes
+ * @param s             pointer to a scanner_t structure
+ */
+static void index_window(scanner_t *s)
+{
+    size_t end = s->next_block + SCAN_WINDOW;
+    if (end > s->size) end = s->size;
+    s->n_index = 0;
+    s->cur = 0;
+
+    for (; s->next_block < end; s->next_block += SCAN_BLOCK)
+    {
+        const unsigned char *block = (const unsigned char *)s->data + s->next_block;
+        unsigned char tail[SCAN_BLOCK];
+        block_masks_t m;
+
+        if (s->size - s->next_block < SCAN_BLOCK)
+        {
+            memset(tail, ' ', SCAN_BLOCK);
+            memcpy(tail, block, s->size - s->next_block);
+            block = tail;
+        }
+        s->block_masks(block, &m);
+
+        const uint64_t quote = m.quote & ~find_escaped(s, m.backslash);
+        const uint64_t in_string = prefix_xor(quote) ^ s->prev_in_string;
+        s->prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+        uint64_t structural = (m.structural & ~in_string) | quote;
+
+        while (structural)
+        {
+            s->index[s->n_index++] = s->next_block + __builtin_ctzll(structural);
+            structural &= structural - 1;
+        }
+    }
+}
+
+/**
+ * @brief peek_token    returns position of the next structural character without consuming it
+ * @param s             pointer to a scanner_t structure
+ * @param pos           pointer to store the position
+ * @return              1 on success, 0 at the end of input
+ */
+static inline int peek_token(scanner_t *s, size_t *pos)
+{
+    while (s->cur == s->n_index)
+    {
+        if (s->next_block >= s->size) return 0;
+        index_window(s);
+    }
+    *pos = s->index[s->cur];
+    return 1;
+}
+
+/**
+ * @brief next_token    consumes the next structural character
+ * @param s             pointer to a scanner_t structure
+ * @param pos           pointer to store the position
+ * @return              1 on success, 0 at the end of input
+ */
+static inline int next_token(scanner_t *s, size_t *pos)
+{
+    if (!peek_token(s, pos)) return 0;
+    ++s->cur;
+    return 1;
+}
+
+/**
+ * @brief scan_error    prints scanning error
+ * @param s             pointer to a scanner_t structure
+ * @param pos           error position
+ * @param what          error description
+ * @return              ERROR
+ */
+static int scan_error(const scanner_t *s, const size_t pos, const char *what)
+{
+    if (pos < s->size)
+        printf("JSON error at offset %lu (near '%c'): %s\n", pos, s->data[pos], what);
+    else
+        printf("JSON error: unexpected end of input, %s\n", what);
+    return ERROR;
+}
+
+/**
+ * @brief expect_token  consumes the next structural character and checks it
+ * @param s             pointer to a scanner_t structure
+ * @param c             expected character
+ * @param pos           pointer to store the position
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static inline int expect_token(scanner_t *s, const char c, size_t *pos)
+{
+    if (!next_token(s, pos))
+    {
+        *pos = s->size;
+        return scan_error(s, *pos, "structural character expected");
+    }
+    if (s->data[*pos] != c)
+        return scan_error(s, *pos, "unexpected structural character");
+    return SUCCESS;
+}
+
+/**
+ * @brief read_string   consumes opening and closing quotes of a string
+ * @param s             pointer to a scanner_t structure
+ * @param start         pointer to store position of the first string character
+ * @param len           pointer to store string length (escaped)
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static inline int read_string(scanner_t *s, size_t *start, size_t *len)
+{
+    size_t open, close;
+    if (expect_token(s, '"', &open) != SUCCESS) return ERROR;
+    if (expect_token(s, '"', &close) != SUCCESS) return ERROR;
+    *start = open + 1;
+    *len = close - open - 1;
+    return SUCCESS;
+}
+
+/**
+ * @brief value_start   finds the first character of a value
+ * @param s             pointer to a scanner_t structure
+ * @param after         position of the ':', '[' or ',' before the value
+ * @return              position of the value
+ */
+static inline size_t value_start(const scanner_t *s, size_t after)
+{
+    size_t pos = after + 1;
+    while (pos < s->size && (s->data[pos] == ' ' || s->data[pos] == '\n' || s->data[pos] == '\r' || s->data[pos] == '\t'))
+        ++pos;
+    return pos;
+}
+
+/**
+ * @brief skip_nested   skips an object or an array which opening character is already consumed
+ * @param s             pointer to a scanner_t structure
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int skip_nested(scanner_t *s)
+{
+    size_t depth = 1, pos = s->size;
+    while (depth)
+    {
+        if (!next_token(s, &pos))
+            return scan_error(s, s->size, "unterminated object or array");
+        switch (s->data[pos])
+        {
+            case '{': case '[':
+                ++depth;
+                break;
+            case '}': case ']':
+                --depth;
+                break;
+            default:
+                break;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief skip_value    skips a value of any type
+ * @param s             pointer to a scanner_t structure
+ * @param after         position of the structural character before the value
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int skip_value(scanner_t *s, const size_t after)
+{
+    size_t pos = value_start(s, after), start, len;
+    if (pos >= s->size)
+        return scan_error(s, pos, "value expected");
+    switch (s->data[pos])
+    {
+        case '"':
+            return read_string(s, &start, &len);
+        case '{': case '[':
+            next_token(s, &pos);
+            return skip_nested(s);
+        default:    //number, true, false or null: no structural characters inside
+            return SUCCESS;
+    }
+}
+
+/**
+ * @brief append_utf8   encodes a code point in UTF-8
+ * @param out           pointer to the output buffer
+ * @param cp            code point
+ * @return              number of written bytes
+ */
+static size_t append_utf8(char *out, const uint32_t cp)
+{
+    if (cp < 0x80)
+    {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800)
+    {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/**
+ * @brief parse_hex4    parses 4 hexadecimal digits of \\u escape sequence
+ * @param p             pointer to the digits
+ * @param cp            pointer to store the value
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int parse_hex4(const char *p, uint32_t *cp)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return ERROR;
+    }
+    *cp = v;
+    return SUCCESS;
+}
+
+/**
+ * @brief unescape_string   unescapes a string value to the scanner buffer
+ * @param s                 pointer to a scanner_t structure
+ * @param k                 projected key index (buffer index)
+ * @param start             position of the first string character
+ * @param len               escaped string length
+ * @param field             pointer to store the unescaped value
+ * @return                  SUCCESS on success, ERROR otherwise
+ */
+static int unescape_string(scanner_t *s, const size_t k, const size_t start, const size_t len, json_field_t *field)
+{
+    if (s->scratch_size[k] < len + 1)
+    {
+        char *buf = realloc(s->scratch[k], len + 1);
+        if (!buf)
+        {
+            printf("JSON scanner: memory allocation error\n");
+            return ERROR;
+        }
+        s->scratch[k] = buf;
+        s->scratch_size[k] = len + 1;
+    }
+    const char *src = s->data + start;
+    const char *end = src + len;
+    char *out = s->scratch[k];
+    while (src < end)
+    {
+        if (*src != '\\')
+        {
+            *out++ = *src++;
+            continue;
+        }
+        if (++src >= end) return scan_error(s, start, "invalid escape sequence");
+        switch (*src++)
+        {
+            case '"':  *out++ = '"';  break;
+            case '\\': *out++ = '\\'; break;
+            case '/':  *out++ = '/';  break;
+            case 'b':  *out++ = '\b'; break;
+            case 'f':  *out++ = '\f'; break;
+            case 'n':  *out++ = '\n'; break;
+            case 'r':  *out++ = '\r'; break;
+            case 't':  *out++ = '\t'; break;
+            case 'u':
+            {
+                uint32_t cp, low;
+                if ((end - src < 4) || parse_hex4(src, &cp) != SUCCESS)
+                    return scan_error(s, start, "invalid \\u escape sequence");
+                src += 4;
+                if (cp >= 0xD800 && cp < 0xDC00)    //surrogate pair, "\uXXXX" (6 bytes) is encoded to 4 bytes
+                {
+                    if ((end - src < 6) || src[0] != '\\' || src[1] != 'u' ||
+                        parse_hex4(src + 2, &low) != SUCCESS || low < 0xDC00 || low > 0xDFFF)
+                        return scan_error(s, start, "invalid surrogate pair");
+                    src += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                out += append_utf8(out, cp);
+                break;
+            }
+            default:
+                return scan_error(s, start, "invalid escape sequence");
+        }
+    }
+    *out = 0;
+    field->str = s->scratch[k];
+    field->len = out - s->scratch[k];
+    return SUCCESS;
+}
+
+/**
+ * @brief find_key  finds projected key index
+ * @param proj      pointer to a projection_t structure
+ * @param key       key text
+ * @param len       key length
+ * @return          key index, n_keys if the key is not projected
+ */
+static inline size_t find_key(const projection_t *proj, const char *key, const size_t len)
+{
+    size_t k = 0;
+    for (; k < proj->n_keys; ++k)
+    {
+        if (proj->key_lens[k] == len && !memcmp(proj->keys[k], key, len))
+            break;
+    }
+    return k;
+}
+
+/**
+ * @brief scan_object   extracts projected fields of an object which '{' is already consumed
+ * @param s             pointer to a scanner_t structure
+ * @param proj          pointer to a projection_t structure
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int scan_object(scanner_t *s, const projection_t *proj)
+{
+    json_field_t fields[MAX_PROJECTED_KEYS];
+    size_t pos, start, len;
+
+    for (size_t k = 0; k < proj->n_keys; ++k)
+        fields[k].str = NULL;
+
+    if (peek_token(s, &pos) && s->data[pos] == '}')
+    {
+        ++s->cur;
+        return proj->cb(proj->ctx, fields);
+    }
+    while (1)
+    {
+        if (read_string(s, &start, &len) != SUCCESS) return ERROR;
+        const size_t k = find_key(proj, s->data + start, len);
+        if (expect_token(s, ':', &pos) != SUCCESS) return ERROR;
+
+        if (k == proj->n_keys)
+        {
+            if (skip_value(s, pos) != SUCCESS) return ERROR;
+        }
+        else
+        {
+            size_t vpos = value_start(s, pos);
+            if (vpos >= s->size) return scan_error(s, vpos, "value expected");
+            switch (s->data[vpos])
+            {
+                case '"':
+                    if (read_string(s, &start, &len) != SUCCESS) return ERROR;
+                    if (memchr(s->data + start, '\\', len))
+                    {
+                        if (unescape_string(s, k, start, len, &fields[k]) != SUCCESS) return ERROR;
+                    }
+                    else
+                    {
+                        fields[k].str = s->data + start;
+                        fields[k].len = len;
+                    }
+                    break;
+                case '{': case '[':
+                    return scan_error(s, vpos, "scalar value expected");
+                default:    //raw scalar text up to the next structural character
+                    if (!peek_token(s, &pos)) return scan_error(s, s->size, "unterminated object");
+                    while (pos > vpos && (s->data[pos - 1] == ' ' || s->data[pos - 1] == '\n' ||
+                                          s->data[pos - 1] == '\r' || s->data[pos - 1] == '\t'))
+                        --pos;
+                    fields[k].str = s->data + vpos;
+                    fields[k].len = pos - vpos;
+                    break;
+            }
+        }
+
+        if (!next_token(s, &pos)) return scan_error(s, s->size, "unterminated object");
+        if (s->data[pos] == '}') break;
+        if (s->data[pos] != ',') return scan_error(s, pos, "',' or '}' expected");
+    }
+    return proj->cb(proj->ctx, fields);
+}
+
+/**
+ * @brief scan_array    scans array of objects
+ * @param s             pointer to a scanner_t structure
+ * @param after         position of ':' before the array
+ * @param proj          pointer to a projection_t structure
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int scan_array(scanner_t *s, const size_t after, const projection_t *proj)
+{
+    size_t pos = value_start(s, after);
+    if (pos >= s->size || s->data[pos] != '[')
+        return scan_error(s, pos, "array expected");
+    next_token(s, &pos);
+
+    if (peek_token(s, &pos) && s->data[pos] == ']')
+    {
+        ++s->cur;
+        return SUCCESS;
+    }
+    while (1)
+    {
+        if (expect_token(s, '{', &pos) != SUCCESS) return ERROR;
+        if (scan_object(s, proj) != SUCCESS) return ERROR;
+        if (!next_token(s, &pos)) return scan_error(s, s->size, "unterminated array");
+        if (s->data[pos] == ']') break;
+        if (s->data[pos] != ',') return scan_error(s, pos, "',' or ']' expected");
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief scan_document scans top-level object and the projected array
+ * @param s             pointer to a scanner_t structure
+ * @param array_key     key of the array to scan
+ * @param proj          pointer to a projection_t structure
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int scan_document(scanner_t *s, const char *array_key, const projection_t *proj)
+{
+    const size_t array_key_len = strlen(array_key);
+    size_t pos, start, len;
+    int found = 0;
+
+    if (expect_token(s, '{', &pos) != SUCCESS) return ERROR;
+    if (peek_token(s, &pos) && s->data[pos] == '}')
+    {
+        ++s->cur;
+    }
+    else
+    {
+        while (1)
+        {
+            if (read_string(s, &start, &len) != SUCCESS) return ERROR;
+            const int is_array_key = (len == array_key_len) && !memcmp(s->data + start, array_key, len);
+            if (expect_token(s, ':', &pos) != SUCCESS) return ERROR;
+            if (is_array_key)
+            {
+                if (scan_array(s, pos, proj) != SUCCESS) return ERROR;
+                found = 1;
+            }
+            else if (skip_value(s, pos) != SUCCESS)
+            {
+                return ERROR;
+            }
+            if (!next_token(s, &pos)) return scan_error(s, s->size, "unterminated document");
+            if (s->data[pos] == '}') break;
+            if (s->data[pos] != ',') return scan_error(s, pos, "',' or '}' expected");
+        }
+    }
+    if (next_token(s, &pos))
+        return scan_error(s, pos, "unexpected data after the document");
+    if (!found)
+    {
+        printf("Couldn't find \"%s\" array!\n", array_key);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+int json_scan_array(const char *data, const size_t size, const char *array_key,
+                    const char **keys, const size_t n_keys, json_scan_record_cb cb, void *ctx)
+{
+    if (!data || !array_key || !keys || !cb || n_keys > MAX_PROJECTED_KEYS)
+    {
+        printf("json_scan_array: invalid input parameter!\n");
+        return ERROR;
+    }
+
+    size_t key_lens[MAX_PROJECTED_KEYS];
+    for (size_t k = 0; k < n_keys; ++k)
+        key_lens[k] = strlen(keys[k]);
+    projection_t proj = { keys, key_lens, n_keys, cb, ctx };
+
+    scanner_t s;
+    memset(&s, 0, sizeof(s));
+    s.data = data;
+    s.size = size;
+    s.block_masks = choose_block_masks(NULL);
+    s.index = malloc(SCAN_WINDOW * sizeof(size_t));
+    if (!s.index)
+    {
+        printf("JSON scanner: memory allocation error\n");
+        return ERROR;
+    }
+
+    int res = scan_document(&s, array_key, &proj);
+
+    for (size_t k = 0; k < MAX_PROJECTED_KEYS; ++k)
+        free(s.scratch[k]);
+    free(s.index);
+    return res;
+}
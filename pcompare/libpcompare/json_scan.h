@@ -0,0 +1,50 @@
+#ifndef __JSON_SCAN_H_
+#define __JSON_SCAN_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Projecting JSON scanner of the libpcompare library.
+ * The scanner works in two stages (the way simdjson does):
+ * 1. builds a structural index (positions of unescaped quotes and of { } [ ] : , outside strings)
+ *    for a window of the input using AVX2/SSE2 (or scalar) bitmasks;
+ * 2. walks the index, finds an array of objects under the given top-level key,
+ *    extracts only the projected keys of each object and jumps over all other values.
+ */
+
+#include <stddef.h>
+
+//projected field value
+typedef struct
+{
+    const char  *str;   //value (string without quotes, unescaped) or raw scalar text
+    size_t      len;    //value length
+}json_field_t;
+
+/**
+ * Callback that receives projected fields of one array element.
+ * fields[i] corresponds to keys[i], missing fields have NULL str.
+ * Values point to the input or to the scanner buffers and are valid during the call only.
+ * Should return SUCCESS to continue scanning, ERROR to stop it.
+ */
+typedef int (*json_scan_record_cb)(void *ctx, const json_field_t *fields);
+
+/**
+ * @brief json_scan_array   scans JSON document and calls the callback for every object of a top-level array
+ * @param data              pointer to JSON text (does not need to be zero terminated)
+ * @param size              JSON text size
+ * @param array_key         top-level key of the array to scan
+ * @param keys              keys to project from the array objects
+ * @param n_keys            number of keys
+ * @param cb                callback to call for every array object
+ * @param ctx               callback context
+ * @return                  SUCCESS on success, ERROR on invalid document or if the callback stopped scanning
+ */
+int json_scan_array(const char *data, const size_t size, const char *array_key,
+                    const char **keys, const size_t n_keys, json_scan_record_cb cb, void *ctx);
+
+/**
+ * @brief json_scan_impl    returns name of the structural index implementation chosen for the CPU
+ * @return                  "avx2", "sse2" or "scalar"
+ */
+const char *json_scan_impl(void);
+
+#endif //__JSON_SCAN_H_
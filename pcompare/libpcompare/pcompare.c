@@ -7,17 +7,29 @@
  * 3. All packages in first branch with newer version then in second one
  */
 #include <stdio.h>
-#include <json-c/json.h>
+#include <stdlib.h>
+#include <limits.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <string.h>
-#include <pthread.h>
-#include <curl/curl.h>
 #include <errno.h>
+#include <pthread.h>
 #include "rpmvercmp.h"
 #include "pcompare.h"
+#include "thread_pool.h"
+#include "json_scan.h"
+#include "branch_table.h"
+#include "branch_index.h"
+#include "branch_digest.h"
+#include "report.h"
+#include "ext_compare.h"
+#include "download.h"
+#include "compare.h"
+#include "sha256.h"
+#include "result_cache.h"
 
 #define PACKAGE_URL "https://rdb.altlinux.org/api/export/branch_binary_packages/"
 #define PACKAGE1                        "p9"
@@ -27,16 +39,37 @@
 #define MAX_VERSION_LEN                 128
 #define MAX_FILE_NAME_LEN               128
 #define MAX_COMMAND_LEN                 256
-#define HEADER_STR_LEN                  64
 #define N_BRANCHES_TO_CHECK_VERSION     1       // number of branches to check
 #define BRANCH_TO_CHECK_VERSION         0       // branch number to check newer wersion
-#define N_OUT_PARAMS                    3       // number of package's parameters to output
+#define N_REPORT_ARRAYS                 (N_BRANCHES_TO_COMPARE_SUPPORTED + N_BRANCHES_TO_CHECK_VERSION)
+#define REPORT_CHUNK_PACKAGES           4096    // packages of a report array formatted by one task
+#define MERGE_PREFETCH_DISTANCE         16      // records of a branch prefetched ahead of the merge
+#define REPORT_IOV_MAX                  1024    // segments per writev call (Linux IOV_MAX)
+
+static const pcompare_options_t default_options = { NULL, 0, NULL, 0, 0 };
 
 const char *ARCH_TAG     = "arch";
 const char *NAME_TAG     = "name";
 const char *VERSION_TAG  = "version";
 const char *PACKAGES_TAG = "packages";
 
+//counters of the report arrays packages of one architecture
+typedef struct
+{
+    const char  *arch;                      //architecture (a string of a compared table)
+    size_t      arch_len;                   //architecture length
+    size_t      counts[N_REPORT_ARRAYS];    //packages of every report array
+}arch_summary_t;
+
+//summary of a comparison: per-architecture counters instead of the report arrays
+typedef struct
+{
+    arch_summary_t  *archs;             //per-architecture counters
+    size_t          n_archs;            //number of architectures
+    size_t          archs_capacity;     //allocated number of architectures
+    int             result;             //SUCCESS, ERROR on a memory allocation error
+}branches_summary_t;
+
 //structure to store branches comparison statistic
 typedef struct
 {
@@ -45,30 +78,97 @@ typedef struct
     size_t index_couters[N_BRANCHES_TO_COMPARE_SUPPORTED];              //counters of absent packages
     size_t version_counter;                                             //counter of first packages with newer version value
     size_t n_branches;                                                  //number of branches to compare (for the release it 2)
+    const branch_table_t *tables;                                       //compared tables
+    branches_summary_t *summary;                                        //summary counters instead of the indexes, may be NULL
 }branches_statistic_t;
 
+//chunk of a report array formatted by a thread pool task
+typedef struct
+{
+    const branch_table_t *table;    //table of the packages
+    const size_t    *indexes;       //indexes of the chunk packages in the table
+    size_t          count;          //number of the chunk packages
+    int             first;          //1 for the first chunk of an array (no leading separator)
+    int             last;           //1 for the last chunk of an array (trailing new line)
+    char            *text;          //formatted chunk, NULL on error
+    size_t          size;           //formatted chunk size
+}report_chunk_t;
+
 //structure to pass parameters
 typedef struct
 {
     const f_param_t *file_parameters;   //pointer to f_param_t structure
-    json_object     *json_wrapper;      //pointer to main JSON-file structure
+    branch_table_t  *table;             //pointer to a table to fill
+    int             result;             //parsing result
 }parse_parameter_t;
 
-// structure to store JSON packets array information
+//identity of a branch file
 typedef struct
 {
-    json_object *packages_array;        //pointer to an array of packets info
-    size_t      packages_array_length;  //the array length
-}json_packages_t;
+    dev_t           dev;            //device of the file
+    ino_t           ino;            //inode of the file
+    off_t           size;           //file size
+    struct timespec mtime;          //file modification time
+}file_id_t;
+
+//parsed branch with the point-query index
+struct pcompare_branch
+{
+    char            *pack_name;     //package branch name
+    branch_table_t  table;          //sorted packages table
+    branch_index_t  index;          //name lookup index
+    file_id_t       file_id;        //identity of the parsed file of a registered branch
+    size_t          refs;           //number of references (under registry lock)
+    int             loading;        //1 while a registered branch is parsed
+    int             failed;         //1 if parsing of a registered branch failed
+    int             registered;     //1 if the branch is in the registry
+    struct pcompare_branch *next;   //next registered branch
+};
+
+//registry of the shared branches acquired by name and file identity
+static struct
+{
+    pthread_mutex_t     lock;
+    pthread_cond_t      loaded;     //signalled when a branch loading is finished
+    pcompare_branch_t   *branches;  //registered branches
+}registry = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL };
 
-//Codes inicates of pacjages array scanning
-typedef enum
+//structure to pass a pair of branches to compare
+typedef struct
 {
-    GO_AHEAD = 0,
-    FIRST_FINISHED,
-    SECOND_FINISHED,
-    BOTH_FINISHED
-}continue_result_t;
+    f_param_t       fparam[N_BRANCHES_TO_COMPARE_SUPPORTED];    //compared branches
+    branch_table_t  tables[N_BRANCHES_TO_COMPARE_SUPPORTED];    //shallow copies of the branches' tables
+    const char      *out_dir;                                   //directory for a report file, NULL to report to memory
+    int             summary;                                    //1 to output counters of the report arrays only
+    char            *report;                                    //report in memory
+    size_t          report_size;                                //report size
+    int             result;                                     //comparison result
+}pair_parameter_t;
+
+/**
+ * @brief check_branches_names  validates branches' names
+ * @param fparam                pointer to an array of f_param_t structure
+ * @param count                 number of branches
+ * @return                      SUCCESS on valid parameters, ERROR otherwise
+ */
+static int check_branches_names(const f_param_t *fparam, const size_t count)
+{
+    if (!fparam || !count)
+    {
+        printf("Invalid input parameter!\n");
+        return ERROR;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!fparam[i].pack_name || !fparam[i].pack_name[0])
+        {
+            printf("Package name was not set!\n");
+            return ERROR;
+        }
+    }
+
+    return SUCCESS;
+}
 
 /**
  * @brief check_input_parameters    validates input parameters
@@ -76,29 +176,53 @@ typedef enum
  * @param count                     must be 2
  * @return                          SUCCESS on valid parameters, ERROR otherwise
  */
-static int check_input_parameters(f_param_t *fparam, const size_t count)
+static int check_input_parameters(const f_param_t *fparam, const size_t count)
 {
-    if (!fparam)
+    if (count != N_BRANCHES_TO_COMPARE_SUPPORTED)
     {
-        printf("Invalid input parameter!\n");
+        printf("We support 2 branches comparison only!\n");
         return ERROR;
     }
-    if (count != N_BRANCHES_TO_COMPARE_SUPPORTED)
+    return check_branches_names(fparam, count);
+}
+
+int pcompare_set_threads(const size_t n_threads)
+{
+    if (tpool_set_threads(n_threads) != SUCCESS)
     {
-        printf("We support 2 branches comparison only!\n");
+        printf("pcompare_set_threads: the thread pool is already started!\n");
         return ERROR;
     }
-    if (!fparam->pack_name)
+    return SUCCESS;
+}
+
+int check_options(const pcompare_options_t *options)
+{
+    if (!options)
+        return SUCCESS;
+    if (options->base_url && (!options->base_url[0] || strlen(options->base_url) + MAX_FILE_NAME_LEN >= MAX_COMMAND_LEN))
     {
-        printf("Package name was not set!\n");
+        printf("Invalid branches export URL!\n");
         return ERROR;
     }
-    if (!fparam->pack_name[0])
+    if (options->max_memory && options->max_memory < EXT_MIN_MEMORY)
     {
-        printf("Package name was not set!\n");
+        printf("Memory budget should be at least %d bytes!\n", EXT_MIN_MEMORY);
         return ERROR;
     }
-
+    if (options->cache_dir)
+    {
+        if (!options->cache_dir[0] || strlen(options->cache_dir) >= PATH_MAX - SHA256_HEX_SIZE - 16)
+        {
+            printf("Invalid reports cache directory!\n");
+            return ERROR;
+        }
+        if (mkdir(options->cache_dir, 0755) != 0 && errno != EEXIST)
+        {
+            printf("Could not create reports cache directory \"%s\": %s\n", options->cache_dir, strerror(errno));
+            return ERROR;
+        }
+    }
     return SUCCESS;
 }
 
@@ -166,80 +290,85 @@ static int map_file(f_param_t * fparam)
 }
 
 /**
- * @brief json_file_parse   JSON file parsing
- * @param param             pointer to a f_param_t structure
- * @return                  SUCCESS on success, ERROR otherwise
+ * @brief add_package   json_scan_array callback, appends projected package fields to a table
+ * @param ctx           pointer to a branch_table_t structure
+ * @param fields        name, version and arch fields
+ * @return              SUCCESS on success, ERROR otherwise
  */
-void * json_file_parse(void * param)
+static int add_package(void *ctx, const json_field_t *fields)
+{
+    const char *tags[N_OUT_PARAMS] = {NAME_TAG, VERSION_TAG, ARCH_TAG};
+    for (size_t k = 0; k < N_OUT_PARAMS; ++k)
+    {
+        if (!fields[k].str)
+        {
+            printf("Package without \"%s\" field!\n", tags[k]);
+            return ERROR;
+        }
+    }
+    return branch_table_add((branch_table_t *)ctx, fields[0].str, fields[0].len,
+                            fields[1].str, fields[1].len, fields[2].str, fields[2].len);
+}
+
+/**
+ * @brief json_file_parse   JSON file parsing task, extracts name, version and arch of packages to a table
+ * @param param             pointer to a parse_parameter_t structure
+ */
+static void json_file_parse(void * param)
 {
     parse_parameter_t *pparam = (parse_parameter_t*)param;
+    const f_param_t *fparam = pparam->file_parameters;
+    const char *tags[N_OUT_PARAMS] = {NAME_TAG, VERSION_TAG, ARCH_TAG};
 
-    printf("Parsing \"%s\" file...\n", pparam->file_parameters->pack_name);
+    printf("Parsing \"%s\" file...\n", fparam->pack_name);
 
-    pparam->json_wrapper = json_tokener_parse(pparam->file_parameters->fptr);
-    printf("\"%s\" file parsing finished.\n", pparam->file_parameters->pack_name);
+    pparam->result = branch_table_init(pparam->table, fparam->size);
+    if (pparam->result != SUCCESS) return;
+    pparam->result = json_scan_array(fparam->fptr, fparam->size, PACKAGES_TAG, tags, N_OUT_PARAMS,
+                                     add_package, pparam->table);
+    if ((pparam->result == SUCCESS) && !branch_table_is_sorted(pparam->table))
+    {
+        printf("Packages of \"%s\" are not sorted by name, sorting...\n", fparam->pack_name);
+        pparam->result = branch_table_sort(pparam->table);
+    }
+    if (pparam->result == SUCCESS)
+        pparam->result = branch_digest_build(pparam->table);
+    if (pparam->result != SUCCESS)
+    {
+        branch_table_destroy(pparam->table);
+        return;
+    }
+    printf("\"%s\" file parsing finished.\n", fparam->pack_name);
+}
 
-    return NULL;
+int branch_url(const char *pack_name, const pcompare_options_t *options, char *url, const size_t size)
+{
+    const char *base_url = (options && options->base_url) ? options->base_url : PACKAGE_URL;
+    if (snprintf(url, size, "%s/%s", base_url, pack_name) >= (int)size)
+        return ERROR;
+    return SUCCESS;
 }
 
 /**
  * @brief json_load loads branch information to a file
  * @param fparam    pointer to a f_param_t structure
+ * @param options   comparison options with the export URL, NULL for the defaults
  * @return          SUCCESS on success, ERROR otherwise
  */
-int json_load(const f_param_t *fparam)
+int json_load(const f_param_t *fparam, const pcompare_options_t *options)
 {
     char url[MAX_COMMAND_LEN];
     char fname[MAX_COMMAND_LEN];
 
-    sprintf(url,"%s/%s", PACKAGE_URL, fparam->pack_name);
-    sprintf(fname,"%s.json",fparam->pack_name);
-
-    FILE *f = fopen(fname,"wb");
-    if (!f)
+    if (branch_url(fparam->pack_name, options, url, sizeof(url)) != SUCCESS ||
+        snprintf(fname, sizeof(fname), "%s.json", fparam->pack_name) >= (int)sizeof(fname))
     {
-        printf("Could not open \"%s\"file to write\n", fname);
+        printf("Branch name \"%s\" is too long\n", fparam->pack_name);
         return ERROR;
     }
 
-    char curlErrorBuffer[CURL_ERROR_SIZE];
-    curl_global_init(CURL_GLOBAL_ALL);
-    CURL *curl = curl_easy_init();
-    if (!curl)
-    {
-        printf("Packet %s: CURL init error!\n", fparam->pack_name);
-        fclose(f);
+    if (download_file(url, fname, fparam->pack_name) != SUCCESS)
         return ERROR;
-    }
-    /* Error buffer definition */
-    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curlErrorBuffer);
-
-    /* URL download definition */
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-
-    /* Switch HTML header off */
-    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
-
-    /* Set file descriptor as a buffer to write */
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, f);
-
-    /* Switch show progress statistic on */
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-
-    /* Auto redirecting enable */
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-
-    printf("\nLoading packet \"%s\"...\n", fparam->pack_name);
-    CURLcode curlResult = curl_easy_perform(curl);
-
-    fclose(f);
-    curl_easy_cleanup(curl);
-
-    if (curlResult != CURLE_OK)
-    {
-        printf("Package \"%s\"Curl perfom error = %d. Error message:\"%s\"\n",fparam->pack_name, curlResult, curlErrorBuffer);
-        return ERROR;
-    }
     printf("\nPacket \"%s\" loading finished\n", fparam->pack_name);
 
     return SUCCESS;
@@ -247,11 +376,16 @@ int json_load(const f_param_t *fparam)
 
 int pcompare_load_files(f_param_t *fparam, const size_t n_branches)
 {
-    if (check_input_parameters(fparam, n_branches) != SUCCESS)
+    return pcompare_load_files_from(fparam, n_branches, NULL);
+}
+
+int pcompare_load_files_from(f_param_t *fparam, const size_t n_branches, const pcompare_options_t *options)
+{
+    if (check_branches_names(fparam, n_branches) != SUCCESS || check_options(options) != SUCCESS)
         return ERROR;
     for (size_t i=0; i < n_branches; ++i)
     {
-       int res = json_load(&fparam[i]);
+       int res = json_load(&fparam[i], options);
        if (res != SUCCESS)
        {
            pcompare_close_files(fparam, i);
@@ -263,14 +397,14 @@ int pcompare_load_files(f_param_t *fparam, const size_t n_branches)
 
 int pcompare_open_downloaded_files(f_param_t *fparam, const size_t n_branches)
 {
-    if (check_input_parameters(fparam, n_branches) != SUCCESS)
+    if (check_branches_names(fparam, n_branches) != SUCCESS)
         return ERROR;
     for (size_t i=0; i < n_branches; ++i)
     {
         int res = map_file(&fparam[i]);
         if (res != SUCCESS)
         {
-            printf("Mapping \"%s.json\" file error\n", fparam->pack_name);
+            printf("Mapping \"%s.json\" file error\n", fparam[i].pack_name);
             pcompare_close_files(fparam, i);
             return res;
         }
@@ -280,74 +414,36 @@ int pcompare_open_downloaded_files(f_param_t *fparam, const size_t n_branches)
 
 
 /**
- * @brief compare_tags  - compare 2 JSON strings values
- * @param iters         - pointer to an array of json objects
- * @param n_branches    - number of branches to compare, suppotred only for 2 branches
- * @param tag           - pointer to a tag string
- * @return              result of strcmp function
+ * @brief compare_names - compare names of 2 packages by the records prefix keys,
+ *                        the strings are compared only if 8 first bytes of the names are equal
+ * @param tables        - pointer to an array of branch tables
+ * @param counters      - packages' arrays current indexes positions
+ * @return              result of strcmp function sign
  */
-int compare_tags(json_object **iters, const size_t n_branches, const char *tag)
+static inline int compare_names(const branch_table_t *tables, const size_t *counters) //released compare for 2 branches only!
 {
-    json_object * tag_obj[n_branches];
-    for( size_t j = 0; j < n_branches; ++j)
-            tag_obj[j] = json_object_object_get(iters[j], tag);
-    const char * tag_val[n_branches];
-    for( size_t j = 0; j < n_branches; ++j)
-        tag_val[j] = json_object_get_string(tag_obj[j]);
-
-    int res = strcmp(tag_val[0], tag_val[1]); //released compare for 2 strings only!
-    return res;
+    const package_rec_t *a = &tables[0].records[counters[0]];
+    const package_rec_t *b = &tables[1].records[counters[1]];
+    if (a->name_prefix != b->name_prefix)
+        return (a->name_prefix > b->name_prefix) ? 1 : -1;
+    /* Names have no zero bytes: equal keys are equal names up to the key size, both names are at least that long */
+    if (a->name_len <= sizeof(a->name_prefix) && b->name_len <= sizeof(b->name_prefix))
+        return EQUAL;
+    return strcmp(branch_table_str(&tables[0], a->name) + sizeof(a->name_prefix),
+                  branch_table_str(&tables[1], b->name) + sizeof(b->name_prefix));
 }
 
 
 /**
- * @brief compare_versions  - compare 2 JSON versions' strings
- * @param iters             - pointer to an array of json objects
- * @param n_branches        - number of branches to compare, suppotred only for 2 branches
+ * @brief compare_versions  - compare versions of 2 packages
+ * @param tables            - pointer to an array of branch tables
+ * @param counters          - packages' arrays current indexes positions
  * @return                  value (<0) if first version is older, (>0) if newer and 0 if versions are equal
  */
-int compare_versions(json_object **iters, const size_t n_branches)
+static inline int compare_versions(const branch_table_t *tables, const size_t *counters)
 {
-
-    json_object * tag_obj[n_branches];
-    size_t j;
-    for(j = 0; j < n_branches; ++j)
-            tag_obj[j] = json_object_object_get(iters[j], VERSION_TAG);
-    const char * tag_val[n_branches];
-    for(j = 0; j < n_branches; ++j)
-    {
-        tag_val[j] = json_object_get_string(tag_obj[j]);
-    }
-    return rpmvercmp(tag_val[0], tag_val[1]);
-}
-
-/**
- * @brief next_position_depend_on_compare_result    shifts next position in packages array depending on compared packages' names result
- * @param res                                       comparison result
- * @param counters                                  pointer to an array of packages' arrays current indexes positions
- * @param packages_info                             pointer to an array of json_packages_t structures
- * @return                                          continue_result_t code
- */
-continue_result_t next_position_depend_on_compare_result(const int res, size_t *counters, const json_packages_t *packages_info)// limit for 2 branches only!
-{
-    continue_result_t cont_result = GO_AHEAD;
-    if (counters[0] >= (packages_info[0].packages_array_length - 1))
-    {
-        cont_result = FIRST_FINISHED;
-    }
-    else if (res <= 0)
-    {
-        ++counters[0];
-    }
-    if (counters[1] >= (packages_info[1].packages_array_length - 1))
-    {
-        cont_result |= SECOND_FINISHED;
-    }
-    else if (res >= 0)
-    {
-        ++counters[1];
-    }
-    return cont_result;
+    return rpmvercmp(branch_table_str(&tables[0], tables[0].records[counters[0]].version),
+                     branch_table_str(&tables[1], tables[1].records[counters[1]].version));
 }
 
 /**
@@ -367,15 +463,15 @@ void free_arrays_memory(size_t **arr, const size_t n_arrays)
 /**
  * @brief init_arrays   - allocates memory for arrays
  * @param arr           - array of pointers to arrays that wil be allocated
- * @param packages_info - array of json_packages_t structures
+ * @param lengths       - arrays' lengths
  * @param n_arrays      - number of array to initiate
  * @return              SUCCESS code on success, ERROR otherwise
  */
-int init_arrays(size_t **arr, const json_packages_t *packages_info, const size_t n_arrays)
+int init_arrays(size_t **arr, const size_t *lengths, const size_t n_arrays)
 {
     for (size_t i = 0; i < n_arrays; ++i)
     {
-        arr[i] = calloc(packages_info[i].packages_array_length, sizeof (size_t));
+        arr[i] = calloc(lengths[i] ? lengths[i] : 1, sizeof (size_t));
         if (!arr[i])
         {
             printf("init_arrays: Memory allocation error for %lu array\n", i);
@@ -399,20 +495,25 @@ void destroy_branch_statistic(branches_statistic_t *stat)
 /**
  * @brief init_branch_statistic     initiates btanches statistic structure and allocates memory for its arrays
  * @param stat                      pointer to branches_statistic_t structure
- * @param packages_info             pointer to an array of json_packages_t structures
+ * @param tables                    pointer to an array of branch tables
  * @param n_branches                number of branches to process
  * @return                      SUCCESS code on success, ERROR code otherwise
  */
-static int init_branch_statistic(branches_statistic_t *stat, const json_packages_t *packages_info, const size_t n_branches)
+static int init_branch_statistic(branches_statistic_t *stat, const branch_table_t *tables, const size_t n_branches)
 {
-
-    int res = init_arrays(stat->absent_packages_indexes, packages_info, n_branches);
+    size_t lengths[N_BRANCHES_TO_COMPARE_SUPPORTED];
+    for (size_t i = 0; i < n_branches; ++i)
+    {
+        lengths[i] = tables[i^1].n_records;     //packages absent in branch i are taken from the other one
+    }
+    int res = init_arrays(stat->absent_packages_indexes, lengths, n_branches);
     if (res!=SUCCESS) return res;
     for (size_t i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i )
     {
         stat->index_couters[i] = 0;
     }
-    res = init_arrays(stat->version_indexes, &packages_info[BRANCH_TO_CHECK_VERSION], N_BRANCHES_TO_CHECK_VERSION);
+    lengths[BRANCH_TO_CHECK_VERSION] = tables[BRANCH_TO_CHECK_VERSION].n_records;
+    res = init_arrays(stat->version_indexes, &lengths[BRANCH_TO_CHECK_VERSION], N_BRANCHES_TO_CHECK_VERSION);
     if (res!=SUCCESS)
     {
         free_arrays_memory(stat->absent_packages_indexes, n_branches);
@@ -420,27 +521,69 @@ static int init_branch_statistic(branches_statistic_t *stat, const json_packages
     }
     stat->version_counter = 0;
     stat->n_branches = n_branches;
+    stat->tables = tables;
+    stat->summary = NULL;
 
     return SUCCESS;
 }
 
 /**
- * @brief get_packages_info  gets information about packages arrays and their length
- * @param wrapper           pointer to a main JSON object
- * @param info              pointer to a json_packages_t structure
- * @return                  SUCCESS code on success, ERROR code otherwise
+ * @brief init_branch_summary   initiates btanches statistic structure to count packages without the indexes arrays
+ * @param stat                  pointer to branches_statistic_t structure
+ * @param summary               pointer to branches_summary_t structure to initiate
+ * @param tables                pointer to an array of branch tables
+ * @param n_branches            number of branches to process
  */
-static int get_packages_info(const json_object *wrapper, json_packages_t *info)
+static void init_branch_summary(branches_statistic_t *stat, branches_summary_t *summary,
+                                const branch_table_t *tables, const size_t n_branches)
 {
-    info->packages_array = json_object_object_get(wrapper, PACKAGES_TAG);
-    if (!info->packages_array)
+    memset(stat, 0, sizeof(branches_statistic_t));
+    memset(summary, 0, sizeof(branches_summary_t));
+    summary->result = SUCCESS;
+    stat->n_branches = n_branches;
+    stat->tables = tables;
+    stat->summary = summary;
+}
+
+/**
+ * @brief summary_add   counts a package of a report array by its architecture
+ * @param summary       pointer to branches_summary_t structure
+ * @param array         report array number
+ * @param table         pointer to the table of the package
+ * @param index         package index in the table
+ */
+static void summary_add(branches_summary_t *summary, const size_t array, const branch_table_t *table, const size_t index)
+{
+    const package_rec_t *rec = &table->records[index];
+    const char *arch = branch_table_str(table, rec->arch);
+    size_t i;
+
+    /* Branches have a few architectures, a linear search is enough */
+    for (i = 0; i < summary->n_archs; ++i)
     {
-        printf("Couln't find packages array!\n");
-        return ERROR;
+        if (summary->archs[i].arch_len == rec->arch_len && !memcmp(summary->archs[i].arch, arch, rec->arch_len))
+        {
+            ++summary->archs[i].counts[array];
+            return;
+        }
     }
-
-    info->packages_array_length = json_object_array_length(info->packages_array);
-    return SUCCESS;
+    if (summary->n_archs == summary->archs_capacity)
+    {
+        const size_t capacity = summary->archs_capacity ? 2 * summary->archs_capacity : 16;
+        arch_summary_t *archs = realloc(summary->archs, capacity * sizeof(arch_summary_t));
+        if (!archs)
+        {
+            summary->result = ERROR;
+            return;
+        }
+        summary->archs = archs;
+        summary->archs_capacity = capacity;
+    }
+    memset(&summary->archs[i], 0, sizeof(arch_summary_t));
+    summary->archs[i].arch = arch;
+    summary->archs[i].arch_len = rec->arch_len;
+    summary->archs[i].counts[array] = 1;
+    ++summary->n_archs;
 }
 
 /**
@@ -453,12 +596,18 @@ static void update_branches_statistic(branches_statistic_t *stat, const int res,
 {
     if (res < EQUAL)    //if package in first branch absent in second
     {
-        stat->absent_packages_indexes[1][stat->index_couters[1]] = counters[0];
+        if (stat->summary)
+            summary_add(stat->summary, 1, &stat->tables[0], counters[0]);
+        else
+            stat->absent_packages_indexes[1][stat->index_couters[1]] = counters[0];
         ++stat->index_couters[1];
         return;
     }
     //if package in second branch absent in first
-    stat->absent_packages_indexes[0][stat->index_couters[0]] = counters[1];
+    if (stat->summary)
+        summary_add(stat->summary, 0, &stat->tables[1], counters[1]);
+    else
+        stat->absent_packages_indexes[0][stat->index_couters[0]] = counters[1];
     ++stat->index_couters[0];
 }
 
@@ -471,185 +620,428 @@ static void update_branches_statistic(branches_statistic_t *stat, const int res,
 static void update_version_statistic(branches_statistic_t *stat, const int res, const size_t *counters)//NOTE: for 2 branches only and Version1 > Vesrion2 condition
 {
     if (res < EQUAL) return;    //we collect statistic for first branch package with newer version only
-    stat->version_indexes[BRANCH_TO_CHECK_VERSION][stat->version_counter] = counters[BRANCH_TO_CHECK_VERSION];
+    if (stat->summary)
+        summary_add(stat->summary, stat->n_branches + BRANCH_TO_CHECK_VERSION,
+                    &stat->tables[BRANCH_TO_CHECK_VERSION], counters[BRANCH_TO_CHECK_VERSION]);
+    else
+        stat->version_indexes[BRANCH_TO_CHECK_VERSION][stat->version_counter] = counters[BRANCH_TO_CHECK_VERSION];
     ++stat->version_counter;
 }
 
 /**
- * @brief get_branches_statistic    scans and compares branches' packages and store scanning statistic
- * @param packages_info             pointer to an array of packages_info structure
+ * @brief prefetch_records  prefetches records of the merge ahead and names of the nearer ones
+ * @param tables            pointer to an array of branch tables
+ * @param counters          packages' arrays current indexes positions
+ */
+static inline void prefetch_records(const branch_table_t *tables, const size_t *counters)
+{
+    for (size_t i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+    {
+        __builtin_prefetch(tables[i].records + counters[i] + MERGE_PREFETCH_DISTANCE);
+        if (counters[i] + MERGE_PREFETCH_DISTANCE / 2 < tables[i].n_records)
+            __builtin_prefetch(branch_table_str(&tables[i], tables[i].records[counters[i] + MERGE_PREFETCH_DISTANCE / 2].name));
+    }
+}
+
+/**
+ * @brief get_branches_statistic    merges branches' tables sorted by name and stores comparison statistic
+ * @param tables                    pointer to an array of branch tables
  * @param branches_statistic        pointer to branches_statistic_t structure
  * @return                          SUCCESS code on success, ERROR code otherwise
  */
-static int get_branches_statistic(const json_packages_t *packages_info, branches_statistic_t *branches_statistic)
+static int get_branches_statistic(const branch_table_t *tables, branches_statistic_t *branches_statistic)
 {
-    const size_t n_branches = branches_statistic->n_branches;
-    json_object * iters[n_branches];
-    size_t counters[n_branches];
-    size_t i;
-    continue_result_t can_continue = GO_AHEAD;
-
-    for (i = 0; i < n_branches; ++i) counters[i] = 0;
+    size_t counters[N_BRANCHES_TO_COMPARE_SUPPORTED] = {0, 0};
     int res;
-    while (1)
+
+    /* Identical ranges of the tables (equal digest nodes) are skipped, the merge goes on between them */
+    const branch_digest_t *digests[N_BRANCHES_TO_COMPARE_SUPPORTED] = {tables[0].digest, tables[1].digest};
+    digest_cursor_t cursors[N_BRANCHES_TO_COMPARE_SUPPORTED];
+    size_t leaf_starts[N_BRANCHES_TO_COMPARE_SUPPORTED] = {SIZE_MAX, SIZE_MAX};
+    if (digests[0] && digests[1])
     {
-        for( size_t j = 0; j < n_branches; ++j)
-        {
-            iters[j]= json_object_array_get_idx(packages_info[j].packages_array, counters[j]);
-            if (!iters[j])
-            {
-                printf("No iteraror for %lu branch, on %lu step!\n", j, counters[j]);
-                return ERROR;
-            }
-        }
-        switch (can_continue)
+        if (branch_digest_equal(&tables[0], &tables[1]))
+            return SUCCESS;
+        memset(cursors, 0, sizeof(cursors));
+        leaf_starts[0] = leaf_starts[1] = 0;
+    }
+
+    while ((counters[0] < tables[0].n_records) && (counters[1] < tables[1].n_records))
+    {
+        prefetch_records(tables, counters);
+        if ((counters[0] == leaf_starts[0]) && (counters[1] == leaf_starts[1]))
         {
-            case GO_AHEAD:
-                res = compare_tags(iters, n_branches, NAME_TAG);
-                break;
-            case FIRST_FINISHED:
-                res = 1;
-                break;
-            case SECOND_FINISHED:
-                res = -1;
-                break;
-            default:
-                printf("Unexpected code = %d\n", can_continue);
-                return ERROR;
+            const size_t skip = branch_digest_skip(digests[0], &cursors[0], counters[0],
+                                                   digests[1], &cursors[1], counters[1]);
+            counters[0] += skip;
+            counters[1] += skip;
+            leaf_starts[0] = branch_digest_next_leaf(digests[0], &cursors[0], counters[0] + !skip);
+            leaf_starts[1] = branch_digest_next_leaf(digests[1], &cursors[1], counters[1] + !skip);
+            if (skip) continue;
         }
-
+        res = compare_names(tables, counters);
         if ( res == EQUAL )
         {
-            res = compare_versions(iters, n_branches);
+            res = compare_versions(tables, counters);
             if (res != EQUAL) //if versions is different
             {
                 update_version_statistic(branches_statistic, res, counters);
             }
-            res = EQUAL;
+            ++counters[0];
+            ++counters[1];
         }
         else
         {
             update_branches_statistic(branches_statistic, res, counters);
+            ++counters[(res < EQUAL) ? 0 : 1];
         }
-        can_continue = next_position_depend_on_compare_result(res, counters, packages_info);
-        if (can_continue == BOTH_FINISHED) break;
+        if (counters[0] > leaf_starts[0])
+            leaf_starts[0] = branch_digest_next_leaf(digests[0], &cursors[0], counters[0]);
+        if (counters[1] > leaf_starts[1])
+            leaf_starts[1] = branch_digest_next_leaf(digests[1], &cursors[1], counters[1]);
     }
+    /* the rest of a longer branch is absent in the other one */
+    for (; counters[0] < tables[0].n_records; ++counters[0])
+        update_branches_statistic(branches_statistic, -1, counters);
+    for (; counters[1] < tables[1].n_records; ++counters[1])
+        update_branches_statistic(branches_statistic, 1, counters);
+
     return SUCCESS;
 }
 
 /**
- * @brief out_statistic_array   output packages statistic in JSON array
- * @param header                header(name) of JSON array
- * @param index_array           array of indexes to output
- * @param length                length of output array
- * @param packages              pointer to an array of packages to output
+ * @brief format_chunk_task     thread pool task, formats a chunk of a report array to memory
+ * @param param                 pointer to a report_chunk_t structure
  */
-static void out_statistic_array(const char *header, const size_t *index_array,  const size_t length, const json_object *packages)
+static void format_chunk_task(void *param)
 {
-    const char *tags_to_out[N_OUT_PARAMS] = {NAME_TAG, VERSION_TAG, ARCH_TAG};
-    printf("\"length\": %lu,\n", length);
-    printf("%s",header);
-    for (size_t i = 0; i < length; )
+    report_chunk_t *chunk = (report_chunk_t *)param;
+    const branch_table_t *table = chunk->table;
+    const size_t separator_len = sizeof(REPORT_PACKAGES_SEPARATOR) - 1;
+    const size_t tags_len = strlen(NAME_TAG) + strlen(VERSION_TAG) + strlen(ARCH_TAG);
+    size_t i, size = chunk->last;
+
+    /* The exact size is counted at first to format to one buffer */
+    for (i = 0; i < chunk->count; ++i)
     {
-        printf("{\n");
-        size_t ind = index_array[i];
-        json_object *iter = json_object_array_get_idx(packages, ind);
-        for (size_t k = 0; k < N_OUT_PARAMS; )
+        const package_rec_t *rec = &table->records[chunk->indexes[i]];
+        size += report_package_size(tags_len, rec->name_len + rec->version_len + rec->arch_len);
+    }
+    size += (chunk->count - chunk->first) * separator_len;
+    char *p = chunk->text = malloc(size ? size : 1);
+    if (!p) return;
+    for (i = 0; i < chunk->count; ++i)
+    {
+        const package_rec_t *rec = &table->records[chunk->indexes[i]];
+        if (i || !chunk->first) p = report_copy(p, REPORT_PACKAGES_SEPARATOR, separator_len);
+        p = report_package_format(p, branch_table_str(table, rec->name), rec->name_len,
+                                  branch_table_str(table, rec->version), rec->version_len,
+                                  branch_table_str(table, rec->arch), rec->arch_len);
+    }
+    if (chunk->last) *p = '\n';
+    chunk->size = size;
+}
+
+/**
+ * @brief write_segments    outputs memory segments in their order: with writev if the stream has
+ *                          a file descriptor, with fwrite otherwise (memory streams)
+ * @param out               output stream
+ * @param iov               array of segments, it is modified
+ * @param n                 number of segments
+ * @return                  SUCCESS code on success, ERROR code otherwise
+ */
+static int write_segments(FILE *out, struct iovec *iov, size_t n)
+{
+    const int fd = fileno(out);
+    if (fd < 0)
+    {
+        for (size_t i = 0; i < n; ++i)
         {
-            json_object * cobj = json_object_object_get(iter, tags_to_out[k]);
-            const char *str =  json_object_get_string(cobj);
-            printf("    \"%s\":\"%s\"", tags_to_out[k], str);
-            ++k;
-            if (k < N_OUT_PARAMS) printf(",");
-            printf("\n");
+            if (fwrite(iov[i].iov_base, 1, iov[i].iov_len, out) != iov[i].iov_len)
+                return ERROR;
         }
-        printf("}");
-        ++i;
-        if (i < length) printf(",");
-        printf("\n");
+        return SUCCESS;
     }
 
+    if (fflush(out) != 0)
+        return ERROR;
+    while (n)
+    {
+        const ssize_t written = writev(fd, iov, (n < REPORT_IOV_MAX) ? n : REPORT_IOV_MAX);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return ERROR;
+        }
+        /* Written segments are skipped, a partly written one is advanced */
+        size_t left = written;
+        for (; n && left >= iov->iov_len; ++iov, --n)
+            left -= iov->iov_len;
+        if (left)
+        {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief format_head   formats the head of a report array: its length and its header with the branch name
+ * @param length        array length
+ * @param format        format of the length and the header
+ * @param name          branch name
+ * @return              allocated head string, NULL on memory allocation error
+ */
+static char *format_head(const size_t length, const char *format, const char *name)
+{
+    const int len = snprintf(NULL, 0, format, length, name);
+    char *head = (len >= 0) ? malloc(len + 1) : NULL;
+    if (head)
+        snprintf(head, len + 1, format, length, name);
+    return head;
 }
 
 /**
  * @brief out_branches_statistic    output branches comparison statistic. (NOTE - released for 2 branches only!)
+ *                                  Arrays are formatted by chunks on the worker threads into private buffers,
+ *                                  the buffers are output in the report order, so the report is the same as of serial output
+ * @param out                       output stream
  * @param fparam                    pointer to an array of f_param_t structures
- * @param packages_info             pointer to an array of json_packages_t structures
+ * @param tables                    pointer to an array of branch tables
  * @param stat                      pointer to a branches_statistic_t structure
+ * @return                          SUCCESS code on success, ERROR code otherwise
  */
-static void out_branches_statistic(const f_param_t *fparam, const json_packages_t *packages_info, const branches_statistic_t *stat)
+static int out_branches_statistic(FILE *out, const f_param_t *fparam, const branch_table_t *tables, const branches_statistic_t *stat)
 {
+    const size_t n_arrays = stat->n_branches + N_BRANCHES_TO_CHECK_VERSION;
+    char *heads[N_REPORT_ARRAYS] = {NULL};
+    const size_t *indexes[N_REPORT_ARRAYS];
+    size_t lengths[N_REPORT_ARRAYS];
+    const branch_table_t *array_tables[N_REPORT_ARRAYS];
+    size_t a, n_chunks = 0;
+    int res = SUCCESS;
 
-    printf("{\n");
-    const size_t n_branches = stat->n_branches;
-    char header_str[HEADER_STR_LEN];
-    int sl;
-    for(size_t i = 0; i < n_branches; ++i)
+    for (a = 0; a < n_arrays; ++a)
     {
-        size_t length = stat->index_couters[i];
-        size_t branch_with_absent_pack = i^1; //for two branches 1 and 0 indexes valid
-        json_object *packages_array =  packages_info[branch_with_absent_pack].packages_array;
-        sl = sprintf(header_str, "\"absent_in_%s_packages\":[\n",fparam[i].pack_name);
-        header_str[sl] = 0;
+        if (a < stat->n_branches)
+        {
+            indexes[a] = stat->absent_packages_indexes[a];
+            lengths[a] = stat->index_couters[a];
+            array_tables[a] = &tables[a^1];     //for two branches 1 and 0 indexes valid
+            heads[a] = format_head(lengths[a], REPORT_LENGTH_FORMAT REPORT_ABSENT_HEADER_FORMAT, fparam[a].pack_name);
+        }
+        else
+        {
+            indexes[a] = stat->version_indexes[BRANCH_TO_CHECK_VERSION];
+            lengths[a] = stat->version_counter;
+            array_tables[a] = &tables[BRANCH_TO_CHECK_VERSION];
+            heads[a] = format_head(lengths[a], REPORT_LENGTH_FORMAT REPORT_NEWER_HEADER_FORMAT,
+                                   fparam[BRANCH_TO_CHECK_VERSION].pack_name);
+        }
+        if (!heads[a]) res = ERROR;
+        n_chunks += (lengths[a] + REPORT_CHUNK_PACKAGES - 1) / REPORT_CHUNK_PACKAGES;
+    }
 
-        out_statistic_array(header_str, stat->absent_packages_indexes[i], length, packages_array);
-         printf("],\n");
+    /* Segments: "{", then the head, the chunks and the end of every array */
+    report_chunk_t *chunks = calloc(n_chunks ? n_chunks : 1, sizeof(report_chunk_t));
+    struct iovec *iov = malloc((1 + 2 * n_arrays + n_chunks) * sizeof(struct iovec));
+    if (!chunks || !iov || res != SUCCESS)
+    {
+        printf("out_branches_statistic: memory allocation error\n");
+        for (a = 0; a < n_arrays; ++a)
+            free(heads[a]);
+        free(chunks);
+        free(iov);
+        return ERROR;
+    }
+    tpool_group_t group;
+    tpool_group_init(&group);
+    size_t c = 0;
+    for (a = 0; a < n_arrays; ++a)
+    {
+        for (size_t i = 0; i < lengths[a]; i += REPORT_CHUNK_PACKAGES, ++c)
+        {
+            chunks[c].table = array_tables[a];
+            chunks[c].indexes = indexes[a] + i;
+            chunks[c].count = (lengths[a] - i < REPORT_CHUNK_PACKAGES) ? lengths[a] - i : REPORT_CHUNK_PACKAGES;
+            chunks[c].first = !i;
+            chunks[c].last = (i + chunks[c].count == lengths[a]);
+            tpool_submit(&group, format_chunk_task, &chunks[c]);
+        }
     }
-    sl = sprintf(header_str, "\"%s_packages_newer_versions\":[\n",fparam[BRANCH_TO_CHECK_VERSION].pack_name);
-    header_str[sl] = 0;
-    out_statistic_array(header_str, stat->version_indexes[BRANCH_TO_CHECK_VERSION],
-                        stat->version_counter, packages_info[BRANCH_TO_CHECK_VERSION].packages_array);
-    printf("]\n");
-    printf("}\n");
+    tpool_group_wait(&group);
+
+    size_t n = 0;
+    iov[n].iov_base = "{\n";
+    iov[n++].iov_len = 2;
+    for (a = 0, c = 0; a < n_arrays; ++a)
+    {
+        iov[n].iov_base = heads[a];
+        iov[n++].iov_len = strlen(heads[a]);
+        for (size_t i = 0; i < lengths[a]; i += REPORT_CHUNK_PACKAGES, ++c)
+        {
+            if (!chunks[c].text) res = ERROR;
+            iov[n].iov_base = chunks[c].text;
+            iov[n++].iov_len = chunks[c].size;
+        }
+        iov[n].iov_base = (a + 1 < n_arrays) ? "],\n" : "]\n}\n";
+        iov[n].iov_len = strlen(iov[n].iov_base);
+        ++n;
+    }
+    if (res == SUCCESS)
+        res = write_segments(out, iov, n);
+    else
+        printf("out_branches_statistic: memory allocation error\n");
+
+    for (c = 0; c < n_chunks; ++c)
+        free(chunks[c].text);
+    for (a = 0; a < n_arrays; ++a)
+        free(heads[a]);
+    free(chunks);
+    free(iov);
+    return res;
+}
+
+/**
+ * @brief compare_archs     qsort comparator of architecture counters by name
+ */
+static int compare_archs(const void *a, const void *b)
+{
+    const arch_summary_t *aa = (const arch_summary_t *)a;
+    const arch_summary_t *ab = (const arch_summary_t *)b;
+    const int res = memcmp(aa->arch, ab->arch, (aa->arch_len < ab->arch_len) ? aa->arch_len : ab->arch_len);
+    return res ? res : (aa->arch_len > ab->arch_len) - (aa->arch_len < ab->arch_len);
+}
+
+/**
+ * @brief out_branches_summary  output counters of the report arrays by architectures (NOTE - released for 2 branches only!)
+ * @param out                   output stream
+ * @param fparam                pointer to an array of f_param_t structures
+ * @param stat                  pointer to a branches_statistic_t structure of summary mode
+ */
+static void out_branches_summary(FILE *out, const f_param_t *fparam, const branches_statistic_t *stat)
+{
+    branches_summary_t *summary = stat->summary;
+    const size_t n_arrays = stat->n_branches + N_BRANCHES_TO_CHECK_VERSION;
+
+    qsort(summary->archs, summary->n_archs, sizeof(arch_summary_t), compare_archs);
+    fprintf(out, "{\n");
+    for (size_t a = 0; a < n_arrays; ++a)
+    {
+        if (a < stat->n_branches)
+            fprintf(out, SUMMARY_ABSENT_HEADER_FORMAT, fparam[a].pack_name);
+        else
+            fprintf(out, SUMMARY_NEWER_HEADER_FORMAT, fparam[BRANCH_TO_CHECK_VERSION].pack_name);
+        fprintf(out, SUMMARY_LENGTH_FORMAT, (a < stat->n_branches) ? stat->index_couters[a] : stat->version_counter);
+        const char *separator = "";
+        for (size_t i = 0; i < summary->n_archs; ++i)
+        {
+            const arch_summary_t *arch = &summary->archs[i];
+            if (!arch->counts[a]) continue;
+            fprintf(out, SUMMARY_ARCH_FORMAT, separator, (int)arch->arch_len, arch->arch, arch->counts[a]);
+            separator = ",";
+        }
+        fprintf(out, "%s", (a + 1 < n_arrays) ? SUMMARY_ARRAY_END ",\n" : SUMMARY_ARRAY_END "\n");
+    }
+    fprintf(out, "}\n");
+}
+
+/**
+ * @brief compare_tables    compares two parsed branches and outputs the result
+ * @param out               output stream
+ * @param fparam            pointer to an array of 2 f_param_t structures
+ * @param tables            pointer to an array of 2 branch tables
+ * @param summary           1 to output counters of the report arrays only
+ * @return                  SUCCESS code on success, ERROR code otherwise
+ */
+static int compare_tables(FILE *out, const f_param_t *fparam, const branch_table_t *tables, const int summary)
+{
+    branches_statistic_t branches_statistic;
+
+    /* Summary: the merge only counts packages, nothing is stored per package */
+    if (summary)
+    {
+        branches_summary_t branches_summary;
+        init_branch_summary(&branches_statistic, &branches_summary, tables, N_BRANCHES_TO_COMPARE_SUPPORTED);
+        int res = get_branches_statistic(tables, &branches_statistic);
+        if (res == SUCCESS && branches_summary.result != SUCCESS)
+        {
+            printf("Get branches summary: memory allocation error\n");
+            res = ERROR;
+        }
+        if (res == SUCCESS)
+            out_branches_summary(out, fparam, &branches_statistic);
+        free(branches_summary.archs);
+        return res;
+    }
+
+    if (init_branch_statistic(&branches_statistic, tables, N_BRANCHES_TO_COMPARE_SUPPORTED) != SUCCESS)
+    {
+        printf("Init branches statistic error!\n");
+        return ERROR;
+    }
+    if (get_branches_statistic(tables, &branches_statistic) != SUCCESS)
+    {
+        printf("Get branches statistic error!\n");
+        destroy_branch_statistic(&branches_statistic);
+        return ERROR;
+    }
+    const int res = out_branches_statistic(out, fparam, tables, &branches_statistic);
+    destroy_branch_statistic(&branches_statistic);
+    return res;
 }
 
 /**
- * @brief parsing_json_files - parsing JSON files in separate threads
+ * @brief parsing_json_files - parsing JSON files as the thread pool tasks
  * @param fparam            - pointer to f_param_t structure
+ * @param tables            - pointer to an array of branch tables to fill
  * @param n_branches        - number of branches
  * @return                  SUCCESS on success, ERROR otherwise
  */
-static int parsing_json_files(const f_param_t *fparam, json_object **wrappers, const size_t n_branches)
+static int parsing_json_files(const f_param_t *fparam, branch_table_t *tables, const size_t n_branches)
 {
-    pthread_t parse_thread[n_branches];
+    tpool_group_t parse_group;
     parse_parameter_t parsers[n_branches];
     size_t i;
     for (i = 0 ; i < n_branches; ++i)
     {
         parsers[i].file_parameters = &fparam[i];
-        parsers[i].json_wrapper = NULL;
+        parsers[i].table = &tables[i];
+        parsers[i].result = ERROR;
     }
     int res = SUCCESS;
+    tpool_group_init(&parse_group);
     for (i = 0 ; i < n_branches; ++i)
     {
-        pthread_create(&parse_thread[i], NULL, json_file_parse, &parsers[i]);
+        tpool_submit(&parse_group, json_file_parse, &parsers[i]);
     }
+    tpool_group_wait(&parse_group);
     for (i = 0; i < n_branches; ++i)
     {
-        pthread_join(parse_thread[i], NULL);
-        if(!parsers[i].json_wrapper)
+        if (parsers[i].result != SUCCESS)
         {
             res = ERROR;
         }
-        else
+    }
+    if (res != SUCCESS)
+    {
+        for (i = 0; i < n_branches; ++i)
         {
-            wrappers[i] = parsers[i].json_wrapper;
+            if (parsers[i].result == SUCCESS)
+                branch_table_destroy(&tables[i]);
         }
     }
 
     return res;
 }
 
-int pcompare_process_branches(const f_param_t *fparam, const size_t n_branches)
+int compare_branches(FILE *out, const f_param_t *fparam, const pcompare_options_t *options)
 {
-    if (check_input_parameters((f_param_t *)fparam, n_branches) != SUCCESS)
-        return ERROR;
-
-    json_object *wrappers[n_branches];
-    json_packages_t packages_info[n_branches];
+    branch_table_t tables[N_BRANCHES_TO_COMPARE_SUPPORTED];
     size_t i;
 
-     for (i = 0; i < n_branches; ++i)
+     for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
      {
          if ((fparam[i].fd<0)||(!fparam[i].fptr)||!fparam[i].size)
          {
@@ -658,39 +1050,635 @@ int pcompare_process_branches(const f_param_t *fparam, const size_t n_branches)
          }
      }
 
+    /* Bounded memory: the branches are never loaded as a whole */
+    if (!options)
+        options = &default_options;
+    if (options->max_memory)
+        return ext_compare_branches(out, fparam, options->max_memory, options->summary);
+
     /* Parsing packages files */
-    int res = parsing_json_files(fparam, wrappers, n_branches);
+    int res = parsing_json_files(fparam, tables, N_BRANCHES_TO_COMPARE_SUPPORTED);
     if (res != SUCCESS)
     {
         printf("Parsing error!\n");
         return res;
     }
 
+    res = compare_tables(out, fparam, tables, options->summary);
+
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+        branch_table_destroy(&tables[i]);
+
+    return res;
+}
+
+int pcompare_process_branches(const f_param_t *fparam, const size_t n_branches)
+{
+    return pcompare_process_branches_to(stdout, fparam, n_branches, NULL);
+}
+
+int pcompare_process_branches_to(FILE *out, const f_param_t *fparam, const size_t n_branches,
+                                 const pcompare_options_t *options)
+{
+    if (!out || check_input_parameters((f_param_t *)fparam, n_branches) != SUCCESS ||
+        check_options(options) != SUCCESS)
+        return ERROR;
+
+    if (options && options->cache_dir)
+        return result_cache_compare(options->cache_dir, options->cache_size, options->summary ? "summary" : "report",
+                                    out, fparam, compare_branches, options);
+    return compare_branches(out, fparam, options);
+}
+
+/**
+ * @brief compare_pair_task     thread pool task, compares a pair of branches to a report file or to memory
+ * @param param                 pointer to a pair_parameter_t structure
+ */
+static void compare_pair_task(void *param)
+{
+    pair_parameter_t *pair = (pair_parameter_t *)param;
+    FILE *out;
+    char fname[PATH_MAX];
+
+    if (pair->out_dir)
+    {
+        if (snprintf(fname, sizeof(fname), "%s/%s_vs_%s.json", pair->out_dir, pair->fparam[0].pack_name,
+                     pair->fparam[1].pack_name) >= (int)sizeof(fname))
+        {
+            printf("Report path of \"%s\" and \"%s\" comparison is too long\n",
+                   pair->fparam[0].pack_name, pair->fparam[1].pack_name);
+            pair->result = ERROR;
+            return;
+        }
+        out = fopen(fname, "w");
+    }
+    else
+    {
+        out = open_memstream(&pair->report, &pair->report_size);
+    }
+    if (!out)
+    {
+        printf("Could not open report of \"%s\" and \"%s\" comparison: %s\n",
+               pair->fparam[0].pack_name, pair->fparam[1].pack_name, strerror(errno));
+        pair->result = ERROR;
+        return;
+    }
+    pair->result = compare_tables(out, pair->fparam, pair->tables, pair->summary);
+    if (fclose(out) != 0)
+        pair->result = ERROR;
+}
+
+int pcompare_process_matrix(const f_param_t *fparam, const size_t n_branches, const char *out_dir,
+                            const pcompare_options_t *options)
+{
+    if (check_branches_names(fparam, n_branches) != SUCCESS || check_options(options) != SUCCESS)
+        return ERROR;
+    if (n_branches < N_BRANCHES_TO_COMPARE_SUPPORTED)
+    {
+        printf("At least 2 branches should be set!\n");
+        return ERROR;
+    }
+
+    size_t i, j, k;
     for (i = 0; i < n_branches; ++i)
     {
-        if (get_packages_info(wrappers[i], &packages_info[i]) != SUCCESS)
+        if ((fparam[i].fd<0)||(!fparam[i].fptr)||!fparam[i].size)
         {
+            printf("File %s.json was not initiated for reading!\n", fparam[i].pack_name);
             return ERROR;
         }
     }
 
-    branches_statistic_t branches_statistic;
+    branch_table_t *tables = calloc(n_branches, sizeof(branch_table_t));
+    const size_t n_pairs = n_branches * (n_branches - 1);
+    pair_parameter_t *pairs = calloc(n_pairs, sizeof(pair_parameter_t));
+    if (!tables || !pairs)
+    {
+        printf("pcompare_process_matrix: memory allocation error\n");
+        free(tables);
+        free(pairs);
+        return ERROR;
+    }
 
-    if (init_branch_statistic(&branches_statistic, packages_info, n_branches) != SUCCESS)
+    /* Every branch is parsed once, its table is shared by all pairs */
+    int res = parsing_json_files(fparam, tables, n_branches);
+    if (res != SUCCESS)
     {
-        printf("Init branches statistic error!\n");
+        printf("Parsing error!\n");
+        free(tables);
+        free(pairs);
+        return res;
+    }
+
+    tpool_group_t pairs_group;
+    tpool_group_init(&pairs_group);
+    for (i = 0, k = 0; i < n_branches; ++i)
+    {
+        for (j = 0; j < n_branches; ++j)
+        {
+            if (i == j) continue;
+            pairs[k].fparam[0] = fparam[i];
+            pairs[k].fparam[1] = fparam[j];
+            pairs[k].tables[0] = tables[i];
+            pairs[k].tables[1] = tables[j];
+            pairs[k].out_dir = out_dir;
+            pairs[k].summary = options ? options->summary : 0;
+            pairs[k].result = ERROR;
+            tpool_submit(&pairs_group, compare_pair_task, &pairs[k]);
+            ++k;
+        }
+    }
+    tpool_group_wait(&pairs_group);
+
+    if (!out_dir)
+        printf("{\n");
+    for (k = 0; k < n_pairs; ++k)
+    {
+        if (pairs[k].result != SUCCESS)
+            res = ERROR;
+        if (!out_dir)
+        {
+            printf("\"%s_vs_%s\":", pairs[k].fparam[0].pack_name, pairs[k].fparam[1].pack_name);
+            if (pairs[k].result == SUCCESS)
+                fwrite(pairs[k].report, 1, pairs[k].report_size, stdout);
+            else
+                printf("null\n");
+            if (k + 1 < n_pairs) printf(",\n");
+        }
+        free(pairs[k].report);
+    }
+    if (!out_dir)
+        printf("}\n");
+
+    for (i = 0; i < n_branches; ++i)
+        branch_table_destroy(&tables[i]);
+    free(tables);
+    free(pairs);
+
+    return res;
+}
+
+/**
+ * @brief branch_load   parses an opened branch file to a branch and builds the point-query index
+ * @param branch        pointer to a branch with the name set
+ * @param fparam        pointer to an opened f_param_t structure
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int branch_load(pcompare_branch_t *branch, const f_param_t *fparam)
+{
+    parse_parameter_t parser = { fparam, &branch->table, ERROR };
+    json_file_parse(&parser);
+    if (parser.result != SUCCESS)
+        return ERROR;
+    if (branch_index_build(&branch->index, &branch->table) != SUCCESS)
+    {
+        branch_table_destroy(&branch->table);
         return ERROR;
     }
+    return SUCCESS;
+}
 
-    if (get_branches_statistic(packages_info, &branches_statistic) != SUCCESS)
+/**
+ * @brief branch_new    allocates a branch with one reference
+ * @param pack_name     branch name
+ * @return              branch on success, NULL otherwise
+ */
+static pcompare_branch_t *branch_new(const char *pack_name)
+{
+    pcompare_branch_t *branch = calloc(1, sizeof(pcompare_branch_t));
+    if (!branch || !(branch->pack_name = strdup(pack_name)))
     {
-        printf("Get branches statistic error!\n");
-        destroy_branch_statistic(&branches_statistic);
+        printf("pcompare_branch_open: memory allocation error\n");
+        free(branch);
+        return NULL;
+    }
+    branch->refs = 1;
+    return branch;
+}
+
+/**
+ * @brief branch_free   releases memory of a branch
+ * @param branch        pointer to a branch
+ * @param loaded        1 if the branch data is loaded
+ */
+static void branch_free(pcompare_branch_t *branch, const int loaded)
+{
+    if (loaded)
+    {
+        branch_index_destroy(&branch->index);
+        branch_table_destroy(&branch->table);
+    }
+    free(branch->pack_name);
+    free(branch);
+}
+
+pcompare_branch_t *branch_from_table(const char *pack_name, branch_table_t *table)
+{
+    pcompare_branch_t *branch = branch_new(pack_name);
+    if (!branch || branch_digest_build(table) != SUCCESS ||
+        branch_index_build(&branch->index, table) != SUCCESS)
+    {
+        branch_table_destroy(table);
+        if (branch) branch_free(branch, 0);
+        return NULL;
+    }
+    branch->table = *table;
+    return branch;
+}
+
+const branch_table_t *branch_get_table(const pcompare_branch_t *branch)
+{
+    return &branch->table;
+}
+
+pcompare_branch_t *pcompare_branch_open(const f_param_t *fparam)
+{
+    if (check_branches_names(fparam, 1) != SUCCESS)
+        return NULL;
+    if ((fparam->fd<0)||(!fparam->fptr)||!fparam->size)
+    {
+        printf("File %s.json was not initiated for reading!\n", fparam->pack_name);
+        return NULL;
+    }
+
+    pcompare_branch_t *branch = branch_new(fparam->pack_name);
+    if (!branch)
+        return NULL;
+    if (branch_load(branch, fparam) != SUCCESS)
+    {
+        branch_free(branch, 0);
+        return NULL;
+    }
+    return branch;
+}
+
+void pcompare_branch_close(pcompare_branch_t *branch)
+{
+    pcompare_branch_release(branch);
+}
+
+/**
+ * @brief registry_unlink   removes a branch from the registry, must be called under the registry lock
+ * @param branch            pointer to a registered branch
+ */
+static void registry_unlink(pcompare_branch_t *branch)
+{
+    for (pcompare_branch_t **p = &registry.branches; *p; p = &(*p)->next)
+    {
+        if (*p == branch)
+        {
+            *p = branch->next;
+            break;
+        }
+    }
+    branch->registered = 0;
+}
+
+/**
+ * @brief file_id_equal     compares identities of two files
+ * @param a                 pointer to the first file identity
+ * @param b                 pointer to the second file identity
+ * @return                  1 if the identities are equal, 0 otherwise
+ */
+static int file_id_equal(const file_id_t *a, const file_id_t *b)
+{
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+pcompare_branch_t *pcompare_branch_acquire(const char *pack_name)
+{
+    pcompare_branch_t *branch;
+    struct stat st;
+
+    if (!pack_name || !pack_name[0])
+    {
+        printf("pcompare_branch_acquire: branch name should be set!\n");
+        return NULL;
+    }
+
+    /* The file is opened first: its identity is the registry key and the parsed data belong to it */
+    f_param_t fparam = { pack_name, -1, 0, NULL };
+    if (pcompare_open_downloaded_files(&fparam, 1) != SUCCESS)
+        return NULL;
+    if (fstat(fparam.fd, &st) != 0)
+    {
+        printf("Could not get \"%s.json\" file status: %s\n", pack_name, strerror(errno));
+        pcompare_close_files(&fparam, 1);
+        return NULL;
+    }
+    const file_id_t file_id = { st.st_dev, st.st_ino, st.st_size, st.st_mtim };
+
+    pthread_mutex_lock(&registry.lock);
+    pcompare_branch_t **p = &registry.branches;
+    while ((branch = *p))
+    {
+        if (!strcmp(branch->pack_name, pack_name))
+        {
+            if (file_id_equal(&branch->file_id, &file_id))
+                break;
+            if (!branch->loading)
+            {
+                /* The file was downloaded again: the old copy is kept by its handles only */
+                *p = branch->next;
+                branch->registered = 0;
+                continue;
+            }
+        }
+        p = &branch->next;
+    }
+    if (branch)
+    {
+        /* The branch is shared: wait until the first acquirer loads it */
+        ++branch->refs;
+        pthread_mutex_unlock(&registry.lock);
+        pcompare_close_files(&fparam, 1);
+        pthread_mutex_lock(&registry.lock);
+        while (branch->loading)
+            pthread_cond_wait(&registry.loaded, &registry.lock);
+        if (!branch->failed)
+        {
+            pthread_mutex_unlock(&registry.lock);
+            return branch;
+        }
+        const int last = !--branch->refs;
+        pthread_mutex_unlock(&registry.lock);
+        if (last)
+            branch_free(branch, 0);
+        return NULL;
+    }
+
+    branch = branch_new(pack_name);
+    if (!branch)
+    {
+        pthread_mutex_unlock(&registry.lock);
+        pcompare_close_files(&fparam, 1);
+        return NULL;
+    }
+    branch->file_id = file_id;
+    branch->loading = 1;
+    branch->registered = 1;
+    branch->next = registry.branches;
+    registry.branches = branch;
+    pthread_mutex_unlock(&registry.lock);
+
+    /* The branch file is parsed without the lock, other acquirers wait for it */
+    int res = branch_load(branch, &fparam);
+    pcompare_close_files(&fparam, 1);
+
+    pthread_mutex_lock(&registry.lock);
+    branch->loading = 0;
+    int last = 0;
+    if (res != SUCCESS)
+    {
+        branch->failed = 1;
+        registry_unlink(branch);
+        last = !--branch->refs;
+    }
+    pthread_cond_broadcast(&registry.loaded);
+    pthread_mutex_unlock(&registry.lock);
+    if (res == SUCCESS)
+        return branch;
+    if (last)
+        branch_free(branch, 0);
+    return NULL;
+}
+
+void pcompare_branch_release(pcompare_branch_t *branch)
+{
+    if (!branch) return;
+    pthread_mutex_lock(&registry.lock);
+    const int last = !--branch->refs;
+    if (last && branch->registered)
+        registry_unlink(branch);
+    pthread_mutex_unlock(&registry.lock);
+    if (last)
+        branch_free(branch, 1);
+}
+
+pcompare_branch_t *pcompare_branch_ref(pcompare_branch_t *branch)
+{
+    if (!branch) return NULL;
+    pthread_mutex_lock(&registry.lock);
+    ++branch->refs;
+    pthread_mutex_unlock(&registry.lock);
+    return branch;
+}
+
+int pcompare_compare(const pcompare_branch_t *branch1, const pcompare_branch_t *branch2, FILE *out,
+                     const pcompare_options_t *options)
+{
+    if (!branch1 || !branch2 || !out)
+    {
+        printf("pcompare_compare: invalid input parameter!\n");
         return ERROR;
     }
+    /* Branches are immutable: shallow copies of the tables are compared */
+    const f_param_t fparam[N_BRANCHES_TO_COMPARE_SUPPORTED] =
+    {
+        { branch1->pack_name, -1, 0, NULL },
+        { branch2->pack_name, -1, 0, NULL }
+    };
+    const branch_table_t tables[N_BRANCHES_TO_COMPARE_SUPPORTED] = { branch1->table, branch2->table };
+    return compare_tables(out, fparam, tables, options ? options->summary : 0);
+}
 
-    out_branches_statistic(fparam, packages_info, &branches_statistic);
-    destroy_branch_statistic(&branches_statistic);
+/**
+ * @brief compare_shared    compares two opened branches sharing their parsed data through the branches registry.
+ *                          If a file is downloaded again after it was opened, the opened files are compared,
+ *                          so the report always belongs to the opened files
+ * @param out               output stream
+ * @param fparam            pointer to an array of 2 opened f_param_t structures
+ * @param options           pointer to comparison options, NULL for the defaults
+ * @return                  SUCCESS code on success, ERROR code otherwise
+ */
+static int compare_shared(FILE *out, const f_param_t *fparam, const pcompare_options_t *options)
+{
+    pcompare_branch_t *branches[N_BRANCHES_TO_COMPARE_SUPPORTED] = {NULL};
+    struct stat st;
+    int same = 1;
+    size_t i;
+
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+    {
+        branches[i] = pcompare_branch_acquire(fparam[i].pack_name);
+        if (!branches[i]) break;
+        if (fstat(fparam[i].fd, &st) == 0)
+        {
+            const file_id_t file_id = { st.st_dev, st.st_ino, st.st_size, st.st_mtim };
+            same = same && file_id_equal(&branches[i]->file_id, &file_id);
+        }
+    }
+    int res = ERROR;
+    if (i == N_BRANCHES_TO_COMPARE_SUPPORTED)
+        res = same ? pcompare_compare(branches[0], branches[1], out, options) : compare_branches(out, fparam, options);
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+        pcompare_branch_release(branches[i]);
+    return res;
+}
 
+int compare_branches_by_name(FILE *out, const char *pack_name1, const char *pack_name2,
+                             const pcompare_options_t *options)
+{
+    f_param_t fparam[N_BRANCHES_TO_COMPARE_SUPPORTED] =
+    {
+        { pack_name1, -1, 0, NULL },
+        { pack_name2, -1, 0, NULL }
+    };
+    int res;
+
+    if (options && (options->max_memory || options->cache_dir))
+    {
+        /* Streaming comparison within the memory budget has nothing to share; the cache key needs opened files */
+        if (pcompare_open_downloaded_files(fparam, N_BRANCHES_TO_COMPARE_SUPPORTED) != SUCCESS)
+            return ERROR;
+        if (options->cache_dir)
+            res = result_cache_compare(options->cache_dir, options->cache_size, options->summary ? "summary" : "report",
+                                       out, fparam, options->max_memory ? compare_branches : compare_shared, options);
+        else
+            res = compare_branches(out, fparam, options);
+        pcompare_close_files(fparam, N_BRANCHES_TO_COMPARE_SUPPORTED);
+        return res;
+    }
+
+    pcompare_branch_t *branch1 = pcompare_branch_acquire(pack_name1);
+    pcompare_branch_t *branch2 = branch1 ? pcompare_branch_acquire(pack_name2) : NULL;
+    res = pcompare_compare(branch1, branch2, out, options);
+    pcompare_branch_release(branch2);
+    pcompare_branch_release(branch1);
+    return res;
+}
+
+const char *pcompare_branch_name(const pcompare_branch_t *branch)
+{
+    return branch ? branch->pack_name : NULL;
+}
+
+/**
+ * @brief fill_package  fills package information of a table record
+ * @param table         pointer to a branch table
+ * @param rec           pointer to a record of the table
+ * @param package       pointer to a pcompare_package_t structure to fill
+ */
+static void fill_package(const branch_table_t *table, const package_rec_t *rec, pcompare_package_t *package)
+{
+    package->name = branch_table_str(table, rec->name);
+    package->version = branch_table_str(table, rec->version);
+    package->arch = branch_table_str(table, rec->arch);
+    package->name_len = rec->name_len;
+    package->version_len = rec->version_len;
+    package->arch_len = rec->arch_len;
+}
+
+size_t pcompare_lookup_range(const pcompare_branch_t *branch, const char *name, const size_t name_len,
+                             const int flags, size_t *first)
+{
+    if (!branch || (!name && name_len) || !first)
+    {
+        printf("pcompare_lookup_range: invalid input parameter!\n");
+        return 0;
+    }
+    const branch_table_t *table = &branch->table;
+    size_t i = branch_index_lower_bound(&branch->index, table, name, name_len);
+
+    *first = i;
+    for (; i < table->n_records; ++i)
+    {
+        const package_rec_t *rec = &table->records[i];
+        const char *rec_name = branch_table_str(table, rec->name);
+        if (flags & PCOMPARE_LOOKUP_PREFIX)
+        {
+            if ((rec->name_len < name_len) || memcmp(rec_name, name, name_len)) break;
+        }
+        else if ((rec->name_len != name_len) || memcmp(rec_name, name, name_len))
+        {
+            break;
+        }
+    }
+    return i - *first;
+}
+
+size_t pcompare_lookup(const pcompare_branch_t *branch, const char *name, const int flags,
+                       pcompare_package_t *packages, const size_t max_packages)
+{
+    if (!branch || !name)
+    {
+        printf("pcompare_lookup: invalid input parameter!\n");
+        return 0;
+    }
+    size_t first;
+    const size_t found = pcompare_lookup_range(branch, name, strlen(name), flags, &first);
+
+    for (size_t i = 0; i < found && i < max_packages; ++i)
+        fill_package(&branch->table, &branch->table.records[first + i], &packages[i]);
+    return found;
+}
+
+size_t pcompare_branch_size(const pcompare_branch_t *branch)
+{
+    return branch ? branch->table.n_records : 0;
+}
+
+int pcompare_branch_package(const pcompare_branch_t *branch, const size_t pos, pcompare_package_t *package)
+{
+    if (!branch || !package || pos >= branch->table.n_records)
+    {
+        printf("pcompare_branch_package: invalid input parameter!\n");
+        return ERROR;
+    }
+    fill_package(&branch->table, &branch->table.records[pos], package);
     return SUCCESS;
 }
+
+int pcompare_diff_next(const pcompare_branch_t *branch1, const pcompare_branch_t *branch2,
+                       pcompare_diff_cursor_t *cursor, pcompare_difference_t *diff)
+{
+    if (!branch1 || !branch2 || !cursor || !diff)
+    {
+        printf("pcompare_diff_next: invalid input parameter!\n");
+        return ERROR;
+    }
+    const branch_table_t tables[N_BRANCHES_TO_COMPARE_SUPPORTED] = { branch1->table, branch2->table };
+    size_t *counters = cursor->pos;
+
+    /* The same merge as get_branches_statistic, stopped at every difference */
+    memset(diff, 0, sizeof(pcompare_difference_t));
+    if (tables[0].digest && tables[1].digest && branch_digest_equal(&tables[0], &tables[1]))
+    {
+        counters[0] = tables[0].n_records;
+        counters[1] = tables[1].n_records;
+    }
+    while ((counters[0] < tables[0].n_records) && (counters[1] < tables[1].n_records))
+    {
+        int res = compare_names(tables, counters);
+        if (res == EQUAL)
+        {
+            res = compare_versions(tables, counters);
+            ++counters[0];
+            ++counters[1];
+            if (res > EQUAL)
+            {
+                diff->kind = PCOMPARE_DIFF_NEWER_IN_FIRST;
+                fill_package(&tables[0], &tables[0].records[counters[0] - 1], &diff->first);
+                fill_package(&tables[1], &tables[1].records[counters[1] - 1], &diff->second);
+                return diff->kind;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (counters[0] < tables[0].n_records &&
+        (counters[1] == tables[1].n_records || compare_names(tables, counters) < EQUAL))
+    {
+        diff->kind = PCOMPARE_DIFF_ONLY_IN_FIRST;
+        fill_package(&tables[0], &tables[0].records[counters[0]++], &diff->first);
+    }
+    else if (counters[1] < tables[1].n_records)
+    {
+        diff->kind = PCOMPARE_DIFF_ONLY_IN_SECOND;
+        fill_package(&tables[1], &tables[1].records[counters[1]++], &diff->second);
+    }
+    return diff->kind;
+}
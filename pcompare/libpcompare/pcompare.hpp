@@ -0,0 +1,419 @@
+#ifndef __PCOMPARE_HPP_
+#define __PCOMPARE_HPP_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Header-only C++17 interface of the libpcompare library.
+ * Branches, comparisons and asynchronous jobs are move-only RAII handles.
+ * Packages and differences are lazily evaluated ranges of std::string_view
+ * into the strings owned by the library branches: nothing is copied or allocated,
+ * the views are valid while the branch (or a comparison holding it) is alive.
+ * Errors are reported with pcompare::error exceptions.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "pcompare.h"
+
+namespace pcompare
+{
+
+//library error
+class error : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+//package information, the views point into the branch strings
+struct package
+{
+    std::string_view name;      //package name
+    std::string_view version;   //package version
+    std::string_view arch;      //package architecture
+};
+
+//kind of a difference of two branches
+enum class difference_kind
+{
+    only_in_first   = PCOMPARE_DIFF_ONLY_IN_FIRST,      //package of the first branch is absent in the second one
+    only_in_second  = PCOMPARE_DIFF_ONLY_IN_SECOND,     //package of the second branch is absent in the first one
+    newer_in_first  = PCOMPARE_DIFF_NEWER_IN_FIRST      //package version in the first branch is newer
+};
+
+//difference of two branches
+struct difference
+{
+    difference_kind kind;   //difference kind
+    package         first;  //package of the first branch (empty for only_in_second)
+    package         second; //package of the second branch (empty for only_in_first)
+};
+
+namespace detail
+{
+
+/**
+ * @brief make_package  makes views of a C package information
+ */
+inline package make_package(const pcompare_package_t &p) noexcept
+{
+    return { { p.name, p.name_len }, { p.version, p.version_len }, { p.arch, p.arch_len } };
+}
+
+} //namespace detail
+
+//random access range of consecutive packages of a branch
+class package_range
+{
+public:
+    //iterator, dereferencing makes a package of views
+    class iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = package;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = void;
+        using reference         = package;
+
+        iterator() noexcept = default;
+        iterator(const pcompare_branch_t *branch, const std::size_t pos) noexcept : branch_(branch), pos_(pos) {}
+
+        package operator*() const
+        {
+            pcompare_package_t p;
+            pcompare_branch_package(branch_, pos_, &p);
+            return detail::make_package(p);
+        }
+        package operator[](const difference_type n) const { return *(*this + n); }
+
+        iterator &operator++() noexcept { ++pos_; return *this; }
+        iterator operator++(int) noexcept { iterator it = *this; ++pos_; return it; }
+        iterator &operator--() noexcept { --pos_; return *this; }
+        iterator operator--(int) noexcept { iterator it = *this; --pos_; return it; }
+        iterator &operator+=(const difference_type n) noexcept { pos_ += n; return *this; }
+        iterator &operator-=(const difference_type n) noexcept { pos_ -= n; return *this; }
+        friend iterator operator+(iterator it, const difference_type n) noexcept { return it += n; }
+        friend iterator operator+(const difference_type n, iterator it) noexcept { return it += n; }
+        friend iterator operator-(iterator it, const difference_type n) noexcept { return it -= n; }
+        friend difference_type operator-(const iterator &a, const iterator &b) noexcept
+        {
+            return static_cast<difference_type>(a.pos_) - static_cast<difference_type>(b.pos_);
+        }
+
+        friend bool operator==(const iterator &a, const iterator &b) noexcept { return a.pos_ == b.pos_; }
+        friend bool operator!=(const iterator &a, const iterator &b) noexcept { return a.pos_ != b.pos_; }
+        friend bool operator<(const iterator &a, const iterator &b) noexcept { return a.pos_ < b.pos_; }
+        friend bool operator>(const iterator &a, const iterator &b) noexcept { return a.pos_ > b.pos_; }
+        friend bool operator<=(const iterator &a, const iterator &b) noexcept { return a.pos_ <= b.pos_; }
+        friend bool operator>=(const iterator &a, const iterator &b) noexcept { return a.pos_ >= b.pos_; }
+
+    private:
+        const pcompare_branch_t *branch_ = nullptr;    //branch of the packages
+        std::size_t             pos_ = 0;               //package position
+    };
+
+    package_range(const pcompare_branch_t *branch, const std::size_t first, const std::size_t count) noexcept
+        : branch_(branch), first_(first), count_(count) {}
+
+    iterator begin() const noexcept { return iterator(branch_, first_); }
+    iterator end() const noexcept { return iterator(branch_, first_ + count_); }
+    std::size_t size() const noexcept { return count_; }
+    bool empty() const noexcept { return !count_; }
+    package operator[](const std::size_t n) const { return begin()[n]; }
+
+private:
+    const pcompare_branch_t *branch_;   //branch of the packages
+    std::size_t             first_;     //position of the first package
+    std::size_t             count_;     //number of packages
+};
+
+//shared read-only branch, move-only owner of one branch reference
+class branch
+{
+public:
+    /**
+     * @brief acquire   returns the shared parsed copy of a downloaded branch ("<name>.json")
+     */
+    static branch acquire(const char *name)
+    {
+        pcompare_branch_t *handle = pcompare_branch_acquire(name);
+        if (!handle)
+            throw error(std::string("could not acquire branch \"") + (name ? name : "") + "\"");
+        return branch(handle);
+    }
+    static branch acquire(const std::string &name) { return acquire(name.c_str()); }
+
+    /**
+     * @brief download  downloads a branch to "<name>.json" from the export of the options and acquires it
+     */
+    static branch download(const char *name, const pcompare_options_t *options = nullptr)
+    {
+        f_param_t fparam = { name, -1, 0, nullptr };
+        if (pcompare_load_files_from(&fparam, 1, options) != SUCCESS)
+            throw error(std::string("could not download branch \"") + (name ? name : "") + "\"");
+        return acquire(name);
+    }
+    static branch download(const std::string &name, const pcompare_options_t *options = nullptr)
+    {
+        return download(name.c_str(), options);
+    }
+
+    /**
+     * @brief open  parses a branch file opened with pcompare_open_downloaded_files, the branch is not shared
+     */
+    static branch open(const f_param_t &fparam)
+    {
+        pcompare_branch_t *handle = pcompare_branch_open(&fparam);
+        if (!handle)
+            throw error(std::string("could not open branch \"") + (fparam.pack_name ? fparam.pack_name : "") + "\"");
+        return branch(handle);
+    }
+
+    /**
+     * @brief history   reconstructs a snapshot of the date (the last one if date is null) from the history archive
+     */
+    static branch history(const char *dir, const char *name, const char *date = nullptr)
+    {
+        pcompare_branch_t *handle = pcompare_history_open(dir, name, date);
+        if (!handle)
+            throw error(std::string("could not open branch \"") + (name ? name : "") + "\" from the history archive");
+        return branch(handle);
+    }
+
+    /**
+     * @brief archive   adds the branch to the history archive as a snapshot of the date "YYYY-MM-DD"
+     */
+    void archive(const char *dir, const char *date) const
+    {
+        if (pcompare_history_add(dir, handle_, date) != SUCCESS)
+            throw error("could not add branch \"" + std::string(name()) + "\" to the history archive");
+    }
+
+    branch() noexcept = default;
+    explicit branch(pcompare_branch_t *handle) noexcept : handle_(handle) {}   //adopts a reference
+    branch(const branch &) = delete;
+    branch &operator=(const branch &) = delete;
+    branch(branch &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    branch &operator=(branch &&other) noexcept
+    {
+        if (this != &other)
+        {
+            pcompare_branch_release(handle_);
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~branch() { pcompare_branch_release(handle_); }
+
+    explicit operator bool() const noexcept { return handle_ != nullptr; }
+    pcompare_branch_t *get() const noexcept { return handle_; }
+    pcompare_branch_t *release() noexcept { return std::exchange(handle_, nullptr); }
+
+    std::string_view name() const
+    {
+        const char *name = pcompare_branch_name(handle_);
+        return name ? std::string_view(name) : std::string_view();
+    }
+    std::size_t size() const noexcept { return pcompare_branch_size(handle_); }
+
+    /**
+     * @brief packages  returns all packages sorted by name and arch
+     */
+    package_range packages() const noexcept { return package_range(handle_, 0, size()); }
+
+    /**
+     * @brief lookup    returns packages with the name or, if prefix is set, with names starting with it
+     */
+    package_range lookup(const std::string_view name, const bool prefix = false) const
+    {
+        std::size_t first = 0;
+        const std::size_t count = handle_ ? pcompare_lookup_range(handle_, name.data(), name.size(),
+                                            prefix ? PCOMPARE_LOOKUP_PREFIX : PCOMPARE_LOOKUP_EXACT, &first) : 0;
+        return package_range(handle_, first, count);
+    }
+
+private:
+    pcompare_branch_t *handle_ = nullptr;  //branch handle
+};
+
+//input range of differences of two branches, evaluated while iterating
+class difference_range
+{
+public:
+    //iterator keeps the comparison position and the current difference
+    class iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = difference;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const difference *;
+        using reference         = const difference &;
+
+        iterator() noexcept = default;  //end iterator
+        iterator(const pcompare_branch_t *first, const pcompare_branch_t *second, const int filter)
+            : first_(first), second_(second), filter_(filter)
+        {
+            next();
+        }
+
+        reference operator*() const noexcept { return current_; }
+        pointer operator->() const noexcept { return &current_; }
+        iterator &operator++() { next(); return *this; }
+        void operator++(int) { next(); }
+
+        friend bool operator==(const iterator &a, const iterator &b) noexcept { return a.first_ == b.first_; }
+        friend bool operator!=(const iterator &a, const iterator &b) noexcept { return a.first_ != b.first_; }
+
+    private:
+        /**
+         * @brief next  evaluates the next difference of the filter kind, becomes the end iterator after the last one
+         */
+        void next()
+        {
+            pcompare_difference_t diff;
+            int kind;
+            do
+            {
+                kind = pcompare_diff_next(first_, second_, &cursor_, &diff);
+            } while (filter_ && kind > PCOMPARE_DIFF_END && kind != filter_);
+            if (kind <= PCOMPARE_DIFF_END)
+            {
+                first_ = second_ = nullptr;
+                return;
+            }
+            current_.kind = static_cast<difference_kind>(kind);
+            current_.first = detail::make_package(diff.first);
+            current_.second = detail::make_package(diff.second);
+        }
+
+        const pcompare_branch_t *first_ = nullptr;     //first branch, nullptr for the end iterator
+        const pcompare_branch_t *second_ = nullptr;    //second branch
+        int                     filter_ = 0;            //PCOMPARE_DIFF_* kind to iterate, 0 for all kinds
+        pcompare_diff_cursor_t  cursor_ = {};           //comparison position
+        difference              current_ = {};          //current difference
+    };
+
+    difference_range(const pcompare_branch_t *first, const pcompare_branch_t *second, const int filter) noexcept
+        : first_(first), second_(second), filter_(filter) {}
+
+    iterator begin() const { return (first_ && second_) ? iterator(first_, second_, filter_) : iterator(); }
+    iterator end() const noexcept { return iterator(); }
+
+private:
+    const pcompare_branch_t *first_;    //first branch
+    const pcompare_branch_t *second_;   //second branch
+    int                     filter_;    //PCOMPARE_DIFF_* kind to iterate, 0 for all kinds
+};
+
+//comparison of two branches, move-only owner of references to both branches
+class comparison
+{
+public:
+    comparison(const branch &first, const branch &second)
+    {
+        if (!first || !second)
+            throw error("comparison of an empty branch");
+        first_ = pcompare_branch_ref(first.get());
+        second_ = pcompare_branch_ref(second.get());
+    }
+    comparison(const comparison &) = delete;
+    comparison &operator=(const comparison &) = delete;
+    comparison(comparison &&other) noexcept
+        : first_(std::exchange(other.first_, nullptr)), second_(std::exchange(other.second_, nullptr)) {}
+    comparison &operator=(comparison &&other) noexcept
+    {
+        if (this != &other)
+        {
+            pcompare_branch_release(first_);
+            pcompare_branch_release(second_);
+            first_ = std::exchange(other.first_, nullptr);
+            second_ = std::exchange(other.second_, nullptr);
+        }
+        return *this;
+    }
+    ~comparison()
+    {
+        pcompare_branch_release(first_);
+        pcompare_branch_release(second_);
+    }
+
+    /**
+     * @brief differences   returns all differences in the packages names order
+     */
+    difference_range differences() const noexcept { return difference_range(first_, second_, 0); }
+    difference_range only_in_first() const noexcept { return difference_range(first_, second_, PCOMPARE_DIFF_ONLY_IN_FIRST); }
+    difference_range only_in_second() const noexcept { return difference_range(first_, second_, PCOMPARE_DIFF_ONLY_IN_SECOND); }
+    difference_range newer_in_first() const noexcept { return difference_range(first_, second_, PCOMPARE_DIFF_NEWER_IN_FIRST); }
+
+    difference_range::iterator begin() const { return differences().begin(); }
+    difference_range::iterator end() const noexcept { return differences().end(); }
+
+    /**
+     * @brief write     outputs the JSON report of the comparison (a summary with the summary option)
+     */
+    void write(FILE *out, const pcompare_options_t *options = nullptr) const
+    {
+        if (pcompare_compare(first_, second_, out, options) != SUCCESS)
+            throw error("could not output the comparison report");
+    }
+
+private:
+    pcompare_branch_t *first_ = nullptr;    //first branch reference
+    pcompare_branch_t *second_ = nullptr;   //second branch reference
+};
+
+//asynchronous comparison job, move-only owner of the job handle
+class job
+{
+public:
+    /**
+     * @brief job   starts an asynchronous comparison, report_file nullptr keeps the report in memory
+     */
+    job(const char *branch1, const char *branch2, const char *report_file = nullptr,
+        const pcompare_options_t *options = nullptr)
+        : handle_(pcompare_start(branch1, branch2, report_file, options))
+    {
+        if (!handle_)
+            throw error("could not start a comparison job");
+    }
+    job(const job &) = delete;
+    job &operator=(const job &) = delete;
+    job(job &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    job &operator=(job &&other) noexcept
+    {
+        if (this != &other)
+        {
+            pcompare_job_free(handle_);
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~job() { pcompare_job_free(handle_); }
+
+    int fd() const noexcept { return pcompare_job_fd(handle_); }
+    int poll(pcompare_progress_t *progress = nullptr) noexcept { return pcompare_poll(handle_, progress); }
+    void cancel() noexcept { pcompare_cancel(handle_); }
+
+    /**
+     * @brief report    returns the in-memory report owned by the job, empty while the job is not done
+     */
+    std::string_view report() const noexcept
+    {
+        std::size_t size = 0;
+        const char *report = pcompare_job_report(handle_, &size);
+        return report ? std::string_view(report, size) : std::string_view();
+    }
+
+private:
+    pcompare_job_t *handle_;    //job handle
+};
+
+} //namespace pcompare
+
+#endif //__PCOMPARE_HPP_
@@ -0,0 +1,94 @@
+#ifndef __REPORT_H_
+#define __REPORT_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Comparison report format shared by the in-memory and the external comparison
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#define N_OUT_PARAMS                    3       // number of package's parameters to output
+
+#define REPORT_LENGTH_FORMAT            "\"length\": %lu,\n"
+#define REPORT_ABSENT_HEADER_FORMAT     "\"absent_in_%s_packages\":[\n"
+#define REPORT_NEWER_HEADER_FORMAT      "\"%s_packages_newer_versions\":[\n"
+#define REPORT_PACKAGE_FORMAT           "{\n    \"%s\":\"%s\",\n    \"%s\":\"%s\",\n    \"%s\":\"%s\"\n}"
+#define REPORT_PACKAGES_SEPARATOR       ",\n"
+
+#define SUMMARY_ABSENT_HEADER_FORMAT    "\"absent_in_%s_packages\":{\n"
+#define SUMMARY_NEWER_HEADER_FORMAT     "\"%s_packages_newer_versions\":{\n"
+#define SUMMARY_LENGTH_FORMAT           "    \"length\": %lu,\n    \"arch\":{"
+#define SUMMARY_ARCH_FORMAT             "%s\n        \"%.*s\": %lu"
+#define SUMMARY_ARRAY_END               "\n    }\n}"
+
+extern const char *ARCH_TAG;
+extern const char *NAME_TAG;
+extern const char *VERSION_TAG;
+extern const char *PACKAGES_TAG;
+
+/**
+ * @brief report_package    outputs one package of a report array (without separator)
+ * @param out               output stream
+ * @param name              package name
+ * @param version           package version
+ * @param arch              package architecture
+ */
+static inline void report_package(FILE *out, const char *name, const char *version, const char *arch)
+{
+    fprintf(out, REPORT_PACKAGE_FORMAT, NAME_TAG, name, VERSION_TAG, version, ARCH_TAG, arch);
+}
+
+/**
+ * @brief report_copy   copies a string to a buffer
+ * @return              pointer past the copied string
+ */
+static inline char *report_copy(char *p, const char *str, const size_t len)
+{
+    memcpy(p, str, len);
+    return p + len;
+}
+
+/**
+ * @brief report_package_size   returns size of a package formatted by report_package_format
+ * @param tags_len              total length of the NAME_TAG, VERSION_TAG and ARCH_TAG tags
+ * @param values_len            total length of the package name, version and architecture
+ * @return                      formatted package size
+ */
+static inline size_t report_package_size(const size_t tags_len, const size_t values_len)
+{
+    /* a tag and a value "%s" of every parameter are replaced */
+    return sizeof(REPORT_PACKAGE_FORMAT) - 1 - 2 * N_OUT_PARAMS * (sizeof("%s") - 1) + tags_len + values_len;
+}
+
+/**
+ * @brief report_package_format formats one package of a report array to a buffer the same as report_package does
+ * @param p                     buffer of report_package_size bytes
+ * @param name                  package name
+ * @param name_len              package name length
+ * @param version               package version
+ * @param version_len           package version length
+ * @param arch                  package architecture
+ * @param arch_len              package architecture length
+ * @return                      pointer past the formatted package
+ */
+static inline char *report_package_format(char *p, const char *name, const size_t name_len,
+                                          const char *version, const size_t version_len,
+                                          const char *arch, const size_t arch_len)
+{
+    p = report_copy(p, "{\n    \"", 7);
+    p = report_copy(p, NAME_TAG, strlen(NAME_TAG));
+    p = report_copy(p, "\":\"", 3);
+    p = report_copy(p, name, name_len);
+    p = report_copy(p, "\",\n    \"", 8);
+    p = report_copy(p, VERSION_TAG, strlen(VERSION_TAG));
+    p = report_copy(p, "\":\"", 3);
+    p = report_copy(p, version, version_len);
+    p = report_copy(p, "\",\n    \"", 8);
+    p = report_copy(p, ARCH_TAG, strlen(ARCH_TAG));
+    p = report_copy(p, "\":\"", 3);
+    p = report_copy(p, arch, arch_len);
+    return report_copy(p, "\"\n}", 3);
+}
+
+#endif //__REPORT_H_
@@ -0,0 +1,316 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Content-addressed cache of comparison reports
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "pcompare.h"
+#include "sha256.h"
+#include "thread_pool.h"
+#include "result_cache.h"
+
+#define COPY_BUFFER_SIZE        (64 * 1024)
+#define REPORT_SUFFIX           ".json"
+#define DIGEST_MEMO_SUFFIX      ".json.sha256"
+
+//branch file digest task parameters
+typedef struct
+{
+    const f_param_t *fparam;                //opened branch file
+    char            hex[SHA256_HEX_SIZE];   //digest of the file
+    int             result;                 //SUCCESS or ERROR
+}digest_parameter_t;
+
+//cached report for eviction
+typedef struct
+{
+    char            name[SHA256_HEX_SIZE + sizeof(REPORT_SUFFIX)];  //file name
+    struct timespec mtime;                                          //last use time
+    off_t           size;                                           //file size
+}cache_entry_t;
+
+/**
+ * @brief timespec_older    checks that a time is strictly older than another one
+ * @param a                 pointer to the first time
+ * @param b                 pointer to the second time
+ * @return                  1 if a is older than b, 0 otherwise
+ */
+static int timespec_older(const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec < b->tv_sec) || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/**
+ * @brief file_digest_task  thread pool task, returns memoized or computes SHA-256 of a branch file
+ * @param param             pointer to a digest_parameter_t structure
+ */
+static void file_digest_task(void *param)
+{
+    digest_parameter_t *dp = (digest_parameter_t *)param;
+    const f_param_t *fparam = dp->fparam;
+    char memo_name[PATH_MAX], tmp_name[PATH_MAX];
+    struct stat st;
+    dp->result = ERROR;
+
+    if (fstat(fparam->fd, &st) != 0 ||
+        snprintf(memo_name, sizeof(memo_name), "%s" DIGEST_MEMO_SUFFIX, fparam->pack_name) >= (int)sizeof(memo_name))
+        return;
+
+    /* The memo is valid for the same file size, modification and status change times and inode */
+    FILE *memo = fopen(memo_name, "r");
+    if (memo)
+    {
+        unsigned long long size, ino;
+        long long sec, csec;
+        long nsec, cnsec;
+        const int n = fscanf(memo, "%64s %llu %lld %ld %llu %lld %ld", dp->hex, &size, &sec, &nsec, &ino, &csec, &cnsec);
+        fclose(memo);
+        if (n == 7 && strlen(dp->hex) == SHA256_HEX_SIZE - 1 && size == (unsigned long long)st.st_size &&
+            sec == (long long)st.st_mtim.tv_sec && nsec == st.st_mtim.tv_nsec && ino == (unsigned long long)st.st_ino &&
+            csec == (long long)st.st_ctim.tv_sec && cnsec == st.st_ctim.tv_nsec)
+        {
+            dp->result = SUCCESS;
+            return;
+        }
+    }
+
+    sha256_t ctx;
+    uint8_t digest[SHA256_SIZE];
+    sha256_init(&ctx);
+    sha256_update(&ctx, fparam->fptr, fparam->size);
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, dp->hex);
+    dp->result = SUCCESS;
+
+    /* The memo is replaced atomically, a failure to write it is not an error */
+    if (snprintf(tmp_name, sizeof(tmp_name), "%s.XXXXXX", memo_name) >= (int)sizeof(tmp_name))
+        return;
+    int fd = mkstemp(tmp_name);
+    memo = (fd >= 0) ? fdopen(fd, "w") : NULL;
+    if (!memo)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(tmp_name);
+        }
+        return;
+    }
+    fchmod(fd, 0644);
+    fprintf(memo, "%s %llu %lld %ld %llu %lld %ld\n", dp->hex, (unsigned long long)st.st_size,
+            (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec, (unsigned long long)st.st_ino,
+            (long long)st.st_ctim.tv_sec, st.st_ctim.tv_nsec);
+    /* A racy memo is not written: a file changed within the timestamp granularity of the memo writing
+       could keep its times, so they must be strictly older than the memo time */
+    struct stat memo_st;
+    const int racy = (fflush(memo) != 0 || fstat(fd, &memo_st) != 0 ||
+                      !timespec_older(&st.st_mtim, &memo_st.st_mtim) || !timespec_older(&st.st_ctim, &memo_st.st_mtim));
+    if ((fclose(memo) != 0) || racy || (rename(tmp_name, memo_name) != 0))
+        unlink(tmp_name);
+}
+
+/**
+ * @brief report_key    computes the cache key of a comparison
+ * @param variant       report variant
+ * @param fparam        pointer to an array of 2 opened f_param_t structures
+ * @param key           buffer of SHA256_HEX_SIZE bytes for the key
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int report_key(const char *variant, const f_param_t *fparam, char *key)
+{
+    digest_parameter_t params[N_BRANCHES_TO_COMPARE_SUPPORTED];
+    tpool_group_t group;
+    size_t i;
+
+    tpool_group_init(&group);
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+    {
+        params[i].fparam = &fparam[i];
+        params[i].result = ERROR;
+        tpool_submit(&group, file_digest_task, &params[i]);
+    }
+    tpool_group_wait(&group);
+
+    sha256_t ctx;
+    uint8_t digest[SHA256_SIZE];
+    sha256_init(&ctx);
+    sha256_update(&ctx, RESULT_CACHE_FORMAT, sizeof(RESULT_CACHE_FORMAT));
+    sha256_update(&ctx, variant, strlen(variant) + 1);
+    for (i = 0; i < N_BRANCHES_TO_COMPARE_SUPPORTED; ++i)
+    {
+        if (params[i].result != SUCCESS)
+            return ERROR;
+        /* Names are a part of the report, so they are a part of the key */
+        sha256_update(&ctx, fparam[i].pack_name, strlen(fparam[i].pack_name) + 1);
+        sha256_update(&ctx, params[i].hex, SHA256_HEX_SIZE);
+    }
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, key);
+    return SUCCESS;
+}
+
+/**
+ * @brief stream_file   outputs a file to a stream, with sendfile if the stream has a file descriptor
+ * @param fd            file descriptor
+ * @param size          file size
+ * @param out           output stream
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int stream_file(const int fd, const size_t size, FILE *out)
+{
+    off_t offset = 0;
+    const int out_fd = fileno(out);
+
+    if (fflush(out) != 0)
+        return ERROR;
+    while (out_fd >= 0 && (size_t)offset < size)
+    {
+        const ssize_t n = sendfile(out_fd, fd, &offset, size - offset);
+        if (n > 0) continue;
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS) && !offset) break;   //not supported: copy below
+        return ERROR;
+    }
+
+    char buffer[COPY_BUFFER_SIZE];
+    while ((size_t)offset < size)
+    {
+        const ssize_t n = pread(fd, buffer, sizeof(buffer), offset);
+        if (n <= 0)
+            return ERROR;
+        if (fwrite(buffer, 1, n, out) != (size_t)n)
+            return ERROR;
+        offset += n;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief compare_entries   qsort comparator of cache entries by the last use time
+ */
+static int compare_entries(const void *a, const void *b)
+{
+    const struct timespec *ta = &((const cache_entry_t *)a)->mtime;
+    const struct timespec *tb = &((const cache_entry_t *)b)->mtime;
+    if (ta->tv_sec != tb->tv_sec)
+        return (ta->tv_sec > tb->tv_sec) - (ta->tv_sec < tb->tv_sec);
+    return (ta->tv_nsec > tb->tv_nsec) - (ta->tv_nsec < tb->tv_nsec);
+}
+
+/**
+ * @brief evict     removes the least recently used reports until the cache fits its limit
+ * @param dir       cache directory
+ * @param max_size  cache size limit in bytes
+ */
+static void evict(const char *dir, const size_t max_size)
+{
+    cache_entry_t *entries = NULL;
+    size_t n = 0, capacity = 0;
+    off_t total = 0;
+    struct dirent *de;
+    struct stat st;
+
+    DIR *d = opendir(dir);
+    if (!d) return;
+    while ((de = readdir(d)))
+    {
+        const size_t len = strlen(de->d_name);
+        if (len != SHA256_HEX_SIZE - 1 + strlen(REPORT_SUFFIX) ||
+            strcmp(de->d_name + SHA256_HEX_SIZE - 1, REPORT_SUFFIX) ||
+            fstatat(dirfd(d), de->d_name, &st, 0) != 0)
+            continue;
+        if (n == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            cache_entry_t *p = realloc(entries, capacity * sizeof(cache_entry_t));
+            if (!p) break;
+            entries = p;
+        }
+        memcpy(entries[n].name, de->d_name, len + 1);
+        entries[n].mtime = st.st_mtim;
+        entries[n].size = st.st_size;
+        total += st.st_size;
+        ++n;
+    }
+    if ((size_t)total > max_size)
+    {
+        qsort(entries, n, sizeof(cache_entry_t), compare_entries);
+        for (size_t i = 0; i < n && (size_t)total > max_size; ++i)
+        {
+            if (unlinkat(dirfd(d), entries[i].name, 0) == 0)
+                total -= entries[i].size;
+        }
+    }
+    closedir(d);
+    free(entries);
+}
+
+int result_cache_compare(const char *dir, const size_t max_size, const char *variant, FILE *out,
+                         const f_param_t *fparam, result_cache_compare_fn compare,
+                         const pcompare_options_t *options)
+{
+    char key[SHA256_HEX_SIZE];
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+    struct stat st;
+
+    if (report_key(variant, fparam, key) != SUCCESS ||
+        snprintf(path, sizeof(path), "%s/%s" REPORT_SUFFIX, dir, key) >= (int)sizeof(path) ||
+        snprintf(tmp_path, sizeof(tmp_path), "%s/tmp-XXXXXX", dir) >= (int)sizeof(tmp_path))
+        return compare(out, fparam, options);
+
+    /* Hit: the report is streamed as is, its time is updated for LRU eviction */
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0)
+    {
+        int res = ERROR;
+        if (fstat(fd, &st) == 0)
+        {
+            /* The note goes to stderr ahead of the report, the output keeps the report only */
+            fprintf(stderr, "Report is taken from the cache \"%s\"\n", path);
+            res = stream_file(fd, st.st_size, out);
+        }
+        futimens(fd, NULL);
+        close(fd);
+        return res;
+    }
+
+    /* Miss: the report is written to a temporary file of the cache, output and published by rename */
+    fd = mkstemp(tmp_path);
+    FILE *tmp = (fd >= 0) ? fdopen(fd, "w") : NULL;
+    if (!tmp)
+    {
+        printf("Could not create a report in the cache \"%s\": %s\n", dir, strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(tmp_path);
+        }
+        return compare(out, fparam, options);
+    }
+    int res = compare(tmp, fparam, options);
+    if (fflush(tmp) != 0 || fstat(fd, &st) != 0)
+        res = ERROR;
+    if (res == SUCCESS)
+        res = stream_file(fd, st.st_size, out);
+    if (res == SUCCESS)
+        fchmod(fd, 0644);
+    if (fclose(tmp) != 0)
+        res = ERROR;
+    if (res != SUCCESS || rename(tmp_path, path) != 0)
+    {
+        unlink(tmp_path);
+        return res;
+    }
+    if (max_size)
+        evict(dir, max_size);
+    return SUCCESS;
+}
@@ -0,0 +1,37 @@
+#ifndef __RESULT_CACHE_H_
+#define __RESULT_CACHE_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Content-addressed cache of comparison reports.
+ * A report is stored as "<dir>/<key>.json" where the key is SHA-256 of the report format version,
+ * the report variant, the branches names and SHA-256 digests of the branches files. A branch file digest is memoized
+ * in the "<branch>.json.sha256" sidecar file and is recomputed only when the file size,
+ * modification or status change time or inode are changed; the memo is not written while the file times
+ * are not older than the memo time, so a change within the timestamp granularity is never missed. Cache hits are streamed to the output with sendfile,
+ * the least recently used reports are evicted when the cache is larger than its limit.
+ */
+
+#include <stdio.h>
+#include "pcompare.h"
+
+#define RESULT_CACHE_FORMAT     "pcompare-report-1"     // report format version, a part of the key
+
+//comparison function producing a report to be cached
+typedef int (*result_cache_compare_fn)(FILE *out, const f_param_t *fparam, const pcompare_options_t *options);
+
+/**
+ * @brief result_cache_compare  outputs a cached report of two branches or compares them and caches the report
+ * @param dir                   cache directory
+ * @param max_size              cache size limit in bytes, 0 means unlimited
+ * @param variant               report variant (e.g. a full report or a summary), a part of the key
+ * @param out                   output stream
+ * @param fparam                pointer to an array of 2 opened f_param_t structures
+ * @param compare               comparison function to call on a cache miss
+ * @param options               comparison options passed to the comparison function
+ * @return                      SUCCESS code on success, ERROR code otherwise
+ */
+int result_cache_compare(const char *dir, const size_t max_size, const char *variant, FILE *out,
+                         const f_param_t *fparam, result_cache_compare_fn compare,
+                         const pcompare_options_t *options);
+
+#endif //__RESULT_CACHE_H_
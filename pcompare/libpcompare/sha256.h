@@ -0,0 +1,51 @@
+#ifndef __SHA256_H_
+#define __SHA256_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * SHA-256 (FIPS 180-4) digest
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE         32                      // digest size in bytes
+#define SHA256_HEX_SIZE     (2 * SHA256_SIZE + 1)   // hex digest size with the terminating zero
+
+//hashing context
+typedef struct
+{
+    uint32_t    state[8];       //intermediate hash
+    uint64_t    length;         //hashed bytes
+    uint8_t     block[64];      //incomplete block
+    size_t      block_size;     //bytes in the incomplete block
+}sha256_t;
+
+/**
+ * @brief sha256_init   initiates a hashing context
+ * @param ctx           pointer to a sha256_t structure
+ */
+void sha256_init(sha256_t *ctx);
+
+/**
+ * @brief sha256_update     hashes data
+ * @param ctx               pointer to a sha256_t structure
+ * @param data              data
+ * @param size              data size
+ */
+void sha256_update(sha256_t *ctx, const void *data, size_t size);
+
+/**
+ * @brief sha256_final  finishes hashing
+ * @param ctx           pointer to a sha256_t structure
+ * @param digest        buffer for the digest of SHA256_SIZE bytes
+ */
+void sha256_final(sha256_t *ctx, uint8_t *digest);
+
+/**
+ * @brief sha256_hex    converts a digest to a hex string
+ * @param digest        digest of SHA256_SIZE bytes
+ * @param hex           buffer of SHA256_HEX_SIZE bytes
+ */
+void sha256_hex(const uint8_t *digest, char *hex);
+
+#endif //__SHA256_H_
@@ -0,0 +1,304 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Work-stealing worker pool of the libpcompare library
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pcompare.h"
+#include "thread_pool.h"
+
+#define DEQUE_INIT_CAPACITY     64
+#define MAX_THREADS             256
+#define NO_WORKER               ((size_t)-1)
+
+//structure to store a queued task
+typedef struct
+{
+    tpool_task_fn   fn;         //task function
+    void            *arg;       //task function argument
+    tpool_group_t   *group;     //group the task belongs to
+}task_t;
+
+//double-ended tasks queue (ring buffer)
+typedef struct
+{
+    pthread_mutex_t lock;
+    task_t          *tasks;     //ring buffer
+    size_t          capacity;   //ring buffer capacity
+    size_t          top;        //index of the oldest task
+    size_t          count;      //number of queued tasks
+}deque_t;
+
+//structure to store the pool state
+typedef struct
+{
+    pthread_mutex_t idle_lock;  //protects sleeping and waking up
+    pthread_cond_t  wake;       //signalled on new tasks and on finished groups
+    size_t          queued;     //number of tasks in all deques (atomic)
+    size_t          n_threads;  //number of started workers
+    deque_t         *deques;    //n_threads workers' deques and the injection queue at the end
+}pool_t;
+
+static pool_t           pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, NULL };
+static pthread_once_t   pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t  config_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t           config_threads = 0;
+static int              pool_started = 0;
+static __thread size_t  current_worker = NO_WORKER;
+
+/**
+ * @brief deque_push_bottom     pushes a task to the bottom of the deque
+ * @param dq                    pointer to a deque_t structure
+ * @param task                  pointer to a task to push
+ * @return                      SUCCESS on success, ERROR on memory allocation error
+ */
+static int deque_push_bottom(deque_t *dq, const task_t *task)
+{
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->capacity)
+    {
+        size_t new_capacity = dq->capacity ? dq->capacity * 2 : DEQUE_INIT_CAPACITY;
+        task_t *tasks = malloc(new_capacity * sizeof(task_t));
+        if (!tasks)
+        {
+            pthread_mutex_unlock(&dq->lock);
+            return ERROR;
+        }
+        for (size_t i = 0; i < dq->count; ++i)
+            tasks[i] = dq->tasks[(dq->top + i) % dq->capacity];
+        free(dq->tasks);
+        dq->tasks = tasks;
+        dq->capacity = new_capacity;
+        dq->top = 0;
+    }
+    dq->tasks[(dq->top + dq->count) % dq->capacity] = *task;
+    ++dq->count;
+    pthread_mutex_unlock(&dq->lock);
+    return SUCCESS;
+}
+
+/**
+ * @brief deque_pop     takes a task from the deque. The end task is taken in O(1); only a group waiter
+ *                      may take a task from the middle, then the gap is closed by moving the following tasks
+ * @param dq            pointer to a deque_t structure
+ * @param from_bottom   1 to take the newest task (owner), 0 to take the oldest one (thief)
+ * @param group         group the task must belong to, NULL for any task
+ * @param task          pointer to store the task
+ * @return              1 if the task was taken, 0 if the deque has no suitable task
+ */
+static int deque_pop(deque_t *dq, const int from_bottom, const tpool_group_t *group, task_t *task)
+{
+    int taken = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count)
+    {
+        const size_t end = from_bottom ? (dq->top + dq->count - 1) % dq->capacity : dq->top;
+        if (!group || dq->tasks[end].group == group)
+        {
+            *task = dq->tasks[end];
+            if (!from_bottom)
+                dq->top = (dq->top + 1) % dq->capacity;
+            --dq->count;
+            taken = 1;
+        }
+    }
+    for (size_t i = 1; !taken && i < dq->count; ++i)
+    {
+        size_t pos = from_bottom ? dq->count - 1 - i : i;
+        if (dq->tasks[(dq->top + pos) % dq->capacity].group != group)
+            continue;
+        *task = dq->tasks[(dq->top + pos) % dq->capacity];
+        /* Close the gap by moving the tasks that follow the taken one */
+        for (; pos + 1 < dq->count; ++pos)
+            dq->tasks[(dq->top + pos) % dq->capacity] = dq->tasks[(dq->top + pos + 1) % dq->capacity];
+        --dq->count;
+        taken = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return taken;
+}
+
+/**
+ * @brief take_task     takes a task: own deque first, then the injection queue, then steals from other workers
+ * @param self          worker index, NO_WORKER for non-worker threads
+ * @param group         group the task must belong to, NULL for any task
+ * @param task          pointer to store the task
+ * @return              1 if a task was taken, 0 otherwise
+ */
+static int take_task(const size_t self, const tpool_group_t *group, task_t *task)
+{
+    const size_t n = pool.n_threads;
+    int taken = 0;
+
+    if (!__atomic_load_n(group ? &group->queued : &pool.queued, __ATOMIC_ACQUIRE))
+        return 0;
+
+    if (self != NO_WORKER)
+        taken = deque_pop(&pool.deques[self], 1, group, task);
+    if (!taken)
+        taken = deque_pop(&pool.deques[n], 0, group, task);
+    for (size_t i = 1; !taken && i <= n; ++i)
+    {
+        size_t victim = (self == NO_WORKER) ? i - 1 : (self + i) % n;
+        if (victim != self)
+            taken = deque_pop(&pool.deques[victim], 0, group, task);
+    }
+    if (taken)
+    {
+        __atomic_fetch_sub(&pool.queued, 1, __ATOMIC_ACQ_REL);
+        __atomic_fetch_sub(&task->group->queued, 1, __ATOMIC_ACQ_REL);
+    }
+    return taken;
+}
+
+/**
+ * @brief run_task  executes a task and updates its group
+ * @param task      pointer to a task_t structure
+ */
+static void run_task(const task_t *task)
+{
+    task->fn(task->arg);
+    if (__atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pthread_mutex_lock(&pool.idle_lock);
+        pthread_cond_broadcast(&pool.wake);
+        pthread_mutex_unlock(&pool.idle_lock);
+    }
+}
+
+/**
+ * @brief worker_thread     worker main loop
+ * @param param             worker index
+ * @return                  never returns
+ */
+static void * worker_thread(void *param)
+{
+    current_worker = (size_t)param;
+    task_t task;
+    while (1)
+    {
+        if (take_task(current_worker, NULL, &task))
+        {
+            run_task(&task);
+            continue;
+        }
+        pthread_mutex_lock(&pool.idle_lock);
+        while (!__atomic_load_n(&pool.queued, __ATOMIC_ACQUIRE))
+            pthread_cond_wait(&pool.wake, &pool.idle_lock);
+        pthread_mutex_unlock(&pool.idle_lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief pool_start    creates worker threads, called once per process
+ */
+static void pool_start(void)
+{
+    pthread_mutex_lock(&config_lock);
+    size_t n_threads = config_threads;
+    pool_started = 1;
+    pthread_mutex_unlock(&config_lock);
+
+    if (!n_threads)
+    {
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (n_cpus > 0) ? (size_t)n_cpus : 1;
+    }
+    if (n_threads > MAX_THREADS) n_threads = MAX_THREADS;
+
+    pool.deques = calloc(n_threads + 1, sizeof(deque_t));
+    if (!pool.deques)
+    {
+        printf("Thread pool: memory allocation error, tasks will be executed synchronously\n");
+        return;
+    }
+    for (size_t i = 0; i <= n_threads; ++i)
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    size_t started = 0;
+    for (; started < n_threads; ++started)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, worker_thread, (void *)started) != 0)
+        {
+            printf("Thread pool: only %lu of %lu threads were created\n", started, n_threads);
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    /* The injection queue is the deque right after the last started worker */
+    __atomic_store_n(&pool.n_threads, started, __ATOMIC_RELEASE);
+}
+
+int tpool_set_threads(const size_t n_threads)
+{
+    int res = SUCCESS;
+    pthread_mutex_lock(&config_lock);
+    if (pool_started)
+        res = ERROR;
+    else
+        config_threads = n_threads;
+    pthread_mutex_unlock(&config_lock);
+    return res;
+}
+
+size_t tpool_threads(void)
+{
+    pthread_once(&pool_once, pool_start);
+    return __atomic_load_n(&pool.n_threads, __ATOMIC_ACQUIRE);
+}
+
+void tpool_group_init(tpool_group_t *group)
+{
+    group->pending = 0;
+    group->queued = 0;
+}
+
+int tpool_submit(tpool_group_t *group, tpool_task_fn fn, void *arg)
+{
+    task_t task = { fn, arg, group };
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch(&group->queued, 1, __ATOMIC_ACQ_REL);
+
+    const size_t n = tpool_threads();
+    deque_t *dq = NULL;
+    if (n)
+        dq = &pool.deques[(current_worker != NO_WORKER) ? current_worker : n];
+    if (!dq || (deque_push_bottom(dq, &task) != SUCCESS))
+    {
+        __atomic_sub_fetch(&group->queued, 1, __ATOMIC_ACQ_REL);
+        run_task(&task);    //no workers or no memory: execute synchronously
+        return SUCCESS;
+    }
+
+    pthread_mutex_lock(&pool.idle_lock);
+    __atomic_add_fetch(&pool.queued, 1, __ATOMIC_ACQ_REL);
+    /* Wake everybody: a group waiter may be the only thread allowed to take the task */
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.idle_lock);
+    return SUCCESS;
+}
+
+void tpool_group_wait(tpool_group_t *group)
+{
+    task_t task;
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE))
+    {
+        if (tpool_threads() && take_task(current_worker, group, &task))
+        {
+            run_task(&task);
+            continue;
+        }
+        pthread_mutex_lock(&pool.idle_lock);
+        while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) &&
+               !__atomic_load_n(&group->queued, __ATOMIC_ACQUIRE))
+            pthread_cond_wait(&pool.wake, &pool.idle_lock);
+        pthread_mutex_unlock(&pool.idle_lock);
+    }
+}
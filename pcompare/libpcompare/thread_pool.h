@@ -0,0 +1,62 @@
+#ifndef __THREAD_POOL_H_
+#define __THREAD_POOL_H_
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Process wide fixed-size worker pool of the libpcompare library.
+ * Every worker owns a task deque: it pushes and pops own tasks from the bottom (LIFO)
+ * and steals tasks of other workers from the top (FIFO) when its deque is empty.
+ * Tasks submitted from a non-worker thread go to a shared injection queue.
+ * Threads are created once, on the first submitted task.
+ */
+
+#include <stddef.h>
+
+//task function type
+typedef void (*tpool_task_fn)(void *arg);
+
+//group of tasks that can be waited for together
+typedef struct
+{
+    size_t pending;     //number of submitted and not finished tasks (atomic)
+    size_t queued;      //number of submitted and not started tasks (atomic)
+}tpool_group_t;
+
+/**
+ * @brief tpool_set_threads     sets number of worker threads, must be called before the first task submission
+ * @param n_threads             number of workers, 0 means number of online CPUs
+ * @return                      SUCCESS on success, ERROR if the pool is already started
+ */
+int tpool_set_threads(const size_t n_threads);
+
+/**
+ * @brief tpool_threads     returns number of worker threads (starts the pool if needed)
+ * @return                  number of workers, 0 if threads could not be created
+ */
+size_t tpool_threads(void);
+
+/**
+ * @brief tpool_group_init  initiates a tasks group
+ * @param group             pointer to a tpool_group_t structure
+ */
+void tpool_group_init(tpool_group_t *group);
+
+/**
+ * @brief tpool_submit  submits a task to the pool
+ *                      (the task is executed in the calling thread if the pool has no workers)
+ * @param group         group the task belongs to
+ * @param fn            task function
+ * @param arg           task function argument
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+int tpool_submit(tpool_group_t *group, tpool_task_fn fn, void *arg);
+
+/**
+ * @brief tpool_group_wait  waits until all tasks of the group are finished.
+ *                          The calling thread executes queued tasks of this group only
+ *                          while waiting, so it is safe to wait from inside a task:
+ *                          a foreign task that blocks can't be stacked on the waiter.
+ * @param group             pointer to a tpool_group_t structure
+ */
+void tpool_group_wait(tpool_group_t *group);
+
+#endif //__THREAD_POOL_H_
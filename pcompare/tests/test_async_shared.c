@@ -0,0 +1,204 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Test of asynchronous jobs sharing an unsorted branch.
+ * The first job loading the branch sorts it on the thread pool, other jobs of the same
+ * branch must wait for the load on their own workers instead of hanging the loader.
+ * Jobs with the reports cache store and reuse the report.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include "pcompare.h"
+
+#define N_JOBS          8
+#define N_LETTERS       8
+#define N_PER_LETTER    20000       // enough for the parallel radix sort of every letter bucket
+#define JOB_TIMEOUT_MS  60000
+
+/**
+ * @brief write_branch  writes a branch export file
+ * @param dir           directory of the file
+ * @param name          branch name
+ * @param reversed      1 to write the packages in descending order, 0 in ascending one
+ * @param n_per_letter  number of packages per name first letter
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int write_branch(const char *dir, const char *name, const int reversed, const int n_per_letter)
+{
+    char path[PATH_MAX];
+    const int total = N_LETTERS * n_per_letter;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        printf("Could not create \"%s\"\n", path);
+        return ERROR;
+    }
+    fprintf(f, "{\"request_args\": {}, \"length\": %d, \"packages\": [", total);
+    for (int i = 0; i < total; ++i)
+    {
+        const int k = reversed ? total - 1 - i : i;
+        fprintf(f, "%s{\"name\": \"%c-package-%06d\", \"epoch\": 0, \"version\": \"1.%d\", "
+                   "\"release\": \"alt1\", \"arch\": \"x86_64\", \"disttag\": \"\", "
+                   "\"buildtime\": 0, \"source\": \"\"}",
+                i ? ", " : "", 'a' + k / n_per_letter, k % n_per_letter, reversed);
+    }
+    fprintf(f, "]}\n");
+    return (fclose(f) == 0) ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief run_job   runs a job of the two branches to the end
+ * @param options   pointer to comparison options
+ * @param report    pointer to the allocated report copy
+ * @param size      pointer to the report size
+ * @return          SUCCESS if the job is done, ERROR otherwise
+ */
+static int run_job(const pcompare_options_t *options, char **report, size_t *size)
+{
+    pcompare_job_t *job = pcompare_start("unsorted", "sorted", NULL, options);
+    if (!job) return ERROR;
+    struct pollfd fd = { pcompare_job_fd(job), POLLIN, 0 };
+    int state = PCOMPARE_JOB_LOADING;
+    while (state >= 0 && state < PCOMPARE_JOB_DONE && poll(&fd, 1, JOB_TIMEOUT_MS) > 0)
+        state = pcompare_poll(job, NULL);
+    const char *data = pcompare_job_report(job, size);
+    *report = (state == PCOMPARE_JOB_DONE && data) ? malloc(*size) : NULL;
+    if (*report)
+        memcpy(*report, data, *size);
+    pcompare_job_free(job);
+    return *report ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief count_reports     counts report files of a cache directory
+ * @param dir               cache directory
+ * @return                  number of "*.json" files
+ */
+static int count_reports(const char *dir)
+{
+    int n = 0;
+    DIR *d = opendir(dir);
+    if (!d) return 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)))
+    {
+        const size_t len = strlen(entry->d_name);
+        if (len > 5 && !strcmp(entry->d_name + len - 5, ".json"))
+            ++n;
+    }
+    closedir(d);
+    return n;
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/pcompare-test-XXXXXX";
+    char url[PATH_MAX + 16];
+    pcompare_job_t *jobs[N_JOBS];
+    int done[N_JOBS] = {0};
+    int res = SUCCESS;
+
+    if (!mkdtemp(dir) || chdir(dir) != 0)
+    {
+        printf("Could not create a temporary directory\n");
+        return EXIT_FAILURE;
+    }
+    if (write_branch(dir, "unsorted", 1, N_PER_LETTER) != SUCCESS ||
+        write_branch(dir, "sorted", 0, N_PER_LETTER / 4) != SUCCESS)
+        return EXIT_FAILURE;
+    snprintf(url, sizeof(url), "file://%s", dir);
+    const pcompare_options_t options = { url, 0, NULL, 0, 0 };
+    if (pcompare_set_threads(4) != SUCCESS)
+        return EXIT_FAILURE;
+
+    for (int i = 0; i < N_JOBS; ++i)
+    {
+        jobs[i] = (i % 2) ? pcompare_start("sorted", "unsorted", NULL, &options)
+                          : pcompare_start("unsorted", "sorted", NULL, &options);
+        if (!jobs[i])
+        {
+            printf("Job %d was not started\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (int left = N_JOBS; left; )
+    {
+        struct pollfd fds[N_JOBS];
+        int idx[N_JOBS], n = 0;
+        for (int i = 0; i < N_JOBS; ++i)
+        {
+            if (done[i]) continue;
+            fds[n].fd = pcompare_job_fd(jobs[i]);
+            fds[n].events = POLLIN;
+            idx[n++] = i;
+        }
+        if (poll(fds, n, JOB_TIMEOUT_MS) <= 0)
+        {
+            printf("FAIL: %d jobs hang\n", left);
+            return EXIT_FAILURE;
+        }
+        for (int k = 0; k < n; ++k)
+        {
+            const int i = idx[k];
+            if (!fds[k].revents) continue;
+            const int state = pcompare_poll(jobs[i], NULL);
+            if (state < PCOMPARE_JOB_DONE) continue;
+            size_t size = 0;
+            const char *report = pcompare_job_report(jobs[i], &size);
+            if (state != PCOMPARE_JOB_DONE || !report || !size)
+            {
+                printf("FAIL: job %d finished in state %d\n", i, state);
+                res = ERROR;
+            }
+            pcompare_job_free(jobs[i]);
+            done[i] = 1;
+            --left;
+        }
+    }
+
+    /* A job with the reports cache stores its report, the next job takes the same report from the cache */
+    char cache_dir[PATH_MAX + 8];
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cache", dir);
+    const pcompare_options_t cache_options = { url, 0, cache_dir, 0, 0 };
+    char *reports[2] = {NULL, NULL};
+    size_t sizes[2] = {0, 0};
+    for (int i = 0; i < 2 && res == SUCCESS; ++i)
+    {
+        if (run_job(&cache_options, &reports[i], &sizes[i]) != SUCCESS || count_reports(cache_dir) != 1)
+        {
+            printf("FAIL: job %d with the reports cache\n", i);
+            res = ERROR;
+        }
+    }
+    if (res == SUCCESS && (sizes[0] != sizes[1] || memcmp(reports[0], reports[1], sizes[0])))
+    {
+        printf("FAIL: cached report differs\n");
+        res = ERROR;
+    }
+    free(reports[0]);
+    free(reports[1]);
+
+    DIR *d = opendir(cache_dir);
+    struct dirent *entry;
+    while (d && (entry = readdir(d)))
+        unlinkat(dirfd(d), entry->d_name, 0);
+    if (d) closedir(d);
+    rmdir(cache_dir);
+    const char *files[] = {"unsorted", "sorted", "unsorted.json", "sorted.json", "unsorted.json.sha256", "sorted.json.sha256"};
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+        unlink(files[i]);
+    if (chdir("/") == 0)
+        rmdir(dir);
+    if (res != SUCCESS)
+        return EXIT_FAILURE;
+    printf("PASS: %d jobs sharing an unsorted branch, jobs with the reports cache\n", N_JOBS);
+    return EXIT_SUCCESS;
+}
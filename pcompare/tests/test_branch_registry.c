@@ -0,0 +1,70 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Test of the shared branches registry: a downloaded again branch file is parsed anew,
+ * while handles of the old copy stay valid.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pcompare.h"
+
+/**
+ * @brief write_branch  writes "branch.json" the way a download does: to a temporary file renamed at the end
+ * @param n_packages    number of packages
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int write_branch(const int n_packages)
+{
+    FILE *f = fopen("branch.json.tmp", "w");
+    if (!f)
+    {
+        printf("Could not create \"branch.json.tmp\"\n");
+        return ERROR;
+    }
+    fprintf(f, "{\"request_args\": {}, \"length\": %d, \"packages\": [", n_packages);
+    for (int i = 0; i < n_packages; ++i)
+        fprintf(f, "%s{\"name\": \"package-%06d\", \"version\": \"1.0\", \"arch\": \"noarch\"}", i ? ", " : "", i);
+    fprintf(f, "]}\n");
+    if (fclose(f) != 0 || rename("branch.json.tmp", "branch.json") != 0)
+        return ERROR;
+    return SUCCESS;
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/pcompare-test-XXXXXX";
+    int res = EXIT_FAILURE;
+
+    if (!mkdtemp(dir) || chdir(dir) != 0)
+    {
+        printf("Could not create a temporary directory\n");
+        return EXIT_FAILURE;
+    }
+    if (write_branch(10) != SUCCESS)
+        return EXIT_FAILURE;
+    pcompare_branch_t *old_branch = pcompare_branch_acquire("branch");
+    pcompare_branch_t *same_branch = pcompare_branch_acquire("branch");
+    if (write_branch(20) != SUCCESS)
+        return EXIT_FAILURE;
+    pcompare_branch_t *new_branch = pcompare_branch_acquire("branch");
+
+    if (!old_branch || !new_branch || same_branch != old_branch)
+        printf("FAIL: branch was not acquired\n");
+    else if (new_branch == old_branch || pcompare_branch_size(new_branch) != 20)
+        printf("FAIL: stale copy of the replaced file is returned\n");
+    else if (pcompare_branch_size(old_branch) != 10)
+        printf("FAIL: old copy is changed\n");
+    else
+        res = EXIT_SUCCESS;
+
+    pcompare_branch_release(old_branch);
+    pcompare_branch_release(same_branch);
+    pcompare_branch_release(new_branch);
+    unlink("branch.json");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    if (res == EXIT_SUCCESS)
+        printf("PASS: replaced branch file is parsed anew\n");
+    return res;
+}
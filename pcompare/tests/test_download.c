@@ -0,0 +1,376 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Test of branch downloads against a local HTTP server stand-in which accepts byte ranges
+ * (or only advertises them).
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "pcompare.h"
+#include "download.h"
+
+#define BODY_SIZE           (3 * 1024 * 1024 + 12345)  // several ranges of a download
+#define REQUEST_LEN         4096
+
+#define SERVE_RANGES        0   // ranges are answered with 206
+#define SERVE_FIRST_RANGE   1   // only the first range is answered, other connections are dropped
+#define SERVE_WHOLE_BODY    2   // ranges are advertised, but requests are answered with 200 and the whole body
+#define SERVE_SLOW_BODY     3   // ranges are not advertised, the whole body is sent slowly by chunks
+#define SERVE_CHANGING_BODY 4   // ranges are answered, the body and its ETag are changed after the first range
+#define SLOW_CHUNK_SIZE     (64 * 1024)
+#define SLOW_CHUNK_DELAY_US 2000
+
+static char     *bodies[2];                 //served file versions
+static int      version;                    //served version, changed under version_lock
+static pthread_mutex_t version_lock = PTHREAD_MUTEX_INITIALIZER;
+static int      serve_mode = SERVE_RANGES;  //SERVE_* mode (atomic)
+static const char *thread_url;              //URL of downloads in threads
+
+/**
+ * @brief send_all  sends a buffer to a socket
+ * @return          SUCCESS on success, ERROR otherwise
+ */
+static int send_all(const int sock, const char *buf, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = send(sock, buf, len, MSG_NOSIGNAL);
+        if (n <= 0) return ERROR;
+        buf += n;
+        len -= n;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief serve_request     answers one request of a connection and closes it
+ * @param param             connection socket
+ */
+static void *serve_request(void *param)
+{
+    const int sock = (int)(intptr_t)param;
+    char request[REQUEST_LEN];
+    char header[512];
+    size_t len = 0;
+
+    while (len < sizeof(request) - 1)
+    {
+        ssize_t n = recv(sock, request + len, sizeof(request) - 1 - len, 0);
+        if (n <= 0) break;
+        len += n;
+        request[len] = 0;
+        if (strstr(request, "\r\n\r\n")) break;
+    }
+    request[len] = 0;
+
+    const int mode = __atomic_load_n(&serve_mode, __ATOMIC_ACQUIRE);
+    const int head = !strncmp(request, "HEAD ", 5);
+    unsigned long long first = 0, last = BODY_SIZE - 1;
+    const char *range = strcasestr(request, "\r\nRange: bytes=");
+    int ranged = range && sscanf(range, "\r\nRange: bytes=%llu-%llu", &first, &last) == 2;
+    if (last >= BODY_SIZE) last = BODY_SIZE - 1;
+
+    /* A range of a changed body is not served if the request has the old ETag in If-Range */
+    char etag[16];
+    pthread_mutex_lock(&version_lock);
+    const int served = version;
+    if (ranged && mode == SERVE_CHANGING_BODY)
+        version = 1;
+    pthread_mutex_unlock(&version_lock);
+    const char *body = bodies[served];
+    snprintf(etag, sizeof(etag), "\"v%d\"", served + 1);
+    const char *if_range = strcasestr(request, "\r\nIf-Range: ");
+    if (ranged && if_range && strncmp(if_range + strlen("\r\nIf-Range: "), etag, strlen(etag)))
+        ranged = 0;
+    if (mode == SERVE_WHOLE_BODY)
+    {
+        ranged = 0;
+        first = 0;
+        last = BODY_SIZE - 1;
+    }
+
+    if (ranged && mode == SERVE_FIRST_RANGE && first)
+    {
+        close(sock);
+        return NULL;
+    }
+    if (ranged)
+        snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\nContent-Length: %llu\r\n"
+                 "Content-Range: bytes %llu-%llu/%d\r\n", last - first + 1, first, last, BODY_SIZE);
+    else
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n", BODY_SIZE);
+    if (mode != SERVE_SLOW_BODY)
+        strcat(header, "Accept-Ranges: bytes\r\n");
+    strcat(header, "ETag: ");
+    strcat(header, etag);
+    strcat(header, "\r\nConnection: close\r\n\r\n");
+    if (send_all(sock, header, strlen(header)) == SUCCESS && !head)
+    {
+        if (mode != SERVE_SLOW_BODY)
+            send_all(sock, body + first, last - first + 1);
+        else
+        {
+            for (size_t sent = 0; sent < BODY_SIZE; sent += SLOW_CHUNK_SIZE)
+            {
+                const size_t len = (BODY_SIZE - sent < SLOW_CHUNK_SIZE) ? BODY_SIZE - sent : SLOW_CHUNK_SIZE;
+                if (send_all(sock, body + sent, len) != SUCCESS) break;
+                usleep(SLOW_CHUNK_DELAY_US);
+            }
+        }
+    }
+    close(sock);
+    return NULL;
+}
+
+/**
+ * @brief server_thread     accepts connections of the HTTP server stand-in
+ * @param param             listening socket
+ */
+static void *server_thread(void *param)
+{
+    const int listen_sock = (int)(intptr_t)param;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (1)
+    {
+        int sock = accept(listen_sock, NULL, NULL);
+        if (sock < 0) continue;
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, serve_request, (void *)(intptr_t)sock) != 0)
+            close(sock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief server_start  starts the HTTP server stand-in on a free local port
+ * @return              port number, 0 on error
+ */
+static int server_start(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    pthread_t thread;
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, 64) != 0 ||
+        getsockname(sock, (struct sockaddr *)&addr, &addr_len) != 0 ||
+        pthread_create(&thread, NULL, server_thread, (void *)(intptr_t)sock) != 0)
+        return 0;
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * @brief check_file    compares a downloaded file with the served body
+ * @param fname         file name
+ * @param body          served body version
+ * @return              SUCCESS if the file is equal to the body, ERROR otherwise
+ */
+static int check_file(const char *fname, const char *body)
+{
+    char *data = malloc(BODY_SIZE + 1);
+    FILE *f = fopen(fname, "rb");
+    int res = ERROR;
+    if (data && f && fread(data, 1, BODY_SIZE + 1, f) == BODY_SIZE && !memcmp(data, body, BODY_SIZE))
+        res = SUCCESS;
+    if (f) fclose(f);
+    free(data);
+    return res;
+}
+
+/**
+ * @brief interrupt_download    makes an interrupted download with the first range completed
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+static int interrupt_download(const char *url)
+{
+    __atomic_store_n(&serve_mode, SERVE_FIRST_RANGE, __ATOMIC_RELEASE);
+    const int res = download_file(url, "branch.json", "branch");
+    __atomic_store_n(&serve_mode, SERVE_RANGES, __ATOMIC_RELEASE);
+    return (res != SUCCESS && access("branch.json.ranges", F_OK) == 0) ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief download_thread   downloads the branch from thread_url
+ * @param param             pointer to the download result
+ */
+static void *download_thread(void *param)
+{
+    *(int *)param = download_file(thread_url, "branch.json", "branch");
+    return NULL;
+}
+
+/**
+ * @brief count_files   counts files of the current directory
+ * @return              number of files
+ */
+static int count_files(void)
+{
+    int n = 0;
+    DIR *dir = opendir(".");
+    if (!dir) return -1;
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+    {
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+            ++n;
+    }
+    closedir(dir);
+    return n;
+}
+
+/**
+ * @brief concurrent_downloads  downloads the branch by two threads at once, checks that an existing file
+ *                              is never seen incomplete
+ * @param mode                  SERVE_* mode
+ * @param existing              1 if the file exists before the downloads
+ * @return                      SUCCESS on success, ERROR otherwise
+ */
+static int concurrent_downloads(const int mode, const int existing)
+{
+    pthread_t threads[2];
+    int results[2] = {ERROR, ERROR};
+    int joined[2] = {0, 0};
+    int res = SUCCESS;
+
+    __atomic_store_n(&serve_mode, mode, __ATOMIC_RELEASE);
+    for (int i = 0; i < 2; ++i)
+    {
+        if (pthread_create(&threads[i], NULL, download_thread, &results[i]) != 0)
+            return ERROR;
+    }
+    /* Readers may map the file while it is downloaded again: it must stay complete */
+    for (int running = 1; running; )
+    {
+        struct stat st;
+        running = 0;
+        for (int i = 0; i < 2; ++i)
+        {
+            if (!joined[i] && pthread_tryjoin_np(threads[i], NULL) == 0)
+                joined[i] = 1;
+            running |= !joined[i];
+        }
+        if (existing && (stat("branch.json", &st) != 0 || st.st_size != BODY_SIZE))
+            res = ERROR;
+        usleep(500);
+    }
+    __atomic_store_n(&serve_mode, SERVE_RANGES, __ATOMIC_RELEASE);
+    if (res != SUCCESS)
+        printf("Incomplete file is seen during a download\n");
+    if (results[0] != SUCCESS || results[1] != SUCCESS || check_file("branch.json", bodies[0]) != SUCCESS ||
+        count_files() != 1)
+        res = ERROR;
+    return res;
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/pcompare-test-XXXXXX";
+    char url[64];
+    int failed = 0;
+
+    for (int v = 0; v < 2; ++v)
+    {
+        bodies[v] = malloc(BODY_SIZE);
+        if (!bodies[v]) return EXIT_FAILURE;
+        for (size_t i = 0; i < BODY_SIZE; ++i)
+            bodies[v][i] = 'a' + (i * (7 + v) + i / 4096) % 26;
+    }
+    const int port = server_start();
+    if (!port || !mkdtemp(dir) || chdir(dir) != 0)
+    {
+        printf("Could not start the test server\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/branch", port);
+
+    /* A ranged download */
+    if (download_file(url, "branch.json", "branch") != SUCCESS || check_file("branch.json", bodies[0]) != SUCCESS ||
+        access("branch.json.part", F_OK) == 0 || access("branch.json.ranges", F_OK) == 0)
+    {
+        printf("FAIL: ranged download\n");
+        ++failed;
+    }
+
+    /* Resumes of interrupted downloads whose partial file was removed or truncated */
+    for (int truncated = 0; truncated < 2; ++truncated)
+    {
+        unlink("branch.json");
+        if (interrupt_download(url) != SUCCESS)
+        {
+            printf("FAIL: download was not interrupted\n");
+            ++failed;
+            continue;
+        }
+        if (truncated ? truncate("branch.json.part", 1000) : unlink("branch.json.part"))
+            ++failed;
+        if (download_file(url, "branch.json", "branch") != SUCCESS || check_file("branch.json", bodies[0]) != SUCCESS)
+        {
+            printf("FAIL: resume with %s partial file\n", truncated ? "truncated" : "removed");
+            ++failed;
+        }
+    }
+
+    /* A server which ignores ranges */
+    unlink("branch.json");
+    __atomic_store_n(&serve_mode, SERVE_WHOLE_BODY, __ATOMIC_RELEASE);
+    if (download_file(url, "branch.json", "branch") != SUCCESS || check_file("branch.json", bodies[0]) != SUCCESS ||
+        access("branch.json.part", F_OK) == 0 || access("branch.json.ranges", F_OK) == 0)
+    {
+        printf("FAIL: download from a server answering ranges with the whole body\n");
+        ++failed;
+    }
+
+    /* Two threads downloading the same branch */
+    thread_url = url;
+    unlink("branch.json");
+    if (concurrent_downloads(SERVE_RANGES, 0) != SUCCESS)
+    {
+        printf("FAIL: concurrent ranged downloads\n");
+        ++failed;
+    }
+    if (concurrent_downloads(SERVE_SLOW_BODY, 1) != SUCCESS)
+    {
+        printf("FAIL: concurrent downloads over a single connection\n");
+        ++failed;
+    }
+
+    /* The body is changed after the first range: the other ranges must not be taken from the new body */
+    unlink("branch.json");
+    __atomic_store_n(&serve_mode, SERVE_CHANGING_BODY, __ATOMIC_RELEASE);
+    if (download_file(url, "branch.json", "branch") != SUCCESS || check_file("branch.json", bodies[1]) != SUCCESS ||
+        access("branch.json.part", F_OK) == 0 || access("branch.json.ranges", F_OK) == 0)
+    {
+        printf("FAIL: download of a body changed during the download\n");
+        ++failed;
+    }
+    __atomic_store_n(&serve_mode, SERVE_RANGES, __ATOMIC_RELEASE);
+
+    const char *files[] = {"branch.json", "branch.json.part", "branch.json.ranges"};
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+        unlink(files[i]);
+    if (chdir("/") == 0)
+        rmdir(dir);
+    free(bodies[0]);
+    free(bodies[1]);
+    if (failed)
+        return EXIT_FAILURE;
+    printf("PASS: downloads from a range-capable server\n");
+    return EXIT_SUCCESS;
+}
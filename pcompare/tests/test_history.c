@@ -0,0 +1,321 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Test of the history archive: snapshots with added, removed, changed and re-added packages
+ * are archived over a checkpoint rollover and every one is reconstructed exactly;
+ * truncated and corrupted archive files are rejected.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "pcompare.h"
+
+#define N_KEYS              400     // package names and archs of the test, two archs per name
+#define N_INITIAL_KEYS      300     // packages of the first snapshot
+#define N_DAYS              36      // snapshots: a checkpoint, 30 deltas, a checkpoint and the rest deltas
+#define CHECKPOINT_INTERVAL 30      // deltas between checkpoints of the archive
+#define N_CHANGED_PER_DAY   4
+
+static int  versions[N_DAYS][N_KEYS];   //version of every package of every snapshot, 0 if absent
+
+/**
+ * @brief key_name  returns the name and the arch of a package key, keys are sorted by name and arch
+ * @param key       package key
+ * @param name      buffer for the name
+ * @param size      buffer size
+ * @return          package arch
+ */
+static const char *key_name(const int key, char *name, const size_t size)
+{
+    snprintf(name, size, "package-%04d", key / 2);
+    return (key % 2) ? "x86_64" : "noarch";
+}
+
+/**
+ * @brief day_date  returns the date of a snapshot
+ * @param day       snapshot index
+ * @param date      buffer for "YYYY-MM-DD"
+ * @param size      buffer size
+ */
+static void day_date(const int day, char *date, const size_t size)
+{
+    /* Every second day, from January the 1st */
+    const int n = day * 2;
+    snprintf(date, size, "2024-%02d-%02d", (n < 31) ? 1 : (n < 60) ? 2 : 3, (n < 31) ? n + 1 : (n < 60) ? n - 30 : n - 59);
+}
+
+/**
+ * @brief make_versions     fills the package versions of every snapshot
+ */
+static void make_versions(void)
+{
+    for (int key = 0; key < N_INITIAL_KEYS; ++key)
+        versions[0][key] = 1;
+    for (int day = 1; day < N_DAYS; ++day)
+    {
+        int *v = versions[day];
+        memcpy(v, versions[day - 1], sizeof(versions[day]));
+        for (int j = 0; j < N_CHANGED_PER_DAY; ++j)
+        {
+            const int key = (day * 11 + j * 97) % N_KEYS;
+            if (v[key]) ++v[key];                           //changed
+        }
+        v[(day * 17) % N_KEYS] = 0;                         //removed
+        if (!v[(N_INITIAL_KEYS + day) % N_KEYS])
+            v[(N_INITIAL_KEYS + day) % N_KEYS] = 1;         //added
+        if (day > 2)
+        {
+            const int key = ((day - 2) * 17) % N_KEYS;      //re-added two snapshots after the removal
+            v[key] = versions[day - 3][key] ? versions[day - 3][key] + 1 : 1;
+        }
+    }
+}
+
+/**
+ * @brief write_branch  writes "branch.json" of a snapshot the way a download does
+ * @param day           snapshot index
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int write_branch(const int day)
+{
+    char name[32];
+    int n = 0;
+    FILE *f = fopen("branch.json.tmp", "w");
+    if (!f)
+    {
+        printf("Could not create \"branch.json.tmp\"\n");
+        return ERROR;
+    }
+    for (int key = 0; key < N_KEYS; ++key)
+        n += versions[day][key] ? 1 : 0;
+    fprintf(f, "{\"request_args\": {}, \"length\": %d, \"packages\": [", n);
+    /* Packages are written in the reversed order, the branch sorts them */
+    for (int key = N_KEYS - 1, first = 1; key >= 0; --key)
+    {
+        if (!versions[day][key]) continue;
+        const char *arch = key_name(key, name, sizeof(name));
+        fprintf(f, "%s{\"name\": \"%s\", \"version\": \"1.%d\", \"arch\": \"%s\"}", first ? "" : ", ",
+                name, versions[day][key], arch);
+        first = 0;
+    }
+    fprintf(f, "]}\n");
+    if (fclose(f) != 0 || rename("branch.json.tmp", "branch.json") != 0)
+        return ERROR;
+    return SUCCESS;
+}
+
+/**
+ * @brief check_branch  compares a reconstructed branch with a snapshot
+ * @param branch        branch handle
+ * @param day           snapshot index
+ * @return              SUCCESS if the branch has the packages of the snapshot, ERROR otherwise
+ */
+static int check_branch(const pcompare_branch_t *branch, const int day)
+{
+    char name[32], version[32];
+    size_t pos = 0;
+
+    for (int key = 0; key < N_KEYS; ++key)
+    {
+        if (!versions[day][key]) continue;
+        pcompare_package_t package;
+        const char *arch = key_name(key, name, sizeof(name));
+        snprintf(version, sizeof(version), "1.%d", versions[day][key]);
+        if (pcompare_branch_package(branch, pos++, &package) != SUCCESS ||
+            package.name_len != strlen(name) || memcmp(package.name, name, package.name_len) ||
+            package.version_len != strlen(version) || memcmp(package.version, version, package.version_len) ||
+            package.arch_len != strlen(arch) || memcmp(package.arch, arch, package.arch_len))
+            return ERROR;
+    }
+    return (pcompare_branch_size(branch) == pos) ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief check_day     reconstructs a snapshot from the archive and checks it
+ * @param date          date to open, NULL for the last snapshot
+ * @param day           expected snapshot index
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int check_day(const char *date, const int day)
+{
+    pcompare_branch_t *branch = pcompare_history_open("archive", "branch", date);
+    const int res = (branch && check_branch(branch, day) == SUCCESS) ? SUCCESS : ERROR;
+    pcompare_branch_release(branch);
+    return res;
+}
+
+/**
+ * @brief check_files   checks that the checkpoints are written at the start and after every interval of deltas
+ * @return              SUCCESS on success, ERROR otherwise
+ */
+static int check_files(void)
+{
+    char date[32], path[64];
+    for (int day = 0; day < N_DAYS; ++day)
+    {
+        day_date(day, date, sizeof(date));
+        const int full = !(day % (CHECKPOINT_INTERVAL + 1));
+        snprintf(path, sizeof(path), "archive/branch/%s.%s", date, full ? "full" : "delta");
+        if (access(path, F_OK) != 0)
+        {
+            printf("No archive file \"%s\"\n", path);
+            return ERROR;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief corrupt_file  corrupts a file of the archive and restores it
+ * @param path          file path
+ * @param how           0 - truncate, 1 - overwrite the signature, 2 - append garbage
+ * @param date          date of the snapshot using the file
+ * @return              SUCCESS if the corrupted file is rejected, ERROR otherwise
+ */
+static int corrupt_file(const char *path, const int how, const char *date)
+{
+    struct stat st;
+    char *data = NULL;
+    FILE *f = fopen(path, "rb");
+    if (!f || stat(path, &st) != 0 || !(data = malloc(st.st_size)) || fread(data, 1, st.st_size, f) != (size_t)st.st_size)
+    {
+        if (f) fclose(f);
+        free(data);
+        return ERROR;
+    }
+    fclose(f);
+
+    int res = SUCCESS;
+    for (off_t cut = 1; how == 0 && cut < st.st_size && res == SUCCESS; cut += (cut < 16) ? 1 : st.st_size / 7)
+    {
+        /* Every truncation must be rejected, from the end of the last record to the signature */
+        if (truncate(path, st.st_size - cut) != 0)
+            res = ERROR;
+        pcompare_branch_t *branch = pcompare_history_open("archive", "branch", date);
+        if (branch) res = ERROR;
+        pcompare_branch_release(branch);
+    }
+    if (how)
+    {
+        f = fopen(path, (how == 1) ? "r+b" : "ab");
+        if (!f || fwrite("XXXX", 1, 4, f) != 4)
+            res = ERROR;
+        if (f) fclose(f);
+        pcompare_branch_t *branch = pcompare_history_open("archive", "branch", date);
+        if (branch) res = ERROR;
+        pcompare_branch_release(branch);
+    }
+
+    f = fopen(path, "wb");
+    if (!f || fwrite(data, 1, st.st_size, f) != (size_t)st.st_size)
+        res = ERROR;
+    if (f) fclose(f);
+    free(data);
+    return res;
+}
+
+/**
+ * @brief remove_tree   removes the archive directory
+ */
+static void remove_tree(void)
+{
+    DIR *d = opendir("archive/branch");
+    struct dirent *entry;
+    while (d && (entry = readdir(d)))
+        unlinkat(dirfd(d), entry->d_name, 0);
+    if (d) closedir(d);
+    rmdir("archive/branch");
+    rmdir("archive");
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/pcompare-test-XXXXXX";
+    char date[32], path[64];
+    int failed = 0;
+
+    if (!mkdtemp(dir) || chdir(dir) != 0)
+    {
+        printf("Could not create a temporary directory\n");
+        return EXIT_FAILURE;
+    }
+    make_versions();
+
+    /* Every snapshot is archived */
+    for (int day = 0; day < N_DAYS && !failed; ++day)
+    {
+        day_date(day, date, sizeof(date));
+        pcompare_branch_t *branch = (write_branch(day) == SUCCESS) ? pcompare_branch_acquire("branch") : NULL;
+        if (!branch || pcompare_history_add("archive", branch, date) != SUCCESS)
+        {
+            printf("FAIL: snapshot of %s was not archived\n", date);
+            ++failed;
+        }
+        pcompare_branch_release(branch);
+    }
+    if (!failed && check_files() != SUCCESS)
+    {
+        printf("FAIL: checkpoints are not written after every %d deltas\n", CHECKPOINT_INTERVAL);
+        ++failed;
+    }
+
+    /* Every snapshot is reconstructed, a date between snapshots takes the earlier one */
+    for (int day = 0; day < N_DAYS && !failed; ++day)
+    {
+        day_date(day, date, sizeof(date));
+        if (check_day(date, day) != SUCCESS)
+        {
+            printf("FAIL: snapshot of %s is not reconstructed exactly\n", date);
+            ++failed;
+        }
+    }
+    if (!failed && (check_day("2024-01-04", 1) != SUCCESS || check_day(NULL, N_DAYS - 1) != SUCCESS ||
+                    check_day("2099-12-31", N_DAYS - 1) != SUCCESS))
+    {
+        printf("FAIL: snapshot of a date without a file is not the previous one\n");
+        ++failed;
+    }
+    pcompare_branch_t *none = failed ? NULL : pcompare_history_open("archive", "branch", "2023-12-31");
+    if (none)
+    {
+        printf("FAIL: snapshot before the first one is opened\n");
+        pcompare_branch_release(none);
+        ++failed;
+    }
+
+    /* Corrupted deltas and checkpoints are rejected, the files before them are still used */
+    const int corrupted_days[] = {5, CHECKPOINT_INTERVAL + 1, N_DAYS - 1};
+    for (size_t i = 0; i < sizeof(corrupted_days) / sizeof(corrupted_days[0]) && !failed; ++i)
+    {
+        const int day = corrupted_days[i];
+        day_date(day, date, sizeof(date));
+        snprintf(path, sizeof(path), "archive/branch/%s.%s", date,
+                 (day % (CHECKPOINT_INTERVAL + 1)) ? "delta" : "full");
+        for (int how = 0; how < 3; ++how)
+        {
+            if (corrupt_file(path, how, date) != SUCCESS)
+            {
+                printf("FAIL: corrupted \"%s\" (%s) is accepted\n", path,
+                       (how == 0) ? "truncated" : (how == 1) ? "signature" : "garbage at the end");
+                ++failed;
+            }
+        }
+        if (check_day(date, day) != SUCCESS)
+        {
+            printf("FAIL: restored \"%s\" is not reconstructed\n", path);
+            ++failed;
+        }
+    }
+
+    remove_tree();
+    unlink("branch.json");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    if (failed)
+        return EXIT_FAILURE;
+    printf("PASS: history archive of %d snapshots is reconstructed, corrupted files are rejected\n", N_DAYS);
+    return EXIT_SUCCESS;
+}
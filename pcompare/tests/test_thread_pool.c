@@ -0,0 +1,163 @@
+/**
+ *  A.V.Ustinov <austinprog@yandex.ru>
+ * Test of waiting for a tasks group from inside a task.
+ * A loader task waits for its subtask group while a foreign task that blocks until the load
+ * is finished is queued: the waiting loader must not execute the foreign task.
+ * Then a long queue is drained by the workers: every task must be executed once.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "pcompare.h"
+#include "thread_pool.h"
+
+#define SUBTASK_HOLD_SEC    1   // time the subtask waits for the foreign task start
+#define TEST_TIMEOUT_SEC    10
+#define N_DRAIN_TASKS       200000  // tasks of a queue drained by the workers
+
+static pthread_mutex_t  lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   changed = PTHREAD_COND_INITIALIZER;
+static int              sub_started;        //the subtask is running on another worker
+static int              loaded;             //the loader has finished
+static int              foreign_started;    //the foreign task is running
+static int              foreign_finished;   //the foreign task has finished
+static tpool_group_t    jobs_group;
+static tpool_group_t    sub_group;
+static unsigned char    drain_runs[N_DRAIN_TASKS];  //executions of every drained task
+
+/**
+ * @brief set_flag  sets a flag and wakes up waiters
+ * @param flag      pointer to the flag
+ */
+static void set_flag(int *flag)
+{
+    pthread_mutex_lock(&lock);
+    *flag = 1;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @brief wait_flag     waits for a flag
+ * @param flag          pointer to the flag
+ * @param timeout_sec   timeout in seconds
+ * @return              1 if the flag is set, 0 on timeout
+ */
+static int wait_flag(const int *flag, const int timeout_sec)
+{
+    struct timespec deadline;
+    int res = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_sec;
+    pthread_mutex_lock(&lock);
+    while (!*flag && res != ETIMEDOUT)
+        res = pthread_cond_timedwait(&changed, &lock, &deadline);
+    res = *flag;
+    pthread_mutex_unlock(&lock);
+    return res;
+}
+
+/**
+ * @brief sub_task  subtask of the loader, keeps its group pending until the foreign task starts
+ */
+static void sub_task(void *param)
+{
+    (void)param;
+    set_flag(&sub_started);
+    wait_flag(&foreign_started, SUBTASK_HOLD_SEC);
+}
+
+/**
+ * @brief foreign_task  task of another job, blocks until the load is finished
+ */
+static void foreign_task(void *param)
+{
+    (void)param;
+    set_flag(&foreign_started);
+    wait_flag(&loaded, TEST_TIMEOUT_SEC * 2);
+    set_flag(&foreign_finished);
+}
+
+/**
+ * @brief submit_foreign    submits the foreign task from a non-worker thread
+ */
+static void *submit_foreign(void *param)
+{
+    (void)param;
+    tpool_submit(&jobs_group, foreign_task, NULL);
+    return NULL;
+}
+
+/**
+ * @brief loader_task   submits a subtask, lets it be stolen, queues the foreign task and waits
+ */
+static void loader_task(void *param)
+{
+    (void)param;
+    tpool_submit(&sub_group, sub_task, NULL);
+    if (!wait_flag(&sub_started, TEST_TIMEOUT_SEC))
+        printf("The subtask was not stolen\n");
+    /* The foreign task comes to the injection queue as a task submitted by a non-worker thread */
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, submit_foreign, NULL) == 0)
+        pthread_join(thread, NULL);
+    tpool_group_wait(&sub_group);
+    set_flag(&loaded);
+}
+
+/**
+ * @brief drain_task    counts an execution of a drained task
+ * @param param         task index
+ */
+static void drain_task(void *param)
+{
+    __atomic_add_fetch(&drain_runs[(size_t)param], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief drain_queue   submits many tasks to the injection queue and waits for them
+ * @return              SUCCESS if every task was executed once, ERROR otherwise
+ */
+static int drain_queue(void)
+{
+    tpool_group_t group;
+    tpool_group_init(&group);
+    for (size_t i = 0; i < N_DRAIN_TASKS; ++i)
+        tpool_submit(&group, drain_task, (void *)i);
+    tpool_group_wait(&group);
+    for (size_t i = 0; i < N_DRAIN_TASKS; ++i)
+    {
+        if (__atomic_load_n(&drain_runs[i], __ATOMIC_RELAXED) != 1)
+            return ERROR;
+    }
+    return SUCCESS;
+}
+
+int main(void)
+{
+    if (tpool_set_threads(2) != SUCCESS || tpool_threads() != 2)
+    {
+        printf("FAIL: could not start 2 workers\n");
+        return EXIT_FAILURE;
+    }
+    tpool_group_init(&jobs_group);
+    tpool_group_init(&sub_group);
+    tpool_submit(&jobs_group, loader_task, NULL);
+
+    if (!wait_flag(&loaded, TEST_TIMEOUT_SEC) || !wait_flag(&foreign_finished, TEST_TIMEOUT_SEC))
+    {
+        printf("FAIL: the waiting loader executed a foreign task and hangs\n");
+        return EXIT_FAILURE;
+    }
+    tpool_group_wait(&jobs_group);
+    if (drain_queue() != SUCCESS)
+    {
+        printf("FAIL: a drained task was not executed exactly once\n");
+        return EXIT_FAILURE;
+    }
+    printf("PASS: group wait executes tasks of its group only, queues are drained\n");
+    return EXIT_SUCCESS;
+}
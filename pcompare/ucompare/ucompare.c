@@ -3,9 +3,366 @@
  * The utility calls functions from libpcompare library
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
 #include "pcompare.h"
 
+#define QUERY_PACKAGES_BUFFER   64      // found packages buffer size for the most of queries
+#define QUERY_PREFIX_MARK       '*'     // trailing mark of a prefix query
+#define BATCH_COMMENT_MARK      '#'     // start of a comment in a batch jobs file
+#define BATCH_SEPARATORS        " \t\r\n"
+#define ARCHIVE_DATE_SEPARATOR  '@'     // separator of a branch name and a date of the archive
+
+/**
+ * @brief usage     prints the utility usage
+ * @param name      utility name
+ */
+static void usage(const char *name)
+{
+    printf("Usage: %s [-j threads] [-u url] [-s] [-M size] [-c dir [-C size]] branch1 branch2\n", name);
+    printf("       %s [-j threads] [-u url] [-s] -m [-o dir] branch1 branch2 [branch3 ...]\n", name);
+    printf("       %s [-j threads] [-u url] -q name[,name...] branch1 [branch2 ...]\n", name);
+    printf("       %s [-j threads] [-u url] [-s] [-o dir] -b jobs_file\n", name);
+    printf("       %s [-j threads] [-u url] -A dir -a date branch1 [branch2 ...]\n", name);
+    printf("       %s [-j threads] -A dir [-s] branch1[@date] branch2[@date]\n", name);
+    printf("       %s [-j threads] -A dir -q name[,name...] branch1[@date] [branch2[@date] ...]\n", name);
+    printf("  -j, --threads threads     number of worker threads (default: number of CPUs)\n");
+    printf("  -u, --url url             URL of the branches export, a branch is loaded from \"<url>/<branch>\"\n");
+    printf("  -M, --max-memory size     compare within a memory budget using temporary files,\n");
+    printf("                            size in bytes with optional K, M or G suffix (at least 4M)\n");
+    printf("  -s, --summary             output lengths and per-architecture counters of the arrays only\n");
+    printf("  -c, --cache dir           reuse reports of unchanged branches from the cache directory\n");
+    printf("  -C, --cache-size size     cache size limit with optional K, M or G suffix (default: unlimited)\n");
+    printf("  -m, --matrix              matrix mode: compare every pair of the branches\n");
+    printf("  -o, --out-dir dir         matrix mode: write one \"<branch1>_vs_<branch2>.json\" file per pair to dir\n");
+    printf("  -b, --batch jobs_file     batch mode: run comparison jobs of the file, one \"branch1 branch2 [report_file]\"\n");
+    printf("                            per line, the default report file is \"<branch1>_vs_<branch2>.json\" (in -o dir);\n");
+    printf("                            every branch is downloaded and parsed once\n");
+    printf("  -q, --query names         output versions of the packages in every branch,\n");
+    printf("                            a name ending with '%c' is a prefix query\n", QUERY_PREFIX_MARK);
+    printf("  -A, --archive dir         history archive directory: branches are taken from the archive\n");
+    printf("                            as \"branch%cYYYY-MM-DD\" (the last snapshot on or before the date)\n",
+           ARCHIVE_DATE_SEPARATOR);
+    printf("                            or \"branch\" (the last snapshot), nothing is downloaded\n");
+    printf("  -a, --archive-add date    add the loaded branches to the archive as snapshots of date YYYY-MM-DD\n");
+}
+
+/**
+ * @brief parse_size    parses a size with optional K, M or G suffix
+ * @param str           size string
+ * @param size          pointer to the parsed size
+ * @return              SUCCESS code on success, ERROR code otherwise
+ */
+static int parse_size(const char *str, size_t *size)
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (errno || end == str)
+        return ERROR;
+    switch (*end)
+    {
+        case 'G': case 'g': value <<= 10; /* fall through */
+        case 'M': case 'm': value <<= 10; /* fall through */
+        case 'K': case 'k': value <<= 10; ++end; break;
+        default: break;
+    }
+    if (*end)
+        return ERROR;
+    *size = value;
+    return SUCCESS;
+}
+
+/**
+ * @brief parse_threads     parses a positive number of threads
+ * @param str               number string
+ * @param n_threads         pointer to the parsed number
+ * @return                  SUCCESS code on success, ERROR code otherwise
+ */
+static int parse_threads(const char *str, size_t *n_threads)
+{
+    char *end;
+    errno = 0;
+    unsigned long value = strtoul(str, &end, 10);
+    if (errno || end == str || *end || *str == '-' || !value)
+        return ERROR;
+    *n_threads = value;
+    return SUCCESS;
+}
+
+/**
+ * @brief out_query_branch  outputs packages found in a branch as JSON array
+ * @param branch            branch handle
+ * @param name              package name or prefix
+ * @param flags             lookup flags
+ * @return                  SUCCESS code on success, ERROR code otherwise
+ */
+static int out_query_branch(const pcompare_branch_t *branch, const char *name, const int flags)
+{
+    pcompare_package_t buffer[QUERY_PACKAGES_BUFFER];
+    pcompare_package_t *packages = buffer;
+    size_t found = pcompare_lookup(branch, name, flags, buffer, QUERY_PACKAGES_BUFFER);
+    if (found > QUERY_PACKAGES_BUFFER)
+    {
+        packages = malloc(found * sizeof(pcompare_package_t));
+        if (!packages)
+        {
+            printf("Memory allocation error\n");
+            return ERROR;
+        }
+        pcompare_lookup(branch, name, flags, packages, found);
+    }
+
+    printf("\"%s\":[\n", pcompare_branch_name(branch));
+    for (size_t i = 0; i < found; ++i)
+    {
+        printf("{\n    \"name\":\"%s\",\n    \"version\":\"%s\",\n    \"arch\":\"%s\"\n}%s\n",
+               packages[i].name, packages[i].version, packages[i].arch, (i + 1 < found) ? "," : "");
+    }
+    printf("]");
+
+    if (packages != buffer) free(packages);
+    return SUCCESS;
+}
+
+/**
+ * @brief close_branches    releases branch handles
+ * @param branches          array of branch handles
+ * @param n_branches        number of branches
+ */
+static void close_branches(pcompare_branch_t **branches, const size_t n_branches)
+{
+    for (size_t i = 0; i < n_branches; ++i)
+        pcompare_branch_close(branches[i]);
+}
+
+/**
+ * @brief open_branches parses opened branch files
+ * @param fparam        pointer to an array of opened f_param_t structures
+ * @param n_branches    number of branches
+ * @param branches      array to store branch handles
+ * @return              SUCCESS code on success, ERROR code otherwise
+ */
+static int open_branches(const f_param_t *fparam, const size_t n_branches, pcompare_branch_t **branches)
+{
+    for (size_t i = 0; i < n_branches; ++i)
+    {
+        branches[i] = pcompare_branch_open(&fparam[i]);
+        if (!branches[i])
+        {
+            close_branches(branches, i);
+            return ERROR;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief open_archive_branches reconstructs branches from the history archive
+ * @param dir                   archive directory
+ * @param names                 array of "branch" or "branch@date" names
+ * @param n_branches            number of branches
+ * @param branches              array to store branch handles
+ * @return                      SUCCESS code on success, ERROR code otherwise
+ */
+static int open_archive_branches(const char *dir, char **names, const size_t n_branches, pcompare_branch_t **branches)
+{
+    for (size_t i = 0; i < n_branches; ++i)
+    {
+        char *date = strrchr(names[i], ARCHIVE_DATE_SEPARATOR);
+        if (date) *date = 0;
+        branches[i] = pcompare_history_open(dir, names[i], date ? date + 1 : NULL);
+        if (date) *date = ARCHIVE_DATE_SEPARATOR;
+        if (!branches[i])
+        {
+            close_branches(branches, i);
+            return ERROR;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief add_to_archive    adds loaded branches to the history archive
+ * @param dir               archive directory
+ * @param fparam            pointer to an array of opened f_param_t structures
+ * @param n_branches        number of branches
+ * @param date              snapshot date
+ * @return                  SUCCESS code on success, ERROR code otherwise
+ */
+static int add_to_archive(const char *dir, const f_param_t *fparam, const size_t n_branches, const char *date)
+{
+    int res = SUCCESS;
+    for (size_t i = 0; i < n_branches && res == SUCCESS; ++i)
+    {
+        pcompare_branch_t *branch = pcompare_branch_open(&fparam[i]);
+        res = branch ? pcompare_history_add(dir, branch, date) : ERROR;
+        pcompare_branch_close(branch);
+    }
+    return res;
+}
+
+/**
+ * @brief run_queries   outputs versions of the queried packages in JSON format
+ * @param branches      array of branch handles
+ * @param n_branches    number of branches
+ * @param queries       comma separated list of names, modified by the function
+ * @return              SUCCESS code on success, ERROR code otherwise
+ */
+static int run_queries(pcompare_branch_t **branches, const size_t n_branches, char *queries)
+{
+    size_t i;
+    int res = SUCCESS;
+
+    char *saveptr = NULL;
+    int first = 1;
+    printf("{\n");
+    for (char *name = strtok_r(queries, ",", &saveptr); name && res == SUCCESS; name = strtok_r(NULL, ",", &saveptr))
+    {
+        int flags = PCOMPARE_LOOKUP_EXACT;
+        printf("%s\"%s\":{\n", first ? "" : ",\n", name);
+        first = 0;
+        size_t len = strlen(name);
+        if (len && name[len - 1] == QUERY_PREFIX_MARK)
+        {
+            name[len - 1] = 0;
+            flags = PCOMPARE_LOOKUP_PREFIX;
+        }
+        for (i = 0; i < n_branches && res == SUCCESS; ++i)
+        {
+            res = out_query_branch(branches[i], name, flags);
+            printf("%s\n", (i + 1 < n_branches) ? "," : "");
+        }
+        printf("}");
+    }
+    printf("\n}\n");
+    return res;
+}
+
+/**
+ * @brief free_batch    releases a batch read by read_batch
+ * @param jobs          array of jobs
+ * @param lines         array of the jobs file lines the jobs branches point to
+ * @param n_jobs        number of jobs
+ */
+static void free_batch(pcompare_batch_job_t *jobs, char **lines, const size_t n_jobs)
+{
+    for (size_t i = 0; i < n_jobs; ++i)
+    {
+        free((char *)jobs[i].out_file);
+        free(lines[i]);
+    }
+    free(jobs);
+    free(lines);
+}
+
+/**
+ * @brief run_batch     reads a batch jobs file and runs the comparisons
+ * @param jobs_file     jobs file name, "-" for the standard input
+ * @param out_dir       directory of the default report files, may be NULL
+ * @param options       pointer to comparison options
+ * @return              SUCCESS code if all jobs succeeded, ERROR code otherwise
+ */
+static int run_batch(const char *jobs_file, const char *out_dir, const pcompare_options_t *options)
+{
+    FILE *in = strcmp(jobs_file, "-") ? fopen(jobs_file, "r") : stdin;
+    if (!in)
+    {
+        printf("Could not open jobs file \"%s\": %s\n", jobs_file, strerror(errno));
+        return ERROR;
+    }
+
+    pcompare_batch_job_t *jobs = NULL;
+    char **lines = NULL;
+    size_t n_jobs = 0, capacity = 0, line_number = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    int res = SUCCESS;
+    while (getline(&line, &line_size, in) >= 0)
+    {
+        ++line_number;
+        char *comment = strchr(line, BATCH_COMMENT_MARK);
+        if (comment) *comment = 0;
+        char *saveptr = NULL;
+        char *words[4];
+        size_t n_words = 0;
+        for (char *word = strtok_r(line, BATCH_SEPARATORS, &saveptr); word && n_words < 4;
+             word = strtok_r(NULL, BATCH_SEPARATORS, &saveptr))
+            words[n_words++] = word;
+        if (!n_words) continue;
+        if (n_words < 2 || n_words > 3)
+        {
+            printf("%s:%lu: \"branch1 branch2 [report_file]\" expected\n", jobs_file, line_number);
+            res = ERROR;
+            break;
+        }
+        if (n_jobs == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            pcompare_batch_job_t *new_jobs = realloc(jobs, capacity * sizeof(pcompare_batch_job_t));
+            char **new_lines = new_jobs ? realloc(lines, capacity * sizeof(char *)) : NULL;
+            if (new_jobs) jobs = new_jobs;
+            if (new_lines) lines = new_lines;
+            if (!new_jobs || !new_lines)
+            {
+                printf("Memory allocation error\n");
+                res = ERROR;
+                break;
+            }
+        }
+        /* Branches point into the line, the line buffer is kept with the job */
+        char *out_file;
+        if (n_words == 3)
+        {
+            out_file = strdup(words[2]);
+        }
+        else
+        {
+            const char *dir = out_dir ? out_dir : ".";
+            const size_t len = snprintf(NULL, 0, "%s/%s_vs_%s.json", dir, words[0], words[1]) + 1;
+            out_file = malloc(len);
+            if (out_file) snprintf(out_file, len, "%s/%s_vs_%s.json", dir, words[0], words[1]);
+        }
+        if (!out_file)
+        {
+            printf("Memory allocation error\n");
+            res = ERROR;
+            break;
+        }
+        jobs[n_jobs].branch1 = words[0];
+        jobs[n_jobs].branch2 = words[1];
+        jobs[n_jobs].out_file = out_file;
+        lines[n_jobs] = line;
+        ++n_jobs;
+        line = NULL;
+        line_size = 0;
+    }
+    free(line);
+    if (in != stdin) fclose(in);
+    if (res == SUCCESS && !n_jobs)
+    {
+        printf("No jobs in \"%s\"\n", jobs_file);
+        res = ERROR;
+    }
+    if (res != SUCCESS)
+    {
+        free_batch(jobs, lines, n_jobs);
+        return res;
+    }
+
+    res = pcompare_process_batch(jobs, n_jobs, options);
+    for (size_t i = 0; i < n_jobs; ++i)
+    {
+        printf("\"%s\" vs \"%s\" -> \"%s\": %s\n", jobs[i].branch1, jobs[i].branch2, jobs[i].out_file,
+               (jobs[i].result == SUCCESS) ? "done" : "failed");
+    }
+    free_batch(jobs, lines, n_jobs);
+    return res;
+}
+
 /**
  * @brief main  the main function of the utility
  * @param argc  number of atguments
@@ -14,22 +371,192 @@
  */
 int main(int argc, char *argv[])
 {
-    const size_t n_branches_to_compare = N_BRANCHES_TO_COMPARE_SUPPORTED;
-    f_param_t fparam[n_branches_to_compare];
+    static const struct option long_options[] =
+    {
+        {"threads",     required_argument, NULL, 'j'},
+        {"url",         required_argument, NULL, 'u'},
+        {"max-memory",  required_argument, NULL, 'M'},
+        {"cache",       required_argument, NULL, 'c'},
+        {"cache-size",  required_argument, NULL, 'C'},
+        {"matrix",      no_argument,       NULL, 'm'},
+        {"out-dir",     required_argument, NULL, 'o'},
+        {"query",       required_argument, NULL, 'q'},
+        {"batch",       required_argument, NULL, 'b'},
+        {"summary",     no_argument,       NULL, 's'},
+        {"archive",     required_argument, NULL, 'A'},
+        {"archive-add", required_argument, NULL, 'a'},
+        {NULL,          0,                 NULL, 0}
+    };
+    int opt;
+    int matrix = 0;
+    const char *out_dir = NULL;
+    char *queries = NULL;
+    const char *batch_file = NULL;
+    pcompare_options_t options = { NULL, 0, NULL, 0, 0 };
+    int summary = 0;
+    size_t n_threads = 0;
+    size_t max_memory = 0;
+    const char *cache_dir = NULL;
+    size_t cache_size = 0;
+    const char *archive_dir = NULL;
+    const char *archive_date = NULL;
 
-    if (argc != (N_BRANCHES_TO_COMPARE_SUPPORTED + 1))
+    while ((opt = getopt_long(argc, argv, "j:u:M:c:C:mo:q:b:sA:a:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'j':
+                if (parse_threads(optarg, &n_threads) != SUCCESS)
+                {
+                    printf("Invalid number of threads \"%s\"\n", optarg);
+                    return ERROR;
+                }
+                if (pcompare_set_threads(n_threads) != SUCCESS)
+                    return ERROR;
+                break;
+            case 'u':
+                options.base_url = optarg;
+                break;
+            case 'M':
+                if (parse_size(optarg, &max_memory) != SUCCESS)
+                {
+                    printf("Invalid memory budget \"%s\"\n", optarg);
+                    return ERROR;
+                }
+                break;
+            case 'c':
+                cache_dir = optarg;
+                break;
+            case 'C':
+                if (parse_size(optarg, &cache_size) != SUCCESS)
+                {
+                    printf("Invalid cache size \"%s\"\n", optarg);
+                    return ERROR;
+                }
+                break;
+            case 'm':
+                matrix = 1;
+                break;
+            case 'o':
+                out_dir = optarg;
+                break;
+            case 'q':
+                queries = optarg;
+                break;
+            case 'b':
+                batch_file = optarg;
+                break;
+            case 's':
+                summary = 1;
+                break;
+            case 'A':
+                archive_dir = optarg;
+                break;
+            case 'a':
+                archive_date = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return ERROR;
+        }
+    }
+
+    const size_t n_branches_to_compare = argc - optind;
+    if (summary && queries)
+    {
+        printf("Option -s can not be combined with -q\n");
+        return ERROR;
+    }
+    options.summary = summary;
+    options.max_memory = max_memory;
+    options.cache_dir = cache_dir;
+    options.cache_size = cache_size;
+    if (batch_file)
+    {
+        if (matrix || queries || max_memory || cache_dir || cache_size || archive_dir || n_branches_to_compare)
+        {
+            printf("Batch mode takes jobs from the file only and can not be combined with -m, -q, -M, -c or -A\n");
+            return ERROR;
+        }
+        return run_batch(batch_file, out_dir, &options);
+    }
+    if (queries && (matrix || out_dir))
+    {
+        printf("Query mode can not be combined with matrix mode\n");
+        return ERROR;
+    }
+    if (archive_date && !archive_dir)
+    {
+        printf("Option -a requires option -A\n");
+        return ERROR;
+    }
+    if (archive_dir && (matrix || max_memory || cache_dir || cache_size || (archive_date && (queries || summary))))
+    {
+        printf("Option -A can not be combined with -m, -M or -c, option -a with -q or -s\n");
+        return ERROR;
+    }
+    const size_t min_branches = (queries || archive_date) ? 1 : N_BRANCHES_TO_COMPARE_SUPPORTED;
+    if ((n_branches_to_compare < min_branches) ||
+        (!matrix && !queries && !archive_date && n_branches_to_compare != N_BRANCHES_TO_COMPARE_SUPPORTED))
+    {
+        printf("Please, enter %s%lu names of branches\n",
+               (matrix || queries || archive_date) ? "at least " : "", min_branches);
+        usage(argv[0]);
+        return ERROR;
+    }
+    if (max_memory && (matrix || queries))
+    {
+        printf("Option -M is supported in two branches comparison only\n");
+        return ERROR;
+    }
+    if ((cache_dir || cache_size) && (matrix || queries))
+    {
+        printf("Option -c is supported in two branches comparison only\n");
+        return ERROR;
+    }
+    if (cache_size && !cache_dir)
     {
-        printf("Please, enter %d names of branches\n", N_BRANCHES_TO_COMPARE_SUPPORTED);
+        printf("Option -C requires option -c\n");
+        return ERROR;
+    }
+    if (out_dir && !matrix)
+    {
+        printf("Option -o is supported in matrix mode only\n");
         return ERROR;
     }
 
-    fparam[0].pack_name = argv[1];
-    fparam[1].pack_name = argv[2];
+    f_param_t fparam[n_branches_to_compare];
+    for (size_t i = 0; i < n_branches_to_compare; ++i)
+    {
+        fparam[i].pack_name = argv[optind + i];
+        fparam[i].fd = -1;
+        fparam[i].fptr = NULL;
+        fparam[i].size = 0;
+    }
 
-    printf("We'll compare package \"%s\" with \"%s\" one\n", fparam[0].pack_name, fparam[1].pack_name);
+    if (queries)
+        printf("We'll look up packages in %lu branches\n", n_branches_to_compare);
+    else if (archive_date)
+        printf("We'll add %lu branches to the archive \"%s\"\n", n_branches_to_compare, archive_dir);
+    else if (matrix)
+        printf("We'll compare every pair of %lu branches\n", n_branches_to_compare);
+    else
+        printf("We'll compare package \"%s\" with \"%s\" one\n", fparam[0].pack_name, fparam[1].pack_name);
+
+    /* Archived branches are reconstructed, nothing is downloaded */
+    if (archive_dir && !archive_date)
+    {
+        pcompare_branch_t *branches[n_branches_to_compare];
+        if (open_archive_branches(archive_dir, argv + optind, n_branches_to_compare, branches) != SUCCESS)
+            return ERROR;
+        int res = queries ? run_queries(branches, n_branches_to_compare, queries)
+                          : pcompare_compare(branches[0], branches[1], stdout, &options);
+        close_branches(branches, n_branches_to_compare);
+        return res;
+    }
 
     /* Load psckages */
-    int resl = pcompare_load_files(fparam, n_branches_to_compare);
+    int resl = pcompare_load_files_from(fparam, n_branches_to_compare, &options);
     if (resl != SUCCESS)
     {
         printf("Load error!\n");
@@ -45,7 +572,22 @@ int main(int argc, char *argv[])
     }
 
     /*Compares branches an out result JSON */
-    res = pcompare_process_branches(fparam, n_branches_to_compare);
+    if (queries)
+    {
+        pcompare_branch_t *branches[n_branches_to_compare];
+        res = open_branches(fparam, n_branches_to_compare, branches);
+        if (res == SUCCESS)
+        {
+            res = run_queries(branches, n_branches_to_compare, queries);
+            close_branches(branches, n_branches_to_compare);
+        }
+    }
+    else if (archive_date)
+        res = add_to_archive(archive_dir, fparam, n_branches_to_compare, archive_date);
+    else if (matrix)
+        res = pcompare_process_matrix(fparam, n_branches_to_compare, out_dir, &options);
+    else
+        res = pcompare_process_branches_to(stdout, fparam, n_branches_to_compare, &options);
 
     pcompare_close_files(fparam, n_branches_to_compare);
 